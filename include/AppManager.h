@@ -12,14 +12,18 @@
 #include "ShellyManager.h"
 #include "LoadManager.h"
 #include "ClimateController.h"
+#include "EnergyMeter.h"
+#include "DeviceReconciler.h"
 
 class AppManager {
 private:
     AppConfig config;
     ConfigManager configManager;
     ShellyManager* shellyManager;
+    DeviceReconciler* reconciler;
     LoadManager* loadManager;
     ClimateController* climateController;
+    EnergyMeter energyMeter;
     
     SemaphoreHandle_t dataMutex;
     TaskHandle_t taskHandle;
@@ -28,14 +32,29 @@ private:
     bool ntpConfigured = false;
     unsigned long lastWifiReconnectAttempt = 0;
     SystemState sharedState;
+    // Guarded by dataMutex: slots whose state changed since the UI last took them
+    std::vector<uint8_t> deviceDirty;
+    std::vector<uint16_t> dirtySlots;
+    std::vector<ConfigChange> pendingChanges; // Guarded by dataMutex
+
+    // Hot reload: the JSON is parsed by a short-lived task, then committed here
+    ConfigManager::Reload* stagedReload = nullptr; // Guarded by dataMutex
+    volatile bool reloadRunning = false;
+    unsigned long lastConfigPoll = 0;
+    unsigned long lastHeapLog = 0;
     
     static void taskFunction(void* parameter);
+    static void reloadTaskFunction(void* parameter);
     void runLoop();
     
     // WiFi management
     bool connectWiFi();
     void setupNTP();
     void handleWiFiReconnect();
+    void queueConfigChange(const ConfigChange& change);
+    void applyConfigChanges();
+    void handleConfigReload();
+    void applyConfigReload(ConfigManager::Reload& reload);
 
 public:
     AppManager();
@@ -47,9 +66,21 @@ public:
 
     // Thread-safe access for UI
     SystemState getSystemState();
+    // Only the devices whose state changed since the last call (all on the first),
+    // without copying the whole snapshot. false if the state lock was busy.
+    bool takeChangedDevices(std::vector<DeviceState>& out);
+    float getTotalPower();
     int getMaxPowerW();
+    // Loaded in begin(); afterwards only the AppTask changes it (see the setters below)
+    const AppConfig& getConfig() const { return config; }
+    const ConfigManager& getConfigManager() const { return configManager; }
     
     // Control methods for UI
     void setDeviceState(String id, bool on);
     void setDeviceTargetTemp(String id, float temp);
+
+    // Persistent settings: applied and journaled by the AppTask
+    void setGlobalSetpoint(float temp);
+    void setDevicePriority(String id, int priority);
+    void setDeviceSchedule(String id, bool enabled, const std::vector<SchedulePoint>& schedule);
 };
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Bump allocator for data that lives for one AppTask cycle: URLs and request
+// bodies, HTTP responses and the JsonDocuments parsed from them. Allocating is a
+// pointer increment, nothing is freed individually and reset() drops everything
+// at once, so a poll cycle does not churn the general heap with small blocks.
+//
+// The block is taken from PSRAM on first use. When it is full, allocations fall
+// back to the heap and are released by reset() as well; highWater() is the
+// largest amount a cycle needed (block + fallbacks), to size the block.
+// Not thread safe: one arena per task.
+class Arena {
+public:
+    explicit Arena(size_t capacity);
+    ~Arena();
+
+    // nullptr only if the heap fallback fails too
+    void* allocate(size_t size);
+    // Grows the most recent allocation in place when it still fits (response
+    // bodies, JSON pools); otherwise allocates and copies
+    void* reallocate(void* p, size_t size);
+    // Releases everything allocated since the last reset: O(1) unless the block overflowed
+    void reset();
+
+    // printf into the arena
+    const char* format(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // ArduinoJson allocator drawing from this arena:
+    //     JsonDocument doc(pollArena.json());
+    ArduinoJson::Allocator* json() { return &jsonAllocator; }
+
+    size_t capacity() const { return cap; }
+    size_t used() const { return top + spillBytes; }
+    size_t highWater() const { return peak; }
+    uint32_t overflows() const { return overflowCount; }  // Allocations that went to the heap
+
+private:
+    struct Header {
+        uint32_t size;      // Requested size
+        uint32_t spilled;   // Allocated on the heap (block full)
+    };
+    union Spill {
+        Spill* next;        // Heap fallbacks, freed by reset()
+        uint64_t align;
+    };
+
+    class JsonAdapter : public ArduinoJson::Allocator {
+    public:
+        explicit JsonAdapter(Arena* arena) : arena(arena) {}
+        void* allocate(size_t size) override { return arena->allocate(size); }
+        void deallocate(void*) override {}
+        void* reallocate(void* p, size_t size) override { return arena->reallocate(p, size); }
+    private:
+        Arena* arena;
+    };
+
+    uint8_t* base = nullptr;
+    size_t cap;
+    size_t top = 0;
+    size_t last = SIZE_MAX;     // Offset of the most recent header in the block
+    size_t peak = 0;
+    Spill* spills = nullptr;
+    size_t spillBytes = 0;
+    uint32_t overflowCount = 0;
+    JsonAdapter jsonAllocator;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+};
+
+// Arena of the AppTask: device polls, commands and discovery draw from it and
+// AppManager resets it at the end of every loop iteration
+extern Arena pollArena;
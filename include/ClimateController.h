@@ -2,20 +2,39 @@
 
 #include <Arduino.h>
 #include <time.h>
+#include <vector>
 #include "ConfigTypes.h"
 #include "ShellyManager.h"
+#include "DeviceReconciler.h"
 
 class ClimateController {
 private:
     ShellyManager* shellyManager;
+    DeviceReconciler* reconciler;
     AppConfig* config;
     
     unsigned long lastUpdate = 0;
-    
-    int getMinutesFromMidnight(struct tm* timeinfo);
-    int parseTime(String timeStr); // "HH:MM" -> minutes
+
+    // Scheduled TRVs, pointing at the schedules compiled in config->devices
+    struct TrvSchedule {
+        String id;
+        const std::vector<ScheduleTransition>* transitions;
+        float activeTarget = -1.0f;
+    };
+    std::vector<TrvSchedule> schedules;
+    bool schedulesBuilt = false;
+
+    // Schedules are re-evaluated only when the next transition is due
+    bool scheduleValid = false;
+    uint16_t evalMinuteOfWeek = 0;
+    uint16_t minutesToNextChange = 0;
+
+    void buildSchedules();
+    void evaluateSchedules(uint16_t minuteOfWeek);
 
 public:
-    ClimateController(ShellyManager* mgr, AppConfig* cfg);
+    ClimateController(ShellyManager* mgr, DeviceReconciler* rec, AppConfig* cfg);
     void update();
+    // Device config changed (schedules, roles, reload): rebuild before the next evaluation
+    void invalidateSchedules() { schedulesBuilt = false; }
 };
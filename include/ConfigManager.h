@@ -4,14 +4,133 @@
 #include <ArduinoJson.h>
 #include <FS.h>
 #include <SD.h>
+#include <vector>
 #include "ConfigTypes.h"
 
+// Runtime change of a mutable setting. Journaled instead of rewriting the JSON.
+struct ConfigChange {
+    enum Op : uint8_t {
+        GLOBAL_SETPOINT = 1,  // setpoint
+        DEVICE_PRIORITY = 2,  // deviceId, priority
+        DEVICE_SCHEDULE = 3   // deviceId, scheduleEnabled, schedule
+    };
+    Op op;
+    String deviceId;
+    float setpoint = 0;
+    int priority = 0;
+    bool scheduleEnabled = false;
+    std::vector<SchedulePoint> schedule;
+};
+
+// /conf.json is the source of truth; /conf.bin is a compiled snapshot of AppConfig
+// (schedules already compiled) loaded with a single read at boot. The snapshot
+// records the size, mtime and CRC of the JSON it was built from and is rebuilt
+// whenever the JSON changes or is saved.
+//
+// Files are replaced atomically: written to <path>.tmp, flushed, then renamed
+// over the original, which is kept as <path>.bak. Runtime changes (ConfigChange)
+// are appended to /conf.jnl on top of that JSON and replayed at load; loop()
+// compacts them into a full save once the journal is large or changes stop.
+//
+// Hot reload of a JSON edited while running: changedOnDisk() (cheap stat, control
+// task), parseReload() (any task, no side effects on the manager), commitReload()
+// (control task: merges runtime fields, diffs and updates the running config in place
+// so the pointers held by the subsystems stay valid).
 class ConfigManager {
+public:
+    // Sections reported as changed by commitReload()
+    enum Section : uint32_t {
+        SECTION_ROOT = 1 << 0,      // wifi, log, timezone
+        SECTION_ENERGY = 1 << 1,    // limits and delays
+        SECTION_METER = 1 << 2,     // main meter id or phases
+        SECTION_CLIMATE = 1 << 3,
+        SECTION_SYSLOG = 1 << 4,
+        SECTION_DEVICES = 1 << 5    // roles, priorities, phases, schedules, devices added/removed
+    };
+
 private:
     const char* filename = "/conf.json";
+    const char* cacheFilename = "/conf.bin";
+    const char* journalFilename = "/conf.jnl";
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint16_t version;     // CACHE_VERSION: bump whenever the payload layout changes
+        uint16_t reserved;
+        uint32_t jsonSize;
+        uint32_t jsonMtime;
+        uint32_t jsonCrc;
+        uint32_t payloadSize;
+        uint32_t crc;         // header up to crc + payload
+    };
+
+    static const uint32_t CACHE_MAGIC = 0x47464348; // "HCFG"
+    static const uint16_t CACHE_VERSION = 2;
+    static const size_t CACHE_MAX = 64 * 1024;
+
+    // The journal starts with a CacheHeader (no payload) naming the JSON it applies to,
+    // followed by records: uint16 length, change, CRC32 of the change
+    static const uint32_t JOURNAL_MAGIC = 0x4C4E4A48; // "HJNL"
+    static const uint16_t JOURNAL_VERSION = 1;
+    static const size_t JOURNAL_COMPACT_BYTES = 16 * 1024;
+    static const unsigned long JOURNAL_COMPACT_IDLE_MS = 5UL * 60UL * 1000UL;
+
+    uint32_t lastLoadMs = 0;
+    bool lastLoadCached = false;
+
+    CacheHeader baseKey = {};       // JSON currently on SD (base of the journal)
+    CacheHeader seenKey = {};       // Last JSON size/mtime considered for a reload
+    uint32_t journalRecords = 0;
+    size_t journalBytes = 0;
+    unsigned long lastChangeMs = 0;
+
     void setDefaults(AppConfig& config);
+    void applyLogSettings(const AppConfig& config);
+    bool loadJson(AppConfig& config, const uint8_t* json, const CacheHeader& key);
+    bool loadBackup(AppConfig& config, CacheHeader& key);
+    bool loadCache(AppConfig& config, CacheHeader& key, bool matchCrc);
+    bool saveCache(const AppConfig& config, const CacheHeader& key);
+    bool readJsonKey(CacheHeader& key, bool withCrc, uint8_t** json);
+    bool diskDiffersFromSeen(CacheHeader& key);
+    static bool keyMatches(const CacheHeader& stored, const CacheHeader& key, bool matchCrc);
+
+    bool writeAtomic(const char* path, const uint8_t* data, size_t len, bool keepBackup);
+    void recoverAtomic(const char* path);
+
+    bool applyChange(AppConfig& config, const ConfigChange& change);
+    bool appendJournal(const ConfigChange& change);
+    void replayJournal(AppConfig& config, const CacheHeader& key, bool matchCrc);
 
 public:
+    struct Reload {
+        AppConfig config;
+        CacheHeader key;
+        bool resave = false;   // Fields were missing or invalid
+    };
+
     bool load(AppConfig& config);
     bool save(const AppConfig& config);
+
+    // Apply a runtime change and append it to the journal (milliseconds, no
+    // reserialization). false if it does not apply: value outside the ConfigSchema.h
+    // range (NaN included) or unknown device.
+    bool apply(AppConfig& config, const ConfigChange& change);
+    // Compact the journal into a full save when due; call periodically from
+    // the task that owns the config. Skipped while the JSON on SD has an edit that
+    // changedOnDisk() has not reported yet.
+    void loop(const AppConfig& config);
+
+    // True once per modification of the JSON by someone else
+    bool changedOnDisk();
+    bool parseReload(Reload& reload);
+    // Returns the changed sections (0 = nothing changed)
+    uint32_t commitReload(AppConfig& config, Reload& reload);
+
+    // Entry for a device that is not in the file: table defaults, role UNKNOWN.
+    // Defaults live only in ConfigSchema.h, the structs carry none.
+    static DeviceConfig makeDevice(const String& id);
+
+    // Duration of the last load() and whether it came from the snapshot (boot profile)
+    uint32_t getLastLoadMs() const { return lastLoadMs; }
+    bool wasLoadedFromCache() const { return lastLoadCached; }
 };
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ConfigTypes.h"
+
+// Single field table for the configuration. Every scalar field of AppConfig,
+// its sections and DeviceConfig is listed once here; ConfigManager expands the
+// tables into defaults, validation, JSON decode/encode and the binary snapshot,
+// so adding a field is one line and the codecs cannot drift apart.
+//
+// X(member, default, min, max): the JSON key is the member name. min/max bound
+// INT and FLOAT fields (out of range = invalid, replaced by the default) and are
+// ignored for bool and String fields.
+//
+// Changing a table changes the snapshot layout: bump ConfigManager::CACHE_VERSION.
+
+#define CONFIG_ROOT_FIELDS(X)                               \
+    X(wifi_ssid, "YOUR_SSID", 0, 0)                         \
+    X(wifi_password, "YOUR_PASSWORD", 0, 0)                 \
+    X(log_level, 0, 0, 2)                                   \
+    X(log_binary, false, 0, 0)                              \
+    X(log_compress, true, 0, 0)                             \
+    X(tz_gmt_offset_sec, 3600, -12 * 3600, 14 * 3600)       \
+    X(tz_dst_offset_sec, 3600, 0, 2 * 3600)
+
+#define CONFIG_ENERGY_FIELDS(X)                             \
+    X(max_power_w, 3300, 1, 100000)                         \
+    X(buffer_power_w, 200, 0, 100000)                       \
+    X(cut_off_delay_s, 10, 0, 3600)                         \
+    X(restore_delay_s, 60, 0, 24 * 3600)                    \
+    X(alarm_enabled, true, 0, 0)                            \
+    X(alarm_freq_hz, 2000, 20, 20000)                       \
+    X(main_meter_id, "AABBCC_0", 0, 0)
+
+#define CONFIG_CLIMATE_FIELDS(X)                            \
+    X(enabled, true, 0, 0)                                  \
+    X(summer_mode, false, 0, 0)                             \
+    X(global_setpoint, 21.0f, 5.0f, 35.0f)                  \
+    X(hysteresis, 0.5f, 0.0f, 5.0f)                         \
+    X(boiler_relay_id, "DDEEFF_0", 0, 0)
+
+#define CONFIG_SYSLOG_FIELDS(X)                             \
+    X(host, "", 0, 0)                                       \
+    X(port, 514, 1, 65535)                                  \
+    X(binary, false, 0, 0)                                  \
+    X(max_lines_per_sec, 50, 0, 10000)
+
+// Per-device scalars (role and schedule have their own encoding). Devices are
+// optional, so their missing fields take the default without being reported.
+#define CONFIG_DEVICE_FIELDS(X)                             \
+    X(name, "", 0, 0)                                       \
+    X(room, "", 0, 0)                                       \
+    X(priority, 0, 0, 100)                                  \
+    X(phase, -1, -1, 15)                                    \
+    X(schedule_enabled, false, 0, 0)
+
+// Array items (device schedule, meter group): only the bounds and defaults come
+// from here, the items keep their own encoding and are not in this snapshot
+// layout. A phase without max_power_w inherits energy.max_power_w.
+#define CONFIG_SCHEDULE_POINT_FIELDS(X)                     \
+    X(temp, 20.0f, 5.0f, 35.0f)
+
+#define CONFIG_METER_PHASE_FIELDS(X)                        \
+    X(max_power_w, 3300, 1, 100000)
+
+// Nested objects of the root: X(member, Type, FIELDS)
+#define CONFIG_SECTIONS(X)                                  \
+    X(energy, EnergyConfig, CONFIG_ENERGY_FIELDS)           \
+    X(climate, ClimateConfig, CONFIG_CLIMATE_FIELDS)        \
+    X(syslog, SyslogConfig, CONFIG_SYSLOG_FIELDS)
@@ -20,9 +20,26 @@ enum class DeviceType {
 };
 
 // Configuration Structures
+struct MeterPhaseConfig {
+    String id;       // Meter channel ID (MAC_Channel), e.g. phase A of a 3EM = "AABBCC_0"
+    int max_power_w; // Limit for this phase only
+};
+
+// Day mask bits follow tm_wday: bit 0 = Sunday ... bit 6 = Saturday
+static const uint8_t SCHEDULE_DAYS_ALL = 0x7F;
+static const uint8_t SCHEDULE_DAYS_WEEKDAYS = 0x3E;
+static const uint8_t SCHEDULE_DAYS_WEEKEND = 0x41;
+
 struct SchedulePoint {
     String time; // "HH:MM"
     float temp;
+    uint8_t days = SCHEDULE_DAYS_ALL; // Days this point applies to
+};
+
+// Schedule point compiled at config load (see ScheduleEngine)
+struct ScheduleTransition {
+    uint16_t minuteOfWeek; // 0 = Sunday 00:00
+    float temp;
 };
 
 struct DeviceConfig {
@@ -30,9 +47,11 @@ struct DeviceConfig {
     String name;
     String room;
     int priority; // 0-100
+    int phase; // Main meter phase the load is wired to (0-based, -1 = unassigned)
     DeviceRole role;
     bool schedule_enabled;
     std::vector<SchedulePoint> schedule;
+    std::vector<ScheduleTransition> compiledSchedule; // Sorted by minuteOfWeek
     
     // Runtime/Discovery info (not necessarily in JSON, but useful here)
     String ip;
@@ -47,6 +66,9 @@ struct EnergyConfig {
     bool alarm_enabled;
     int alarm_freq_hz;
     String main_meter_id;
+    // Optional meter group (index = phase). When empty, main_meter_id is the single
+    // aggregate channel and max_power_w is the only limit.
+    std::vector<MeterPhaseConfig> main_meter_phases;
 };
 
 struct ClimateConfig {
@@ -57,18 +79,31 @@ struct ClimateConfig {
     String boiler_relay_id;
 };
 
+// Remote log collector (UDP). Empty host = disabled.
+struct SyslogConfig {
+    String host;
+    int port;
+    bool binary;            // Binary records (requires log_binary), otherwise RFC 5424
+    int max_lines_per_sec;  // 0 = unlimited
+};
+
 struct AppConfig {
     String wifi_ssid;
     String wifi_password;
     EnergyConfig energy;
     ClimateConfig climate;
+    SyslogConfig syslog;
     std::map<String, DeviceConfig> devices; // Keyed by ID
     // Log level as numeric: 0=INFO, 1=ERROR, 2=DEBUG
-    int log_level = 0; // default INFO
+    int log_level;
+    // Binary log records on SD/Serial instead of text (tools/logdecode.py)
+    bool log_binary;
+    // Compress rotated log generations (<path>.N.lz) in the background
+    bool log_compress;
     // Timezone configuration in seconds: GMT offset and daylight offset (seconds)
     // Example for CET with DST: tz_gmt_offset_sec = 3600, tz_dst_offset_sec = 3600
-    int tz_gmt_offset_sec = 3600;
-    int tz_dst_offset_sec = 3600;
+    int tz_gmt_offset_sec;
+    int tz_dst_offset_sec;
 };
 
 // UI / Shared State Structures
@@ -81,6 +116,8 @@ struct DeviceState {
     float currentTemp; // For TRVs
     float targetTemp;  // For TRVs
     float valvePos;    // For TRVs
+    float energyTodayWh;
+    float energyWeekWh;
     bool isOnline;
     DeviceRole role;
 };
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "ShellyManager.h"
+
+// Desired-state reconciliation for relays and TRV setpoints.
+// Controllers and the UI record what they want; observed state stays in the devices
+// and is refreshed by polling. After each poll the reconciler diffs the two and issues
+// idempotent corrective commands, bounded by a per-device retry budget with backoff,
+// a per-pass batch size and a global command rate.
+class DeviceReconciler {
+public:
+    explicit DeviceReconciler(ShellyManager* mgr);
+
+    // Desired state. Thread-safe (UI task and control task).
+    // releaseWhenReached: forget the desire once observed state matches it, so later
+    // manual changes on the device are not reverted.
+    void setDesiredOn(const String& id, bool on, bool releaseWhenReached = false);
+    void setDesiredTarget(const String& id, float temp, bool releaseWhenReached = false);
+    void release(const String& id);
+
+    // Control task only: diff desired vs observed and send corrective commands
+    void reconcile();
+
+    uint32_t getCommandCount() const { return commandCount; }
+    uint32_t getFailureCount() const { return failureCount; }
+    uint32_t getRateLimitedCount() const { return rateLimitedCount; }
+
+private:
+    struct Desired {
+        bool hasOn = false;
+        bool on = false;
+        bool onRelease = false;
+        bool hasTarget = false;
+        float target = 0.0f;
+        bool targetRelease = false;
+
+        uint8_t attempts = 0;          // corrective commands sent for the current desire
+        unsigned long nextAttempt = 0; // millis() before which no retry is sent
+        uint32_t pollAtCommand = 0;    // poll count when the last command was sent
+    };
+
+    struct Action {
+        String id;
+        bool setOn; // false = setpoint
+        bool on;
+        float target;
+    };
+
+    ShellyManager* shellyManager;
+    SemaphoreHandle_t mutex;
+    std::map<String, Desired> desired;
+
+    // Token bucket shared by all devices
+    float tokens = RATE_BURST;
+    unsigned long lastRefill = 0;
+
+    uint32_t commandCount = 0;
+    uint32_t failureCount = 0;
+    uint32_t rateLimitedCount = 0;
+
+    static constexpr float TARGET_TOLERANCE = 0.1f;
+    static const uint8_t MAX_ATTEMPTS = 5;
+    static const unsigned long RETRY_BASE_MS = 2000;
+    static const unsigned long RETRY_MAX_MS = 60000;
+    static const unsigned long COOLDOWN_MS = 5UL * 60UL * 1000UL;
+    static const size_t MAX_COMMANDS_PER_PASS = 4;
+    static constexpr float RATE_PER_SEC = 2.0f;
+    static constexpr float RATE_BURST = 4.0f;
+
+    bool execute(const Action& a);
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+
+// Per-device energy accounting.
+// Each poll integrates device power trapezoidally and rolls the result into hourly
+// and daily buckets. All buckets live in one fixed-size binary image in PSRAM, so
+// queries are O(buckets) and never replay raw samples. The image is checkpointed to
+// SD record by record: only devices that changed since the last checkpoint are written.
+class EnergyMeter {
+public:
+    static const int MAX_DEVICES = 32;
+    static const int HOURLY_BUCKETS = 48; // 2 days of hourly data
+    static const int DAILY_BUCKETS = 62;  // ~2 months of daily data
+    static const int ID_LEN = 24;
+
+    // Allocate the PSRAM image and restore the last checkpoint from SD
+    bool begin();
+
+    // Feed one power reading (W) for a device. Call once per poll.
+    void addSample(const String& id, float powerW, bool online, unsigned long nowMs);
+
+    // Periodic checkpoint (call from the control loop)
+    void loop();
+    bool checkpoint();
+
+    // Queries (Wh). daysAgo/hoursAgo = 0 is the bucket in progress.
+    float getTodayWh(const String& id) const;
+    float getWeekWh(const String& id) const; // today + previous 6 days
+    float getDayWh(const String& id, int daysAgo) const;
+    float getHourWh(const String& id, int hoursAgo) const;
+
+private:
+    // On-SD / PSRAM layout. Keep POD and fixed-size: records are written in place.
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t maxDevices;
+        uint16_t hourlyBuckets;
+        uint16_t dailyBuckets;
+        int32_t currentHour; // local hours since epoch of the bucket in progress (0 = clock not set)
+        int32_t currentDay;  // local days since epoch
+    };
+
+    struct DeviceRecord {
+        char id[ID_LEN];                 // empty = free slot
+        float hourWh;                    // bucket in progress
+        float dayWh;                     // bucket in progress
+        uint16_t hourly[HOURLY_BUCKETS]; // Wh, ring indexed by hour % HOURLY_BUCKETS
+        uint32_t daily[DAILY_BUCKETS];   // Wh, ring indexed by day % DAILY_BUCKETS
+        uint32_t crc;
+    };
+
+    // Runtime-only integration state (not persisted)
+    struct Integrator {
+        float lastPowerW = 0.0f;
+        unsigned long lastSampleMs = 0;
+        bool hasSample = false;
+        bool dirty = false;
+    };
+
+    Header* header = nullptr;
+    DeviceRecord* records = nullptr;
+    Integrator integrators[MAX_DEVICES];
+    bool headerDirty = false;
+    bool fileStale = false;     // SD file rejected by restore(): next checkpoint rewrites it whole
+    unsigned long lastCheckpoint = 0;
+    unsigned long lastKeyCheck = 0;
+
+    const char* path = "/energy.bin";
+    static const unsigned long CHECKPOINT_INTERVAL_MS = 15UL * 60UL * 1000UL;
+    static const unsigned long MAX_GAP_MS = 5UL * 60UL * 1000UL; // don't integrate across outages
+
+    int findSlot(const String& id) const;
+    int findOrCreateSlot(const String& id);
+    float dayWhAt(int slot, int daysAgo) const;
+    void rollover(int32_t hour, int32_t day);
+    bool restore();
+    static uint32_t recordCrc(const DeviceRecord& rec);
+    static bool localTimeKeys(int32_t& hour, int32_t& day);
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+
+// Append-only compressed history on SD (Gorilla-style).
+// Samples (one per minute per series) are packed into fixed 512-byte blocks:
+// timestamps as delta-of-delta, values as XOR against the previous float, so a
+// slowly changing temperature costs a few bits per sample. Every block carries a
+// CRC and the id (name hash) of its series. A block is written when full, and the
+// block in progress is rewritten in place every few minutes so a power loss costs
+// at most one checkpoint interval.
+class HistoryLog {
+public:
+    typedef void (*SampleCallback)(void* ctx, uint32_t seriesId, uint32_t time, float value);
+
+    static const size_t BLOCK_SIZE = 512;
+    static const int MAX_STREAMS = 16;
+
+    // Stable id for a series name (FNV-1a)
+    static uint32_t seriesId(const String& name);
+
+    void append(uint32_t seriesId, uint32_t time, float value);
+
+    // Write the blocks in progress (call periodically)
+    void loop();
+    bool flush();
+
+    // Replay samples from the last `windowSec` seconds (relative to the newest
+    // sample in the file), in chronological order per series.
+    size_t load(uint32_t windowSec, SampleCallback cb, void* ctx);
+
+private:
+    struct BlockHeader {
+        uint32_t magic;
+        uint32_t seriesId;
+        uint32_t firstTime;
+        uint32_t lastTime;
+        uint16_t count;
+        uint16_t bitCount;
+        uint32_t crc; // header up to crc + payload
+    };
+
+    static const size_t PAYLOAD_SIZE = BLOCK_SIZE - sizeof(BlockHeader);
+    static const uint32_t MAX_BLOCK_SPAN = 24UL * 3600UL; // a block never spans more than a day
+    static const unsigned long CHECKPOINT_INTERVAL_MS = 5UL * 60UL * 1000UL;
+
+    struct Block {
+        BlockHeader header;
+        uint8_t payload[PAYLOAD_SIZE];
+    };
+
+    struct Stream {
+        uint32_t seriesId = 0;
+        bool used = false;
+        bool dirty = false;
+        int32_t fileOffset = -1; // slot reserved for the block in progress
+        uint32_t prevTime = 0;
+        int32_t prevDelta = 0;
+        uint32_t prevBits = 0;
+        uint8_t prevLeading = 0xFF; // 0xFF = no XOR window yet
+        uint8_t prevTrailing = 0;
+        Block block;
+    };
+
+    Stream streams[MAX_STREAMS];
+    unsigned long lastCheckpoint = 0;
+    const char* path = "/history.bin";
+
+    Stream* findStream(uint32_t seriesId);
+    void startBlock(Stream& s, uint32_t time, float value);
+    static uint32_t blockCrc(const Block& b);
+    static size_t decodeBlock(const Block& b, uint32_t fromTime, SampleCallback cb, void* ctx);
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Allocator for every JsonDocument: the pool and strings of a document go to PSRAM
+// (internal RAM only if PSRAM is missing or full), so parsing device replies and the
+// config does not fragment the internal heap that Wi-Fi and LVGL need.
+//
+//     JsonDocument doc(psramJsonAllocator());
+ArduinoJson::Allocator* psramJsonAllocator();
+
+// Internal heap health, to compare before/after changes to the allocation pattern
+struct HeapStats {
+    uint32_t internalFree;
+    uint32_t internalMinFree;    // Low-water mark since boot
+    uint32_t internalLargest;    // Largest block that can still be allocated
+    uint8_t fragmentation;       // % of the free internal heap not in the largest block
+    uint32_t psramFree;
+    uint32_t jsonFallbacks;      // JSON allocations that did not fit in PSRAM
+};
+
+HeapStats readHeapStats();
+// One log line with the stats, prefixed by the given context
+void logHeapStats(const String& context);
@@ -5,24 +5,38 @@
 #include <vector>
 #include "ConfigTypes.h"
 #include "ShellyManager.h"
+#include "DeviceReconciler.h"
 
 class LoadManager {
 private:
     ShellyManager* shellyManager;
+    DeviceReconciler* reconciler;
     EnergyConfig* config;
     
-    unsigned long overloadStartTime = 0;
-    bool isOverloaded = false;
+    // One overload timer per limit: slot 0 is the aggregate (max_power_w),
+    // slots 1..N are the configured meter phases (main_meter_phases).
+    struct LimitState {
+        bool isOverloaded = false;
+        unsigned long overloadStartTime = 0;
+    };
+    std::vector<LimitState> limits;
     
     struct ShedDevice {
         String id;
+        int phase; // Phase the device was shed for (-1 = aggregate)
         unsigned long shedTime;
     };
     std::vector<ShedDevice> shedDevices;
     
     unsigned long lastCheck = 0;
 
+    float slotPower(int slot) const;
+    float slotLimit(int slot) const;
+    bool isShed(const String& id) const;
+    int pickShedCandidate(int phase);
+    bool canRestore(int phase) const;
+
 public:
-    LoadManager(ShellyManager* mgr, EnergyConfig* cfg);
+    LoadManager(ShellyManager* mgr, DeviceReconciler* rec, EnergyConfig* cfg);
     void update();
 };
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+
+// Rotated generations of a log file on SD: <path>.1 (newest) .. <path>.N (oldest).
+// Rotation renames through the chain instead of deleting, and the oldest
+// generations are dropped only when the total exceeds the disk budget.
+// Rotated files can be compressed in the background into <path>.N.lz: a magic
+// followed by independent frames (uint16 raw length, uint16 stored length, data;
+// stored length 0 = raw copy) holding up to FRAME_SIZE bytes each, LZ4-style
+// token/literal/offset sequences. Frames keep reads chunked: a reader only ever
+// decompresses the frame it needs.
+class LogArchive {
+public:
+    static const int MAX_GENERATIONS = 8;
+    static const size_t FRAME_SIZE = 4096;
+
+    // Sequential reader over one generation (0 = live file), compressed or not.
+    // Memory use is bounded by two frames whatever the file size.
+    class Reader {
+    public:
+        ~Reader() { close(); }
+        bool open(const String& path);
+        void close();
+        bool isOpen() const { return (bool)file; }
+        // Uncompressed size (frame headers only for .lz files)
+        size_t size();
+        bool seek(size_t pos);
+        size_t read(uint8_t* buf, size_t len);
+        size_t position() const { return pos; }
+
+    private:
+        File file;
+        bool compressed = false;
+        size_t pos = 0;          // Uncompressed read position
+        size_t totalSize = 0;    // 0 = not computed yet
+        uint8_t* frame = nullptr;      // Decompressed current frame (PSRAM)
+        uint8_t* packed = nullptr;     // Compressed frame as read from SD
+        size_t frameStart = 0;   // Uncompressed offset of the decoded frame
+        size_t frameLen = 0;     // 0 = no frame decoded
+        uint32_t frameOffset = 0; // File offset of the next frame header to load
+
+        bool loadFrameAt(size_t target);
+    };
+
+    void setBasePath(const char* path);
+    const char* getBasePath() const { return base; }
+
+    // <path> becomes <path>.1, every generation moves down by one; the file at
+    // <path> must be closed. Drops generations beyond the limit and the budget.
+    void rotate(size_t budget);
+    void enforceBudget(size_t budget);
+
+    // Path of an existing generation (plain or .lz), empty if missing. 0 = live file.
+    String generationPath(int gen);
+    int generationCount();
+    // Sidecar line index of a generation (see LogReader), moved along on rotation
+    String indexPath(int gen) const { return plainPath(gen) + ".idx"; }
+
+    // Compress one frame of the first uncompressed generation; false if there
+    // is nothing left to do. Meant for the idle time of the writer task.
+    bool compressStep();
+    void abortCompression();
+
+    // Frame codec (mirrored in tools/logdecode.py)
+    static size_t compressFrame(const uint8_t* src, size_t n, uint8_t* dst, size_t cap, uint16_t* table);
+    static size_t decompressFrame(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+private:
+    static const uint32_t MAGIC = 0x315A4C48; // "HLZ1"
+    static const int HASH_BITS = 12;
+
+    const char* base = "/system.log";
+
+    // Background compression state
+    File cIn;
+    File cOut;
+    int cGen = 0;
+    bool cPending = true;    // Rescan for uncompressed generations (cleared when none left or on error)
+    uint8_t* cRaw = nullptr;
+    uint8_t* cPacked = nullptr;
+    uint16_t* cTable = nullptr;
+
+    String plainPath(int gen) const;
+    String packedPath(int gen) const { return plainPath(gen) + ".lz"; }
+    String tempPath(int gen) const { return plainPath(gen) + ".tmp"; }
+    static size_t fileSize(const String& path);
+    bool allocBuffers();
+    void finishCompression();
+};
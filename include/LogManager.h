@@ -2,6 +2,19 @@
 #include <Arduino.h>
 #include <M5Unified.h>
 #include <SD.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/ringbuf.h>
+#include <atomic>
+#include "LogArchive.h"
+
+// Compile-time ceiling for log sites: 0=INFO, 1=ERROR, 2=DEBUG (see LogManager::Level).
+// Release builds can pass -DHOMEAIO_LOG_MAX_LEVEL=1 to compile out every LOG_DEBUG site.
+#ifndef HOMEAIO_LOG_MAX_LEVEL
+#define HOMEAIO_LOG_MAX_LEVEL 2
+#endif
 
 class LogManager {
 public:
@@ -15,6 +28,10 @@ public:
     void error(const String& msg);  // ERROR level
     void debug(const String& msg);  // DEBUG level
 
+    // printf-style, formatted only after the level check (use the LOG_* macros)
+    void logf(Level lvl, const char* file, const char* fmt, ...) __attribute__((format(printf, 4, 5)));
+    bool isEnabled(Level lvl) const { return lvl <= _level; }
+
     // Configuration
     void setLogLevel(Level lvl) { _level = lvl; }
     void setLogLevel(int numericLevel); // Converts 0/1/2 to enum
@@ -22,15 +39,107 @@ public:
 
     void setScreenLogging(bool enabled) { _screenLogging = enabled; }
 
+    // Binary structured log: SD (/system.blg) and Serial get packed records instead of
+    // text lines, the screen still shows text. Decode with tools/logdecode.py.
+    void setBinaryFormat(bool enabled);
+    bool isBinaryFormat() const { return _binary; }
+
+    // Rotated generations are compressed by the writer task when it is idle
+    void setCompressRotated(bool enabled) { _compressRotated = enabled; }
+
     // SD card management
     bool isSdMounted() const { return _sdMounted; }
     void setSdPins(int cs, int sck, int mosi, int miso);
     bool tryRemount();
     String getLogContent();
+    // Generation files for readers (0 = live file): path (empty if missing) and sidecar index
+    String getGenerationPath(int gen) { return _archive.generationPath(gen); }
+    String getIndexPath(int gen) const { return _archive.indexPath(gen); }
+
+    // Lines dropped because the SD ring buffer was full
+    uint32_t getDroppedCount() const { return _dropped; }
+
+    // Remote sink: a separate task sends the lines over UDP to host:port, as RFC 5424
+    // syslog (one message per datagram) or, with binary=true and the binary log format
+    // on, as the same binary records packed several per datagram. Empty host = off.
+    // Callers never wait on Wi-Fi: over the rate limit or with the queue full a line
+    // is dropped and counted, and the counts are reported with the next line sent.
+    void setNetworkSink(const String& host, uint16_t port, bool binary, uint16_t maxLinesPerSec);
+    uint32_t getNetDroppedCount() const { return _netDropped; }
+    uint32_t getNetRateLimitedCount() const { return _netLimited; }
 
 private:
+    // Binary record: REC_SYNC, uint8 type, uint16 payload length, payload (little endian).
+    //  REC_EVENT:  uint32 time, uint16 ms, uint8 level (LEVEL_UPTIME: time is seconds since
+    //              boot), uint16 source, uint32 format id, arguments packed per the format
+    //              string: integers and %p 4 bytes, %ll/%j 8, floating point as float32,
+    //              %s uint8 length + bytes. Format id 0: the rest is plain text (log()).
+    //  REC_FORMAT: uint32 format id, uint16 source, uint8 file name length, file name,
+    //              format string. The SD writer puts every known definition at the top
+    //              of each file it opens and new ones ahead of the data it drains, so a
+    //              definition always precedes its events and never goes through the ring.
+    //              The network task sends them the same way (see netLoop()).
+    static const uint8_t REC_SYNC = 0xA5;
+    static const uint8_t REC_EVENT = 0;
+    static const uint8_t REC_FORMAT = 1;
+    static const uint8_t LEVEL_UPTIME = 0x80;
+    static const size_t REC_MAX = 512;
+    static const size_t FORMAT_SLOTS = 128;
+
+    struct FormatSlot {
+        const char* fmt;      // Literal from the call site: the pointer is the key
+        const char* file;     // __FILE__ of the call site
+        uint32_t id;          // FNV-1a of the format string, stable across builds
+        uint16_t source;      // Hash of the file name
+        uint32_t generation;  // Generation the definition was last sent to Serial in
+    };
+
     void emit(Level lvl, const String& prefix, const String& msg, uint16_t color);
-    void writeToSD(const String& line);
+    void writeToSD(const uint8_t* data, size_t len);
+    void enqueueToSD(const uint8_t* data, size_t len);
+    void sdWrite(const uint8_t* data, size_t len);
+
+    // Network queue item header, followed by the message text or a binary record
+    struct NetItem {
+        uint32_t sec;
+        uint16_t ms;
+        uint8_t level;   // Level, | LEVEL_UPTIME if sec is uptime
+        uint8_t binary;  // Payload is a binary record
+    };
+    static const size_t NET_RING_SIZE = 16 * 1024;      // PSRAM
+    static const size_t NET_DATAGRAM_MAX = 1400;        // Below the Wi-Fi MTU: never fragmented
+    static const uint32_t NET_BATCH_MS = 200;           // Max time a record waits for a full datagram
+    static const uint32_t NET_RESOLVE_RETRY_MS = 30000;
+    static const uint32_t NET_DEFINE_INTERVAL_MS = 60000;  // All definitions sent again
+
+    bool netTextEnabled() const { return _netHandle && _netOn && !(_netBinary && _binary); }
+    bool netRecordsEnabled() const { return _netHandle && _netOn && _netBinary && _binary; }
+    bool netAllow();
+    void netEnqueue(Level lvl, bool binary, const uint8_t* data, size_t len);
+    static void netTask(void* param);
+    void netLoop();
+    bool netResolve();
+    void netSend(const uint8_t* data, size_t len);
+    void netPack(uint8_t* datagram, size_t& used, uint32_t& since, const uint8_t* data, size_t len);
+    void netDefine(uint8_t* datagram, size_t& used, uint32_t& since);
+    size_t formatSyslog(char* out, size_t cap, const NetItem& item, const char* text, size_t len, const char* sd);
+
+    void writeRecord(const uint8_t* rec, size_t len);
+    size_t beginRecord(uint8_t* rec, uint8_t type);
+    size_t endRecord(uint8_t* rec, size_t len);
+    size_t beginEvent(uint8_t* rec, Level lvl, uint16_t source, uint32_t fmtId);
+    size_t encodeText(uint8_t* rec, Level lvl, const char* text);
+    size_t encodeNote(uint8_t* out, const char* text);
+    size_t encodeFormat(uint8_t* rec, const FormatSlot& fs);
+    bool lookupFormat(const char* file, const char* fmt, uint32_t& id, uint16_t& source, bool& define);
+    size_t defineFormats(File* direct);
+
+    // SD writer task: drains the ring buffer into a staging block and keeps the file open
+    static void writerTask(void* param);
+    void writerLoop();
+    bool writerOpen();
+    void writerWrite(const uint8_t* data, size_t len);
+    void writerFlush();
     void printToScreen(const String& line, uint16_t color);
     String makeTimestamp();
 
@@ -42,8 +151,76 @@ private:
     int _sd_sck = -1;
     int _sd_mosi = -1;
     int _sd_miso = -1;
+    // Switching format only sets _binary and _reopen: the writer (or the synchronous
+    // path) picks the file when it reopens, so _logPath has a single writer and always
+    // points at a literal that other tasks can read
     const char* _logPath = "/system.log";
-    const size_t _maxLogSize = 1024 * 1024; // 1MB
+    bool _fileBinary = false;            // Format of the file at _logPath
+    bool _binary = false;
+    FormatSlot _formats[FORMAT_SLOTS] = {};
+    uint8_t _formatOrder[FORMAT_SLOTS];  // Slots in registration order
+    size_t _formatCount = 0;             // Guarded by _formatLock, like the table
+    portMUX_TYPE _formatLock = portMUX_INITIALIZER_UNLOCKED;
+    size_t _fileDefined = 0;             // Registered formats already defined in the SD file
+    volatile uint32_t _generation = 1;  // Bumped on rotation: definitions are sent to Serial again
+    const size_t _maxLogSize = 1024 * 1024; // 1MB, then rotated to <path>.1
+    const size_t _maxDiskBytes = 6 * 1024 * 1024; // Live file + all generations
+    LogArchive _archive;
+    bool _compressRotated = true;
+
+    // Async SD pipeline. Callers only copy into the ring (non-blocking, bounded time).
+    static const size_t RING_SIZE = 64 * 1024;       // PSRAM
+    static const size_t BLOCK_SIZE = 4096;           // SD write unit, aligned to the file offset
+    static const uint32_t FLUSH_INTERVAL_MS = 2000;  // Max time a line waits in the staging block
+    RingbufHandle_t _ring = nullptr;
+    TaskHandle_t _writerHandle = nullptr;
+    std::atomic<uint32_t> _dropped{0}; // Bumped by every logging task
+    volatile bool _reopen = false;   // Set by tryRemount(): writer must reopen the file
+    uint32_t _droppedReported = 0;
+    File _file;
+    size_t _fileSize = 0;
+    uint8_t* _block = nullptr;       // Staging block (internal RAM, DMA capable)
+    size_t _blockLen = 0;
+    uint32_t _blockSince = 0;        // millis() of the oldest unflushed byte
+
+    // Network sink (see setNetworkSink)
+    RingbufHandle_t _netRing = nullptr;
+    TaskHandle_t _netHandle = nullptr;
+    // Host and port belong to the network task: setNetworkSink() leaves them in the
+    // *Next fields and the task takes them over on _netChanged. setNetworkSink()
+    // writes every field below under _netLock
+    char _netHost[64] = "";
+    uint16_t _netPort = 514;
+    char _netHostNext[64] = "";
+    uint16_t _netPortNext = 514;
+    volatile bool _netOn = false;        // A host is configured
+    volatile bool _netBinary = false;
+    volatile bool _netChanged = false;   // Target changed: resolve again
+    uint16_t _netRate = 50;              // Lines per second, burst of 2 s
+    uint32_t _netTokens = 0;             // Token bucket, in 1/1000 lines
+    uint32_t _netRefill = 0;             // millis() of the last refill
+    portMUX_TYPE _netLock = portMUX_INITIALIZER_UNLOCKED;
+    std::atomic<uint32_t> _netDropped{0}; // Queue full, or not sendable
+    std::atomic<uint32_t> _netLimited{0}; // Over the rate limit
+    WiFiUDP _udp;
+    IPAddress _netIp;
+    bool _netResolved = false;
+    uint32_t _netResolveAt = 0;
+    char _netSelf[16] = "-";             // Our IP, used as HOSTNAME
+    size_t _netDefined = 0;              // Registered formats already sent to the collector
 };
 
 extern LogManager SysLog;
+
+// Deferred-format logging. Arguments are not evaluated and nothing is formatted
+// unless the level passes: a filtered line costs one compare, and sites above
+// HOMEAIO_LOG_MAX_LEVEL are removed by the compiler.
+#define HOMEAIO_LOG_AT(lvl, fmt, ...)                                               \
+    do {                                                                            \
+        if ((int)(lvl) <= HOMEAIO_LOG_MAX_LEVEL && SysLog.isEnabled(lvl))           \
+            SysLog.logf(lvl, __FILE__, fmt, ##__VA_ARGS__);                         \
+    } while (0)
+
+#define LOG_INFO(fmt, ...) HOMEAIO_LOG_AT(LogManager::INFO, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) HOMEAIO_LOG_AT(LogManager::ERROR, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) HOMEAIO_LOG_AT(LogManager::DEBUG, fmt, ##__VA_ARGS__)
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+#include <vector>
+#include "LogArchive.h"
+
+// Line-oriented random access to one text log generation (live or rotated, plain
+// or .lz). A sparse index of line starts (one entry every INDEX_LINES lines or at
+// each new minute) is kept in a sidecar file next to the log, so reopening only
+// scans what was appended since. Each entry also records which levels occur in its
+// span: a level filter skips every span that cannot match without reading it.
+// Reads go through a 4 KB chunk cache, never byte by byte.
+class LogReader {
+public:
+    // Level bits, one per LogManager::Level plus lines without a level tag
+    static const uint8_t MASK_INFO = 1 << 0;
+    static const uint8_t MASK_ERROR = 1 << 1;
+    static const uint8_t MASK_DEBUG = 1 << 2;
+    static const uint8_t MASK_OTHER = 1 << 3;
+    static const uint8_t MASK_ALL = 0x0F;
+
+    static const uint32_t INDEX_LINES = 64;
+    static const size_t MAX_LINE = 255;  // Longer lines are cut when read
+
+    typedef void (*LineCallback)(void* ctx, uint32_t pos, const char* text, uint8_t levelMask);
+
+    ~LogReader() { close(); }
+
+    bool open(const String& logPath, const String& indexPath);
+    void close();
+    bool isOpen() const { return reader.isOpen(); }
+
+    // Index lines appended to the live file since the last call; true if any
+    bool refresh();
+
+    // Positions below count only lines whose level is in the mask
+    void setLevelMask(uint8_t mask);
+    uint8_t getLevelMask() const { return levelMask; }
+    uint32_t lineCount() const { return levelMask == MASK_ALL ? totalLines : (uint32_t)matches.size(); }
+
+    // Delivers up to `count` lines from position `first`; returns how many
+    size_t readLines(uint32_t first, size_t count, LineCallback cb, void* ctx);
+
+    // First position whose timestamp is >= t (local time as printed in the log),
+    // lineCount() if none. Lines without a wall-clock time are skipped.
+    uint32_t findTime(uint32_t t);
+    // Timestamp of the line at a position, 0 if unknown
+    uint32_t timeAt(uint32_t pos);
+
+    // "YYYY-mm-dd HH:MM:SS" at the start of a line, as seconds; 0 otherwise
+    static uint32_t parseTime(const char* line, size_t len);
+    static uint8_t parseLevel(const char* line, size_t len);
+
+private:
+    struct IndexEntry {
+        uint32_t offset;  // First byte of the first line of the span
+        uint32_t line;    // Line number of that line
+        uint32_t time;    // Its timestamp (0 = none)
+        uint16_t lines;   // Lines in the span
+        uint8_t levels;   // Level bits present in the span
+        uint8_t reserved;
+    };
+
+    struct IndexHeader {
+        uint32_t magic;
+        uint32_t headCrc;   // CRC of the first bytes of the log: detects a rotated/replaced file
+        uint32_t scanned;   // Bytes covered by the entries
+        uint32_t count;
+    };
+
+    static const uint32_t INDEX_MAGIC = 0x5844494C; // "LIDX"
+    static const size_t HEAD_BYTES = 256;
+    static const size_t CHUNK_SIZE = 4096;
+
+    LogArchive::Reader reader;
+    String logPath;
+    String idxPath;
+    std::vector<IndexEntry> entries;
+    uint32_t scanned = 0;      // End of the last complete line indexed
+    uint32_t totalLines = 0;
+    uint32_t headCrc = 0;
+    size_t savedClosed = 0;    // Closed spans already in the sidecar file
+
+    uint8_t levelMask = MASK_ALL;
+    std::vector<uint32_t> matches;  // Offsets of the lines passing the filter
+    size_t matchedEntries = 0;      // Entries already scanned into `matches`
+
+    uint8_t* chunk = nullptr;  // Read cache (PSRAM)
+    uint32_t chunkStart = 0;
+    size_t chunkLen = 0;
+
+    bool loadIndex();
+    void saveIndex();
+    uint32_t computeHeadCrc();
+    void scan();
+    void updateMatches();
+    // Copies the line at `offset` into buf (NUL terminated, cut at MAX_LINE);
+    // returns the offset of the next line, or `offset` at end of data
+    uint32_t readLineAt(uint32_t offset, char* buf, size_t& len);
+    size_t entryForLine(uint32_t line) const;
+    uint32_t positionOfOffset(uint32_t offset) const;
+};
@@ -0,0 +1,60 @@
+#ifndef LOG_VIEWER_H
+#define LOG_VIEWER_H
+
+#include <lvgl.h>
+#include "LogReader.h"
+
+// Schermata di consultazione del log su SD (creata da codice, non da EEZ).
+// Lista virtualizzata: un numero fisso di righe riempite da LogReader per la
+// posizione corrente, quindi lo scorrimento costa uguale con qualsiasi dimensione del file.
+class LogViewer {
+private:
+    static const int ROWS = 26;
+    static const lv_coord_t ROW_HEIGHT = 24;
+
+    lv_obj_t* screen;
+    lv_obj_t* list;
+    lv_obj_t* rows[ROWS];
+    lv_obj_t* slider;
+    lv_obj_t* fileLabel;
+
+    LogReader reader;
+    int generation;        // 0 = file corrente, 1..N = generazioni ruotate
+    uint32_t topPos;       // Prima riga visibile (posizione filtrata)
+    bool followTail;       // In fondo: segue le righe nuove
+    lv_coord_t dragAccum;  // Pixel di trascinamento non ancora convertiti in righe
+
+    void create();
+    bool openGeneration(int gen);
+    void render();
+    void updateInfo();
+    uint32_t maxTop() const;
+    void scrollTo(uint32_t pos);
+
+    static void onLine(void* ctx, uint32_t pos, const char* text, uint8_t levelMask);
+    static void onOpen(lv_event_t* e);
+    static void onBack(lv_event_t* e);
+    static void onFilter(lv_event_t* e);
+    static void onNav(lv_event_t* e);
+    static void onOlder(lv_event_t* e);
+    static void onNewer(lv_event_t* e);
+    static void onSlider(lv_event_t* e);
+    static void onListPressing(lv_event_t* e);
+
+public:
+    LogViewer();
+
+    // Aggiunge il pulsante "LOG" al contenitore indicato (barra laterale della home)
+    void attach(lv_obj_t* parent);
+    void show();
+
+    // Da chiamare periodicamente mentre la schermata è visibile: indicizza le righe nuove
+    void update();
+
+    lv_obj_t* getScreen() const { return screen; }
+};
+
+// Istanza globale
+extern LogViewer logViewer;
+
+#endif // LOG_VIEWER_H
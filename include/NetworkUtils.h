@@ -10,4 +10,18 @@ struct HttpResult {
 
 HttpResult httpGet(String url);
 HttpResult httpPost(String url, String body);
+
+class Arena;
+
+// Response body kept in an arena (NUL-terminated, valid until the arena is reset)
+struct HttpView {
+	int code; // HTTP status code (<=0 for network errors)
+	const char* payload; // "" when there is no body
+	size_t length;
+};
+
+// Same requests without String copies of the body: the response is read straight
+// into the arena. Used by the poll cycle (pollArena).
+HttpView httpGet(Arena& arena, const char* url);
+HttpView httpPost(Arena& arena, const char* url, const char* body);
 void setWifiPins(int clk, int cmd, int d0, int d1, int d2, int d3, int rst);
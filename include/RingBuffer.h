@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+
+// Fixed-capacity circular buffer, no heap allocation.
+// push() is O(1) and overwrites the oldest sample when full. Logical index 0 is the
+// oldest sample, size()-1 the newest. Storage is a plain contiguous array: the slot
+// holding the oldest sample is physicalIndex(0), so consumers that understand
+// wrap-around (e.g. an LVGL chart with a start point) can read it in place.
+template <typename T, size_t N>
+class RingBuffer {
+public:
+    static_assert(N > 0, "RingBuffer capacity must be > 0");
+
+    void push(const T& value) {
+        buf[head] = value;
+        head = (head + 1) % N;
+        if (count < N) count++;
+    }
+
+    // Drop the oldest sample
+    void popFront() {
+        if (count > 0) count--;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == N; }
+    static constexpr size_t capacity() { return N; }
+
+    // Logical access, oldest -> newest
+    T& operator[](size_t i) { return buf[physicalIndex(i)]; }
+    const T& operator[](size_t i) const { return buf[physicalIndex(i)]; }
+
+    T& front() { return buf[physicalIndex(0)]; }
+    const T& front() const { return buf[physicalIndex(0)]; }
+    T& back() { return buf[(head + N - 1) % N]; }
+    const T& back() const { return buf[(head + N - 1) % N]; }
+
+    // Raw storage for in-place readers
+    T* data() { return buf; }
+    const T* data() const { return buf; }
+    size_t physicalIndex(size_t i) const { return (head + N - count + i) % N; }
+
+    // Minimal forward iteration (oldest -> newest), enough for range-for
+    class const_iterator {
+    public:
+        const_iterator(const RingBuffer* rb, size_t i) : rb(rb), i(i) {}
+        const T& operator*() const { return (*rb)[i]; }
+        const T* operator->() const { return &(*rb)[i]; }
+        const_iterator& operator++() { i++; return *this; }
+        bool operator!=(const const_iterator& o) const { return i != o.i; }
+        bool operator==(const const_iterator& o) const { return i == o.i; }
+    private:
+        const RingBuffer* rb;
+        size_t i;
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, count); }
+
+private:
+    T buf[N];
+    size_t head = 0;  // next slot to write
+    size_t count = 0;
+};
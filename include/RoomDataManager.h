@@ -2,46 +2,123 @@
 #define ROOM_DATA_MANAGER_H
 
 #include <Arduino.h>
+#include <lvgl.h>
 #include <vector>
+#include <map>
+#include "ConfigTypes.h"
+#include "TimeSeries.h"
+#include "HistoryLog.h"
 
-// Struttura per un singolo punto temperatura-tempo
-struct TempPoint {
-    uint32_t timestamp;  // minuti dall'avvio
-    float temperature;
+// Finestra del grafico breve: 30 minuti
+static const uint32_t ROOM_HISTORY_WINDOW_MIN = 30;
+
+// Traccia del grafico: una media al minuto, 30 minuti + 1 punto vuoto che separa
+// il più recente dal più vecchio (layout circolare letto direttamente da lv_chart)
+static const uint16_t ROOM_CHART_POINTS = 31;
+
+// Ultimo contributo di un dispositivo agli aggregati della stanza
+struct RoomMember {
+    String id;
+    bool known = false;     // Stato ricevuto almeno una volta
+    bool hasTemp = false;   // TRV online con temperatura valida
+    float temp = 0.0f;
+    float target = 0.0f;
+    bool demand = false;    // TRV che chiede calore
+    float power = 0.0f;
 };
 
 // Classe per gestire i dati di una singola stanza
 class RoomData {
 public:
     String roomName;
-    float currentTemp;
-    float setpoint;
-    std::vector<TempPoint> history;  // Ultimi 30 minuti
+    float currentTemp;   // Media delle TRV online
+    float minTemp;       // Minima delle TRV online
+    float setpoint;      // Media dei setpoint delle TRV online
+    int heatingDemand;   // Numero di TRV che chiedono calore
+    float totalPower;    // Somma potenze dei dispositivi della stanza (W)
+    std::vector<RoomMember> members;
+    TimeSeries* series;  // Storico lungo (raw/1m/15m/1h) in PSRAM, timestamp epoch
+    uint32_t historyId;  // Id della serie nel log su SD
+    uint32_t lastLoggedMinute;
+    lv_coord_t chartTrace[ROOM_CHART_POINTS];  // Decimi di grado, LV_CHART_POINT_NONE = vuoto
+    uint16_t traceHead;   // Slot vuoto: il prossimo punto va qui
+    uint32_t traceSeq;    // Incrementato a ogni nuovo punto della traccia
     
     RoomData(String name);
-    void addTemperature(float temp);
+    bool hasTemperature() const { return tempCount > 0; }
+    // true se il campione ha chiuso un minuto (da salvare su SD)
+    bool addTemperature(float temp);
+    // Ripristino da SD di una media al minuto
+    void restoreMinute(uint32_t time, float temp);
     float getLastTemperature() const;
+    
+    // Sostituisce il contributo di un membro e aggiorna gli aggregati in O(1)
+    // (ricalcolati sui soli membri della stanza quando cambia la minima e periodicamente)
+    void updateMember(RoomMember& m, const RoomMember& next);
+    
+private:
+    float lastTemp;      // Ultimo campione ricevuto (NAN = nessuno)
+    float tempSum;
+    int tempCount;
+    float targetSum;
+    uint16_t sinceRecompute;  // Aggiornamenti incrementali dall'ultimo ricalcolo
+    static const uint16_t RECOMPUTE_EVERY = 100;
+    
+    uint32_t traceMinute;
+    float traceSum;
+    int traceCount;
+    
+    void recompute();
+    void pushTrace(float temp);
 };
 
 // Manager globale per tutte le stanze
 class RoomDataManager {
 private:
-    RoomData rooms[4];
+    std::vector<RoomData*> rooms;  // Costruite dalla configurazione, ordine alfabetico
+    std::map<String, std::pair<int, int>> deviceIndex;  // id dispositivo -> (stanza, membro)
     int currentRoomIndex;
+    float hysteresis;
+    TimeSeries* powerSeries;  // Consumo totale casa (W)
+    uint32_t powerHistoryId;
+    uint32_t powerLastLoggedMinute;
+    HistoryLog historyLog;  // Storico compresso su SD
+    
+    void logClosedMinute(TimeSeries* ts, uint32_t id, uint32_t& lastLogged);
+    static void onHistorySample(void* ctx, uint32_t seriesId, uint32_t time, float value);
     
 public:
     RoomDataManager();
     
-    RoomData& getRoom(int index);
+    // Crea le stanze dai campi "room" dei dispositivi in configurazione
+    void begin(const AppConfig& config);
+    
+    int getRoomCount() const { return (int)rooms.size(); }
+    RoomData* getRoom(int index);
+    RoomData* findRoom(const String& name);
     void setCurrentRoom(int index);
     int getCurrentRoomIndex() const;
-    RoomData& getCurrentRoom();
+    RoomData* getCurrentRoom();
+    
+    // Aggiorna gli aggregati con lo stato di un dispositivo (ignorato se invariato).
+    // Da chiamare solo per i dispositivi cambiati (AppManager::takeChangedDevices)
+    void onDeviceState(const DeviceState& ds);
+    
+    // Registra un campione di temperatura per ogni stanza (1 Hz)
+    void update();
+    
+    // Campione di potenza totale (W) per lo storico
+    void addPowerSample(float watts);
+    TimeSeries* getPowerSeries() { return powerSeries; }
+    
+    // Carica le ultime 24 ore da SD (chiamare dopo begin() e il mount della SD)
+    void loadHistory();
     
-    // Genera temperatura casuale per test
-    void generateRandomTemp(int roomIndex);
+    // Salvataggio periodico dello storico su SD
+    void loop();
     
-    // Genera temperature per tutte le stanze
-    void generateAllRandomTemps();
+    // Tempo epoch in secondi, false se l'orologio non è ancora sincronizzato
+    static bool getEpochSeconds(uint32_t& out);
 };
 
 // Istanza globale
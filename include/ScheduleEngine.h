@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <vector>
+#include <time.h>
+#include "ConfigTypes.h"
+
+// Compiles "HH:MM" schedule points into sorted minute-of-week transitions once at
+// config load, so the controller only does a binary search at runtime.
+// Daily, weekday/weekend and per-day weekly profiles share the same representation.
+class ScheduleEngine {
+public:
+    static const uint16_t MINUTES_PER_DAY = 24 * 60;
+    static const uint16_t MINUTES_PER_WEEK = 7 * MINUTES_PER_DAY;
+
+    // "HH:MM" -> minutes from midnight. False if malformed.
+    static bool parseTime(const String& timeStr, uint16_t& minutes);
+
+    // Day mask <-> JSON ("all", "weekdays", "weekend" or [0..6] with 0 = Sunday)
+    static uint8_t parseDays(JsonVariantConst v);
+    static void writeDays(JsonObject obj, uint8_t days);
+
+    // Rebuild dc.compiledSchedule from dc.schedule
+    static void compile(DeviceConfig& dc);
+
+    // Active setpoint at minuteOfWeek. nextChange = minutes until the following
+    // transition (MINUTES_PER_WEEK if there is only one). False if the schedule is empty.
+    static bool lookup(const std::vector<ScheduleTransition>& transitions, uint16_t minuteOfWeek,
+                       float& temp, uint16_t& nextChange);
+
+    static uint16_t minuteOfWeek(const struct tm& timeinfo);
+};
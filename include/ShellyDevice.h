@@ -2,94 +2,122 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <HTTPClient.h>
+#include <vector>
 #include "ConfigTypes.h"
 
+// Hot state of every device, one slot per device (struct of arrays). The control
+// loops and the UI snapshot scan these columns directly instead of chasing one
+// object per device; ShellyDevice reads and writes its own slot.
+//
+// isOn, role and priority are written only through the setters, which keep the
+// role indexes up to date: the loops read a prefiltered, ordered list of slots
+// instead of filtering every device on every pass.
+struct DeviceStates {
+    std::vector<uint8_t> isOn;
+    std::vector<uint8_t> isOnline;
+    std::vector<float> power;
+    std::vector<float> currentTemp;  // TRVs
+    std::vector<float> targetTemp;
+    std::vector<float> valvePos;
+    std::vector<DeviceRole> role;
+    std::vector<int> priority;
+    std::vector<int> phase;          // Main meter phase (-1 = unassigned)
+
+    // Role indexes (slots)
+    std::vector<uint16_t> loads;     // LOAD: on before off, then priority descending
+    std::vector<uint16_t> trvs;      // TRV
+
+    size_t size() const { return power.size(); }
+    void reserve(size_t n);
+    // Appends a slot (offline, off) and returns its index
+    uint16_t add(DeviceRole r, int prio);
+
+    void setOn(uint16_t slot, bool on);
+    void setRole(uint16_t slot, DeviceRole r);
+    void setPriority(uint16_t slot, int prio);
+
+private:
+    bool loadBefore(uint16_t a, uint16_t b) const;
+    void placeLoad(uint16_t slot);
+    void indexRole(uint16_t slot);
+    void unindexRole(uint16_t slot);
+};
+
+// One Shelly relay/meter channel or BLU TRV. A single concrete type: the protocol
+// is selected by deviceType with a switch instead of virtual calls, so devices are
+// stored by value, contiguously, in ShellyManager's pool.
 class ShellyDevice {
-protected:
+private:
     String ip;
     String id; // Unique ID
     String mac;
-    int channelIndex;
+    int channelIndex; // Relay/meter channel, thermostat component id for a BLU TRV
     String friendlyName;
-    DeviceRole role;
-    int priority;
-    DeviceType deviceType = DeviceType::UNKNOWN;
-    
-    bool isOn = false;
-    float power = 0.0f;
-    bool isOnline = false;
-
-    // For TRVs
-    float currentTemp = 0.0f;
-    float targetTemp = 0.0f;
-    float valvePos = 0.0f;
+    DeviceType deviceType;
 
-public:
-    ShellyDevice(String ip, String id, int channel, DeviceRole role, int priority);
-    virtual ~ShellyDevice() {}
+    // Flag per indicare se il canale controlla un relay fisico o è solo misurazione/non supportato
+    // Necessario per Shelly 3EM (canali > 0) o Shelly 2.5 in modalità Roller (solo Gen1)
+    bool hasRelay = true;
 
-    virtual void turnOn() = 0;
-    virtual void turnOff() = 0;
-    virtual void update() = 0; // Poll status
-    virtual void fetchMetadata() = 0; // Get name, etc.
-    
-    virtual void setTargetTemperature(float temp) {} // Default empty
+    DeviceStates* states;
+    uint16_t slot;
 
-    // Getters
-    String getId() const { return id; }
-    String getIp() const { return ip; }
-    DeviceType getType() const { return deviceType; }
-    int getChannelIndex() const { return channelIndex; }
-    String getName() const { return friendlyName; }
-    bool getIsOn() const { return isOn; }
-    float getPower() const { return power; }
-    bool getIsOnline() const { return isOnline; }
-    float getCurrentTemp() const { return currentTemp; }
-    float getTargetTemp() const { return targetTemp; }
-    float getValvePos() const { return valvePos; }
-    DeviceRole getRole() const { return role; }
-    int getPriority() const { return priority; }
+    void setOn(bool on) { states->setOn(slot, on); }
+    void setOnline(bool online) { states->isOnline[slot] = online; }
+    void setPower(float w) { states->power[slot] = w; }
 
-    void setFriendlyName(String name) { friendlyName = name; }
-    void setPriority(int p) { priority = p; }
-    void setRole(DeviceRole r) { role = r; }
+    // Gen1 (Shelly 1, 1PM, 2.5, 3EM): REST
+    bool setOutputGen1(bool on);
+    void updateGen1();
+    void applyStatusGen1(JsonVariantConst status);
+    void fetchMetadataGen1();
 
-    // Factory
-    static ShellyDevice* create(DeviceType type, String ip, String id, int channel, DeviceRole role = DeviceRole::UNKNOWN, int priority = 0);
-};
+    // Gen2 (Plus, Pro): RPC over HTTP
+    bool setOutputGen2(bool on);
+    void updateGen2();
+    void applyStatusGen2(JsonVariantConst status);
+    void fetchMetadataGen2();
 
-class ShellyGen1 : public ShellyDevice {
-private:
-    // Flag per indicare se il canale controlla un relay fisico o è solo misurazione/non supportato
-    // Necessario per Shelly 3EM (canali > 0) o Shelly 2.5 in modalità Roller
-    bool hasRelay = true; 
+    // BLU TRV: RPC to the gateway
+    void updateBluTrv();
+    void applyStatusBluTrv(JsonVariantConst status);
+    bool setTargetTempBluTrv(float temp);
 
 public:
-    ShellyGen1(String ip, String id, int channel, DeviceRole role, int priority);
-    void turnOn() override;
-    void turnOff() override;
-    void update() override;
-    void fetchMetadata() override;
-};
+    ShellyDevice(DeviceType type, const String& ip, const String& id, int channel, DeviceStates* states, uint16_t slot);
 
-class ShellyGen2 : public ShellyDevice {
-public:
-    ShellyGen2(String ip, String id, int channel, DeviceRole role, int priority);
-    void turnOn() override;
-    void turnOff() override;
-    void update() override;
-    void fetchMetadata() override;
-};
+    // Commands return true only when the device acknowledged them
+    bool turnOn();
+    bool turnOff();
+    void update(); // Poll status
+    void fetchMetadata(); // Get name, etc.
 
-class ShellyBluTrv : public ShellyDevice {
-private:
-    int componentId; // e.g. 200 for thermostat:200
-public:
-    ShellyBluTrv(String gatewayIp, String id, int componentId, DeviceRole role, int priority);
-    void turnOn() override; // Maybe set mode?
-    void turnOff() override;
-    void update() override;
-    void fetchMetadata() override;
-    void setTargetTemperature(float temp) override;
-};
\ No newline at end of file
+    // Apply a device-wide status document fetched once for several channels
+    // (Gen1: /status body, Gen2: Shelly.GetStatus "result"). Used by shared polls.
+    void applyStatus(JsonVariantConst status);
+
+    bool setTargetTemperature(float temp); // BLU TRV only
+
+    // Getters
+    const String& getId() const { return id; }
+    const String& getIp() const { return ip; }
+    DeviceType getType() const { return deviceType; }
+    int getChannelIndex() const { return channelIndex; }
+    const String& getName() const { return friendlyName; }
+    uint16_t getSlot() const { return slot; }
+    bool getIsOn() const { return states->isOn[slot]; }
+    float getPower() const { return states->power[slot]; }
+    bool getIsOnline() const { return states->isOnline[slot]; }
+    float getCurrentTemp() const { return states->currentTemp[slot]; }
+    float getTargetTemp() const { return states->targetTemp[slot]; }
+    float getValvePos() const { return states->valvePos[slot]; }
+    DeviceRole getRole() const { return states->role[slot]; }
+    int getPriority() const { return states->priority[slot]; }
+    int getPhase() const { return states->phase[slot]; }
+
+    void setFriendlyName(String name) { friendlyName = name; }
+    void setPriority(int p) { states->setPriority(slot, p); }
+    void setRole(DeviceRole r) { states->setRole(slot, r); }
+    void setPhase(int p) { states->phase[slot] = p; }
+    void markOffline() { setOnline(false); }
+};
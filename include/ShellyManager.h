@@ -6,14 +6,53 @@
 #include <ESPmDNS.h>
 #include "ShellyDevice.h"
 #include "ConfigTypes.h"
+#include "EnergyMeter.h"
 
 class ShellyManager {
 private:
-    std::map<String, ShellyDevice*> devices; // Key: ID (MAC_Channel)
+    // Devices by value in one contiguous pool; pool[i] owns slot i of states.
+    // Never removed, so a slot is stable; pointers into the pool are valid until
+    // discovery grows it past its capacity (use them within one AppTask cycle).
+    static const size_t POOL_RESERVE = 32;
+    std::vector<ShellyDevice> pool;
+    DeviceStates states;
+    std::map<String, uint16_t> slots; // Key: ID (MAC_Channel)
     AppConfig* config; // Reference to global config
+    EnergyMeter* energyMeter = nullptr; // Optional, fed once per poll cycle
     
     unsigned long lastUpdate = 0;
     unsigned long lastDiscovery = 0;
+    uint32_t pollCount = 0; // Completed poll cycles
+
+    // Main meter group (index = phase). Phase channels are polled together, one request
+    // per meter IP, and the sums are cached for the 250ms LoadManager loop.
+    std::vector<String> meterPhaseIds;
+    std::vector<int> meterSlots;              // Per phase, -1 = not discovered yet
+    std::vector<float> phasePower;
+    float meterTotalPower = 0.0f;
+
+    // Devices polled one by one (neither meter phases nor BLU TRVs) and BLU TRVs
+    // polled through their gateway; rebuilt on discovery and meter changes
+    std::vector<uint16_t> singleSlots;
+    std::vector<uint16_t> gatewayTrvSlots;
+
+    // Reused by the shared polls so a cycle does not allocate them
+    std::vector<ShellyDevice*> scratchDevices;
+    std::vector<bool> scratchPolled;
+
+    ShellyDevice* addDevice(DeviceType type, const String& ip, const String& id, int channel,
+                            DeviceRole role, int priority, int phase);
+    void rebuildPollIndexes();
+    // Config entry of a device, created with the schema defaults if missing
+    DeviceConfig& configFor(const String& id);
+    void pollMeterGroup();
+
+    // One status request covering every channel/component behind an IP
+    // (Gen1: /status, Gen2 and BLU gateways: Shelly.GetStatus "result")
+    bool fetchSharedStatus(const String& ip, DeviceType type, JsonDocument& doc, JsonVariantConst& status);
+
+    // BLU TRVs are refreshed per gateway, not per TRV
+    void pollTrvGateways();
     
     // Metodi interni di discovery
     void discoverDevices();
@@ -31,11 +70,26 @@ public:
     ShellyManager(AppConfig* config);
     void begin();
     void update(); // Called in loop
+    void setEnergyMeter(EnergyMeter* meter) { energyMeter = meter; }
+    uint32_t getPollCount() const { return pollCount; }
     
-    ShellyDevice* getDevice(String id);
-    std::vector<ShellyDevice*> getAllDevices();
+    ShellyDevice* getDevice(const String& id);
     
-    float getTotalPower(String mainMeterId);
+    // Hot state of all devices by slot, for scans without touching the device objects.
+    // Role views (no allocation): getStates().loads in shedding order, getStates().trvs.
+    const DeviceStates& getStates() const { return states; }
+    ShellyDevice& getDeviceAt(uint16_t slot) { return pool[slot]; }
+    size_t getDeviceCount() const { return pool.size(); }
+    // Slot of each main meter phase (-1 = not discovered yet)
+    const std::vector<int>& getMeterSlots() const { return meterSlots; }
+    
+    // Rebuild the meter group from config.energy (main_meter_phases or main_meter_id)
+    void configureMeterGroup();
+
+    // Cached results of the last shared meter poll (no HTTP)
+    float getTotalPower() const { return meterTotalPower; }
+    float getPhasePower(int phase) const;
+    int getPhaseCount() const { return (int)meterPhaseIds.size(); }
     
     // Helper to sync config with discovered devices
     void syncConfig();
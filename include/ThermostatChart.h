@@ -2,19 +2,62 @@
 #define THERMOSTAT_CHART_H
 
 #include <lvgl.h>
+#include "TimeSeries.h"
+
+class RoomData;
 
 class ThermostatChart {
+public:
+    // Viste: ultimi 30 minuti (traccia live della stanza) o finestre lunghe dallo storico
+    enum View : uint8_t { VIEW_LIVE = 0, VIEW_1H, VIEW_24H, VIEW_7D, VIEW_COUNT };
+
 private:
+    static const size_t QUERY_MAX = 4096;  // Punti massimi letti dallo storico per una finestra
+    static const size_t DRAW_MAX = 1280;   // Punti massimi disegnati (larghezza Tab5)
+    static const int PX_PER_POINT = 2;     // Densità del downsampling LTTB
+
     lv_obj_t* chartObj;
-    
+    lv_obj_t* viewSelector;
+    lv_chart_series_t* series;
+    RoomData* boundRoom;   // Stanza la cui traccia è collegata alla serie
+    uint32_t boundSeq;     // Ultimo traceSeq disegnato
+
+    View view;
+    uint32_t viewEnd;          // Fine finestra (epoch), 0 = segue l'ora corrente
+    uint32_t renderedUntil;    // Ultimo campione incluso nel rendering
+    uint32_t renderedStep;     // Secondi per punto del livello usato
+    lv_coord_t yMin, yMax;     // Range Y attuale (decimi di grado)
+
+    SeriesPoint* queryBuf;     // PSRAM
+    SeriesPoint* drawBuf;
+    lv_coord_t* xPoints;
+    lv_coord_t* yPoints;
+
+    bool allocBuffers();
+    void bindLive(RoomData* room);
+    void renderRange(RoomData* room);
+    void applyYRange(lv_coord_t dataMin, lv_coord_t dataMax);
+    void invalidateXTicks();
+
+    static void onViewChanged(lv_event_t* e);
+    static void onChartPressing(lv_event_t* e);
+
 public:
     ThermostatChart();
-    
+
     // Inizializza il grafico del termostato con assi e configurazioni
     void init();
-    
-    // Aggiorna il grafico per una specifica stanza
+
+    // Aggiorna il grafico per una specifica stanza.
+    // Nessun lavoro se la stanza non ha punti nuovi; un punto nuovo invalida solo la sua zona.
     void updateForRoom(int roomIndex);
+
+    void setView(View v);
+    View getView() const { return view; }
+    uint32_t getSpanSeconds() const;
+    uint32_t getViewEnd() const { return viewEnd; }
+    // Slot del punto più recente della traccia live, -1 se non collegata
+    int getLiveNewest() const;
 };
 
 // Istanza globale
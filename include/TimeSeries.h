@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Arduino.h>
+#include "RingBuffer.h"
+
+// One point returned by a query. Raw samples have min == max == avg.
+struct SeriesPoint {
+    uint32_t time; // seconds, start of the bucket
+    float min;
+    float max;
+    float avg;
+};
+
+// Multi-resolution time series: raw samples plus 1-minute, 15-minute and 1-hour tiers.
+// Every sample updates the open bucket of the 1-minute tier; when a bucket closes it is
+// merged into the next coarser tier, so downsampling is incremental and O(1) per sample.
+// Each tier is a fixed ring, so the memory of a series is bounded (memoryBytes()) and the
+// whole object lives in PSRAM: create it with TimeSeries::create().
+class TimeSeries {
+public:
+    enum Tier : uint8_t { TIER_RAW = 0, TIER_1MIN, TIER_15MIN, TIER_1H, TIER_COUNT };
+
+    static const size_t RAW_CAPACITY = 3600;   // 1 h at 1 Hz
+    static const size_t MIN1_CAPACITY = 2880;  // 48 h
+    static const size_t MIN15_CAPACITY = 2880; // 30 days
+    static const size_t HOUR_CAPACITY = 2160;  // 90 days
+
+    // Allocate in PSRAM (falls back to internal RAM). Returns nullptr on failure.
+    static TimeSeries* create();
+    static void destroy(TimeSeries* ts);
+
+    // Append a sample. Samples older than the last one are ignored.
+    // Returns true when the sample closed a 1-minute bucket (see lastClosed()).
+    bool add(uint32_t time, float value);
+
+    // Append an already aggregated 1-minute value (history restore): skips the raw tier
+    void addMinute(uint32_t time, float value);
+
+    // Newest closed bucket of a tier
+    bool lastClosed(Tier tier, SeriesPoint& out) const;
+
+    void clear();
+
+    bool empty() const { return !hasSamples; }
+    uint32_t firstTime() const { return firstSampleTime; }
+    uint32_t lastTime() const { return lastSampleTime; }
+
+    // Points in [from, to] from the coarsest tier that still yields at least
+    // `width` points (or the finest tier covering the window if none does).
+    // Writes at most maxOut points to out, oldest first. O(log n + points written).
+    size_t query(uint32_t from, uint32_t to, size_t width, SeriesPoint* out, size_t maxOut) const;
+
+    // Points in [from, to] from one tier (used by query and for persistence)
+    size_t read(Tier tier, uint32_t from, uint32_t to, SeriesPoint* out, size_t maxOut) const;
+
+    // Tier chosen by query() for a window
+    Tier pickTier(uint32_t from, uint32_t to, size_t width) const;
+
+    static uint32_t tierSeconds(Tier tier);
+    static size_t memoryBytes();
+
+private:
+    struct RawSample {
+        uint32_t time;
+        float value;
+    };
+
+    struct Bucket {
+        uint32_t time;
+        float min;
+        float max;
+        float sum;
+        uint32_t count;
+    };
+
+    RingBuffer<RawSample, RAW_CAPACITY> raw;
+    RingBuffer<Bucket, MIN1_CAPACITY> min1;
+    RingBuffer<Bucket, MIN15_CAPACITY> min15;
+    RingBuffer<Bucket, HOUR_CAPACITY> hour;
+    Bucket open[TIER_COUNT - 1]; // bucket in progress for 1-min, 15-min, 1-h
+    uint32_t firstSampleTime = 0;
+    uint32_t lastSampleTime = 0;
+    bool hasSamples = false;
+    bool closedMinute = false;
+
+    void merge(int level, const Bucket& b);
+    size_t tierSize(Tier tier) const;
+    uint32_t tierOldest(Tier tier) const;
+    SeriesPoint tierPoint(Tier tier, size_t i) const;
+    size_t lowerBound(Tier tier, uint32_t time) const;
+};
@@ -1,12 +1,24 @@
 #include "AppManager.h"
 #include <esp_sntp.h>
 #include "LogManager.h"
+#include "JsonAllocator.h"
+#include "Arena.h"
 #include <ESPmDNS.h>
 
 // WiFi connection timeout (ms)
 static const unsigned long WIFI_CONNECT_TIMEOUT_MS = 15000;
 // WiFi reconnect interval (ms)
 static const unsigned long WIFI_RECONNECT_INTERVAL_MS = 10000;
+// Config file check interval for hot reload (ms)
+static const unsigned long CONFIG_POLL_INTERVAL_MS = 10000;
+// Internal heap / fragmentation report interval (ms)
+static const unsigned long HEAP_LOG_INTERVAL_MS = 10UL * 60UL * 1000UL;
+
+// Snapshot change detection: NaN (no reading yet) equals NaN
+static bool sameValue(float a, float b)
+{
+    return a == b || (isnan(a) && isnan(b));
+}
 
 // NTP Callback - called when time is synchronized
 // Only update the hardware RTC the first time we receive a valid NTP time
@@ -36,6 +48,7 @@ AppManager::AppManager()
 {
     dataMutex = xSemaphoreCreateMutex();
     shellyManager = nullptr;
+    reconciler = nullptr;
     loadManager = nullptr;
     climateController = nullptr;
     taskHandle = nullptr;
@@ -48,9 +61,12 @@ void AppManager::begin()
 
     // Init Modules
     shellyManager = new ShellyManager(&config);
-    loadManager = new LoadManager(shellyManager, &config.energy);
-    climateController = new ClimateController(shellyManager, &config);
+    reconciler = new DeviceReconciler(shellyManager);
+    loadManager = new LoadManager(shellyManager, reconciler, &config.energy);
+    climateController = new ClimateController(shellyManager, reconciler, &config);
 
+    energyMeter.begin();
+    shellyManager->setEnergyMeter(&energyMeter);
     shellyManager->begin();
 }
 
@@ -207,15 +223,31 @@ void AppManager::runLoop()
             setupNTP();
         }
 
+        // Config file edited on SD, settings changed from the UI, then compaction
+        // of their journal when due
+        handleConfigReload();
+        applyConfigChanges();
+        configManager.loop(config);
+
         // Logic Updates
         shellyManager->update();
         loadManager->update();
         climateController->update();
+        reconciler->reconcile();
+        energyMeter.loop();
+
+        if (millis() - lastHeapLog >= HEAP_LOG_INTERVAL_MS)
+        {
+            logHeapStats("AppTask");
+            LOG_INFO("Poll arena: high water %u of %u bytes, %u overflow(s)", (unsigned)pollArena.highWater(),
+                     (unsigned)pollArena.capacity(), (unsigned)pollArena.overflows());
+            lastHeapLog = millis();
+        }
 
         // Update Shared State
         if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)))
         {
-            sharedState.totalPower = shellyManager->getTotalPower(config.energy.main_meter_id);
+            sharedState.totalPower = shellyManager->getTotalPower();
             sharedState.alarmActive = false; // TODO: Get from LoadManager
             sharedState.boilerOn = false;    // TODO: Get from ClimateController or check boiler device
 
@@ -224,26 +256,40 @@ void AppManager::runLoop()
             if (boiler)
                 sharedState.boilerOn = boiler->getIsOn();
 
-            sharedState.devices.clear();
-            auto devs = shellyManager->getAllDevices();
-            for (auto *d : devs)
+            // One pass over the hot state columns, in slot order. Entries are
+            // overwritten in place so their strings keep their buffers; slots whose
+            // state differs from the last snapshot are queued for takeChangedDevices().
+            const DeviceStates &st = shellyManager->getStates();
+            size_t known = sharedState.devices.size();
+            sharedState.devices.resize(st.size());
+            deviceDirty.resize(st.size(), 0);
+            for (uint16_t i = 0; i < st.size(); i++)
             {
-                DeviceState ds;
-                ds.id = d->getId();
-                ds.name = d->getName();
-                ds.isOn = d->getIsOn();
-                ds.power = d->getPower();
-                ds.isOnline = d->getIsOnline();
-                ds.role = d->getRole();
-                ds.currentTemp = d->getCurrentTemp();
-                ds.targetTemp = d->getTargetTemp();
-                ds.valvePos = d->getValvePos();
-                // Room info from config
-                if (config.devices.find(ds.id) != config.devices.end())
+                const ShellyDevice &d = shellyManager->getDeviceAt(i);
+                DeviceState &ds = sharedState.devices[i];
+                bool changed = i >= known || ds.id != d.getId() || ds.isOn != (bool)st.isOn[i] ||
+                               ds.isOnline != (bool)st.isOnline[i] || ds.role != st.role[i] ||
+                               !sameValue(ds.power, st.power[i]) || !sameValue(ds.currentTemp, st.currentTemp[i]) ||
+                               !sameValue(ds.targetTemp, st.targetTemp[i]) || !sameValue(ds.valvePos, st.valvePos[i]);
+                if (changed && !deviceDirty[i])
                 {
-                    ds.room = config.devices[ds.id].room;
+                    deviceDirty[i] = 1;
+                    dirtySlots.push_back(i);
                 }
-                sharedState.devices.push_back(ds);
+                ds.id = d.getId();
+                ds.name = d.getName();
+                ds.isOn = st.isOn[i];
+                ds.power = st.power[i];
+                ds.isOnline = st.isOnline[i];
+                ds.role = st.role[i];
+                ds.currentTemp = st.currentTemp[i];
+                ds.targetTemp = st.targetTemp[i];
+                ds.valvePos = st.valvePos[i];
+                ds.energyTodayWh = energyMeter.getTodayWh(ds.id);
+                ds.energyWeekWh = energyMeter.getWeekWh(ds.id);
+                // Room info from config
+                auto it = config.devices.find(ds.id);
+                ds.room = (it != config.devices.end()) ? it->second.room : String();
             }
 
             // Read host battery info via M5.Power (if available)
@@ -269,11 +315,42 @@ void AppManager::runLoop()
             xSemaphoreGive(dataMutex);
         }
 
+        // Responses and documents of this cycle are dead: release them in one go
+        pollArena.reset();
+
         // Yield to other tasks
         vTaskDelay(pdMS_TO_TICKS(50));
     }
 }
 
+bool AppManager::takeChangedDevices(std::vector<DeviceState>& out)
+{
+    out.clear();
+    if (!xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)))
+        return false;
+    for (uint16_t slot : dirtySlots)
+    {
+        if (slot >= sharedState.devices.size())
+            continue; // Removed by a config reload
+        deviceDirty[slot] = 0;
+        out.push_back(sharedState.devices[slot]);
+    }
+    dirtySlots.clear();
+    xSemaphoreGive(dataMutex);
+    return true;
+}
+
+float AppManager::getTotalPower()
+{
+    float watts = 0.0f;
+    if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)))
+    {
+        watts = sharedState.totalPower;
+        xSemaphoreGive(dataMutex);
+    }
+    return watts;
+}
+
 SystemState AppManager::getSystemState()
 {
     SystemState state;
@@ -292,24 +369,170 @@ int AppManager::getMaxPowerW()
 
 void AppManager::setDeviceState(String id, bool on)
 {
-    // This might be called from UI (Core 1).
-    // We should probably queue this action or protect ShellyManager.
-    // But ShellyManager is on Core 0.
-    // Direct call is unsafe if ShellyManager is not thread safe.
-    // Ideally we post a message to a queue that Core 0 processes.
-    // For simplicity, I'll just lock mutex if I were accessing shared data,
-    // but ShellyManager methods might use HTTPClient which is slow.
-    // We don't want to block UI.
-    // So we should use a command queue.
-    // I'll skip implementation for now or just do it unsafely/blocking for MVP.
-    // Or better: AppManager exposes a thread-safe way.
-    // I'll leave it empty or simple for now.
-    // "Synchronization: Use std::mutex ... to protect shared data when the UI reads device status."
-    // It doesn't explicitly say how to handle writes.
-    // I'll assume writes are rare and maybe acceptable to block or I should use a queue.
+    // Called from the UI task: only record the desire, the AppTask reconciler sends
+    // the command. Released once reached so the device stays manually controllable.
+    reconciler->setDesiredOn(id, on, true);
 }
 
 void AppManager::setDeviceTargetTemp(String id, float temp)
 {
-    // Same as above
+    // Holds until reached; the schedule takes over again at its next transition
+    reconciler->setDesiredTarget(id, temp, true);
+}
+
+void AppManager::setGlobalSetpoint(float temp)
+{
+    ConfigChange change;
+    change.op = ConfigChange::GLOBAL_SETPOINT;
+    change.setpoint = temp;
+    queueConfigChange(change);
+}
+
+void AppManager::setDevicePriority(String id, int priority)
+{
+    ConfigChange change;
+    change.op = ConfigChange::DEVICE_PRIORITY;
+    change.deviceId = id;
+    change.priority = priority;
+    queueConfigChange(change);
+}
+
+void AppManager::setDeviceSchedule(String id, bool enabled, const std::vector<SchedulePoint>& schedule)
+{
+    ConfigChange change;
+    change.op = ConfigChange::DEVICE_SCHEDULE;
+    change.deviceId = id;
+    change.scheduleEnabled = enabled;
+    change.schedule = schedule;
+    queueConfigChange(change);
+}
+
+// Called from the UI task: the config is only modified by the AppTask, which reads it
+void AppManager::queueConfigChange(const ConfigChange& change)
+{
+    if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)))
+    {
+        pendingChanges.push_back(change);
+        xSemaphoreGive(dataMutex);
+    }
+    else
+    {
+        SysLog.error("Config change dropped: state lock busy");
+    }
+}
+
+void AppManager::applyConfigChanges()
+{
+    std::vector<ConfigChange> changes;
+    if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)))
+    {
+        changes.swap(pendingChanges);
+        xSemaphoreGive(dataMutex);
+    }
+    for (const auto& change : changes)
+    {
+        if (!configManager.apply(config, change))
+            continue; // Out of range or unknown device, logged by ConfigManager
+        // Devices copy their priority at creation; the controller caches the schedules
+        if (change.op == ConfigChange::DEVICE_PRIORITY)
+        {
+            ShellyDevice* dev = shellyManager->getDevice(change.deviceId);
+            if (dev)
+                dev->setPriority(change.priority);
+        }
+        else if (change.op == ConfigChange::DEVICE_SCHEDULE)
+        {
+            climateController->invalidateSchedules();
+        }
+    }
+}
+
+void AppManager::handleConfigReload()
+{
+    ConfigManager::Reload* reload = nullptr;
+    if (xSemaphoreTake(dataMutex, pdMS_TO_TICKS(100)))
+    {
+        reload = stagedReload;
+        stagedReload = nullptr;
+        xSemaphoreGive(dataMutex);
+    }
+    if (reload)
+    {
+        applyConfigReload(*reload);
+        delete reload;
+        return;
+    }
+
+    unsigned long now = millis();
+    if (reloadRunning || now - lastConfigPoll < CONFIG_POLL_INTERVAL_MS)
+        return;
+    lastConfigPoll = now;
+    if (!configManager.changedOnDisk())
+        return;
+
+    // Parsing takes a while on a large file: keep it off the control loop
+    SysLog.log("Config file changed on SD, reloading...");
+    reloadRunning = true;
+    if (xTaskCreatePinnedToCore(reloadTaskFunction, "ConfigReload", 8192, this, 0, nullptr, 1) != pdPASS)
+    {
+        reloadRunning = false;
+        SysLog.error("Failed to create config reload task");
+    }
+}
+
+void AppManager::reloadTaskFunction(void* parameter)
+{
+    AppManager* self = static_cast<AppManager*>(parameter);
+    ConfigManager::Reload* reload = new ConfigManager::Reload();
+    if (!self->configManager.parseReload(*reload))
+    {
+        SysLog.error("Config reload failed: keeping the running configuration");
+        delete reload;
+        reload = nullptr;
+    }
+    xSemaphoreTake(self->dataMutex, portMAX_DELAY);
+    self->stagedReload = reload;
+    self->reloadRunning = false;
+    xSemaphoreGive(self->dataMutex);
+    vTaskDelete(nullptr);
+}
+
+// Only the changed sections are touched: devices stay connected and keep their state
+void AppManager::applyConfigReload(ConfigManager::Reload& reload)
+{
+    String oldSsid = config.wifi_ssid;
+    String oldPassword = config.wifi_password;
+    int oldGmt = config.tz_gmt_offset_sec;
+    int oldDst = config.tz_dst_offset_sec;
+
+    uint32_t changed = configManager.commitReload(config, reload);
+
+    if (changed & ConfigManager::SECTION_METER)
+        shellyManager->configureMeterGroup();
+
+    if (changed & ConfigManager::SECTION_DEVICES)
+    {
+        for (uint16_t i = 0; i < shellyManager->getDeviceCount(); i++)
+        {
+            ShellyDevice* dev = &shellyManager->getDeviceAt(i);
+            auto it = config.devices.find(dev->getId());
+            if (it == config.devices.end())
+                continue;
+            dev->setRole(it->second.role);
+            dev->setPriority(it->second.priority);
+            dev->setPhase(it->second.phase);
+        }
+        // The device map was replaced: cached schedule pointers are stale
+        climateController->invalidateSchedules();
+    }
+
+    if (config.tz_gmt_offset_sec != oldGmt || config.tz_dst_offset_sec != oldDst)
+        ntpConfigured = false; // setupNTP() applies the new offsets
+
+    if (config.wifi_ssid != oldSsid || config.wifi_password != oldPassword)
+    {
+        SysLog.log("WiFi credentials changed, reconnecting...");
+        WiFi.disconnect();
+        lastWifiReconnectAttempt = 0; // handleWiFiReconnect() connects with the new ones
+    }
 }
@@ -0,0 +1,101 @@
+#include "Arena.h"
+#include <esp_heap_caps.h>
+#include <stdarg.h>
+
+static const size_t ALIGN = 8;
+static const size_t POLL_ARENA_SIZE = 64 * 1024;
+
+Arena pollArena(POLL_ARENA_SIZE);
+
+static size_t alignUp(size_t n) {
+    return (n + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+Arena::Arena(size_t capacity) : cap(capacity), jsonAllocator(this) {}
+
+Arena::~Arena() {
+    reset();
+    heap_caps_free(base);
+}
+
+void* Arena::allocate(size_t size) {
+    if (!base && cap > 0) {
+        base = (uint8_t*)heap_caps_aligned_alloc(ALIGN, cap, MALLOC_CAP_SPIRAM);
+        if (!base) cap = 0; // No PSRAM: every allocation goes to the heap
+    }
+
+    size_t need = sizeof(Header) + alignUp(size);
+    if (top + need <= cap) {
+        Header* h = (Header*)(base + top);
+        h->size = size;
+        h->spilled = 0;
+        last = top;
+        top += need;
+        if (used() > peak) peak = used();
+        return h + 1;
+    }
+
+    size_t bytes = sizeof(Spill) + sizeof(Header) + size;
+    Spill* s = (Spill*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+    if (!s) s = (Spill*)heap_caps_malloc(bytes, MALLOC_CAP_DEFAULT);
+    if (!s) return nullptr;
+    s->next = spills;
+    spills = s;
+    spillBytes += bytes;
+    overflowCount++;
+    if (used() > peak) peak = used();
+
+    Header* h = (Header*)(s + 1);
+    h->size = size;
+    h->spilled = 1;
+    return h + 1;
+}
+
+void* Arena::reallocate(void* p, size_t size) {
+    if (!p) return allocate(size);
+    Header* h = (Header*)p - 1;
+
+    if (!h->spilled && (size_t)((uint8_t*)h - base) == last) {
+        size_t need = sizeof(Header) + alignUp(size);
+        if (last + need <= cap) {
+            h->size = size;
+            top = last + need;
+            if (used() > peak) peak = used();
+            return p;
+        }
+    }
+    if (size <= h->size) {
+        h->size = size;
+        return p;
+    }
+
+    void* n = allocate(size);
+    if (n) memcpy(n, p, h->size);
+    return n;
+}
+
+void Arena::reset() {
+    while (spills) {
+        Spill* next = spills->next;
+        heap_caps_free(spills);
+        spills = next;
+    }
+    spillBytes = 0;
+    top = 0;
+    last = SIZE_MAX;
+}
+
+const char* Arena::format(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(nullptr, 0, fmt, args);
+    va_end(args);
+    if (n < 0) return nullptr;
+
+    char* s = (char*)allocate(n + 1);
+    if (!s) return nullptr;
+    va_start(args, fmt);
+    vsnprintf(s, n + 1, fmt, args);
+    va_end(args);
+    return s;
+}
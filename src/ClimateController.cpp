@@ -1,17 +1,40 @@
 #include "ClimateController.h"
+#include "ScheduleEngine.h"
 
-ClimateController::ClimateController(ShellyManager* mgr, AppConfig* cfg) : shellyManager(mgr), config(cfg) {}
+ClimateController::ClimateController(ShellyManager* mgr, DeviceReconciler* rec, AppConfig* cfg)
+    : shellyManager(mgr), reconciler(rec), config(cfg) {}
 
-int ClimateController::parseTime(String timeStr) {
-    int split = timeStr.indexOf(':');
-    if (split == -1) return 0;
-    int h = timeStr.substring(0, split).toInt();
-    int m = timeStr.substring(split + 1).toInt();
-    return h * 60 + m;
+void ClimateController::buildSchedules() {
+    schedules.clear();
+    for (auto& kv : config->devices) {
+        const DeviceConfig& devCfg = kv.second;
+        if (devCfg.role == DeviceRole::TRV && devCfg.schedule_enabled && !devCfg.compiledSchedule.empty()) {
+            TrvSchedule ts;
+            ts.id = devCfg.id;
+            ts.transitions = &devCfg.compiledSchedule;
+            schedules.push_back(ts);
+        }
+    }
+    schedulesBuilt = true;
+    scheduleValid = false;
 }
 
-int ClimateController::getMinutesFromMidnight(struct tm* timeinfo) {
-    return timeinfo->tm_hour * 60 + timeinfo->tm_min;
+// Binary search each compiled schedule, hand the setpoints to the reconciler and
+// remember the earliest upcoming transition
+void ClimateController::evaluateSchedules(uint16_t minuteOfWeek) {
+    uint16_t nextChange = ScheduleEngine::MINUTES_PER_WEEK;
+    for (auto& ts : schedules) {
+        float target;
+        uint16_t delta;
+        if (ScheduleEngine::lookup(*ts.transitions, minuteOfWeek, target, delta)) {
+            ts.activeTarget = target;
+            if (target > 0) reconciler->setDesiredTarget(ts.id, target);
+            if (delta < nextChange) nextChange = delta;
+        }
+    }
+    evalMinuteOfWeek = minuteOfWeek;
+    minutesToNextChange = nextChange;
+    scheduleValid = true;
 }
 
 void ClimateController::update() {
@@ -24,50 +47,15 @@ void ClimateController::update() {
     struct tm timeinfo;
     if (!getLocalTime(&timeinfo)) return; // Time not set yet
     
-    int currentMins = getMinutesFromMidnight(&timeinfo);
-    
+    if (!schedulesBuilt) buildSchedules();
+
     // 1. Update Schedules
-    for (auto& kv : config->devices) {
-        DeviceConfig& devCfg = kv.second;
-        if (devCfg.role == DeviceRole::TRV && devCfg.schedule_enabled && !devCfg.schedule.empty()) {
-            // Find target temp
-            float target = -1.0;
-            int bestTime = -1;
-            
-            // Find latest point <= currentMins
-            for (const auto& pt : devCfg.schedule) {
-                int ptMins = parseTime(pt.time);
-                if (ptMins <= currentMins) {
-                    if (ptMins > bestTime) {
-                        bestTime = ptMins;
-                        target = pt.temp;
-                    }
-                }
-            }
-            
-            // If no point found today, use the last one from the list (previous day)
-            if (target < 0) {
-                // Find the point with max time
-                int maxTime = -1;
-                for (const auto& pt : devCfg.schedule) {
-                    int ptMins = parseTime(pt.time);
-                    if (ptMins > maxTime) {
-                        maxTime = ptMins;
-                        target = pt.temp;
-                    }
-                }
-            }
-            
-            if (target > 0) {
-                ShellyDevice* dev = shellyManager->getDevice(devCfg.id);
-                if (dev) {
-                    // Only update if significantly different to avoid spamming
-                    if (abs(dev->getTargetTemp() - target) > 0.1) {
-                        dev->setTargetTemperature(target);
-                    }
-                }
-            }
-        }
+    // Sleep until the next transition; a clock jump backwards shows up as a huge
+    // elapsed value and simply forces a re-evaluation.
+    uint16_t mow = ScheduleEngine::minuteOfWeek(timeinfo);
+    uint16_t elapsed = (uint16_t)((mow + ScheduleEngine::MINUTES_PER_WEEK - evalMinuteOfWeek) % ScheduleEngine::MINUTES_PER_WEEK);
+    if (!scheduleValid || elapsed >= minutesToNextChange) {
+        evaluateSchedules(mow);
     }
     
     // 2. Boiler Logic
@@ -75,29 +63,23 @@ void ClimateController::update() {
     if (!boiler) return;
     
     if (config->climate.summer_mode) {
-        if (boiler->getIsOn()) boiler->turnOff();
+        reconciler->setDesiredOn(boiler->getId(), false);
         return;
     }
     
     bool needHeat = false;
-    auto devices = shellyManager->getAllDevices();
-    for (auto* dev : devices) {
-        if (dev->getRole() == DeviceRole::TRV) {
-            // Check valve pos or temp diff
-            if (dev->getValvePos() > 10.0f) {
-                needHeat = true;
-                break;
-            }
-            if (dev->getCurrentTemp() < (dev->getTargetTemp() - config->climate.hysteresis)) {
-                needHeat = true;
-                break;
-            }
+    const DeviceStates& st = shellyManager->getStates();
+    for (uint16_t i : st.trvs) {
+        // Check valve pos or temp diff
+        if (st.valvePos[i] > 10.0f) {
+            needHeat = true;
+            break;
+        }
+        if (st.currentTemp[i] < (st.targetTemp[i] - config->climate.hysteresis)) {
+            needHeat = true;
+            break;
         }
     }
     
-    if (needHeat) {
-        if (!boiler->getIsOn()) boiler->turnOn();
-    } else {
-        if (boiler->getIsOn()) boiler->turnOff();
-    }
+    reconciler->setDesiredOn(boiler->getId(), needHeat);
 }
@@ -1,264 +1,1051 @@
 #include "ConfigManager.h"
+#include "ConfigSchema.h"
+#include "JsonAllocator.h"
 #include "LogManager.h"
+#include "ScheduleEngine.h"
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <vector>
 
-// Centralized defaults
+// Little endian byte packing of the snapshot payload
+struct ByteWriter {
+    std::vector<uint8_t> buf;
+
+    void raw(const void *v, size_t n) {
+        const uint8_t *p = (const uint8_t *)v;
+        buf.insert(buf.end(), p, p + n);
+    }
+    void u8(uint8_t v) { raw(&v, 1); }
+    void u16(uint16_t v) { raw(&v, 2); }
+    void put(bool v) { u8(v); }
+    void put(int v) { int32_t x = v; raw(&x, 4); }
+    void put(float v) { raw(&v, 4); }
+    void put(const String &s) {
+        u16((uint16_t)s.length());
+        raw(s.c_str(), s.length());
+    }
+};
+
+struct ByteReader {
+    const uint8_t *buf;
+    size_t end;
+    size_t pos;
+    bool ok;
+
+    void raw(void *v, size_t n) {
+        if (!ok || pos + n > end) {
+            ok = false;
+            memset(v, 0, n);
+            return;
+        }
+        memcpy(v, buf + pos, n);
+        pos += n;
+    }
+    uint8_t u8() { uint8_t v; raw(&v, 1); return v; }
+    uint16_t u16() { uint16_t v; raw(&v, 2); return v; }
+    void get(bool &v) { v = u8() != 0; }
+    void get(int &v) { int32_t x; raw(&x, 4); v = x; }
+    void get(float &v) { raw(&v, 4); }
+    void get(String &s) {
+        uint16_t n = u16();
+        s = "";
+        if (!ok || pos + n > end) {
+            ok = false;
+            return;
+        }
+        s.concat((const char *)buf + pos, n);
+        pos += n;
+    }
+};
+
+enum FieldStatus : uint8_t { FIELD_OK, FIELD_MISSING, FIELD_INVALID };
+
+// Fields that fell back to their default while decoding; names point into the tables
+struct FieldReport {
+    struct Entry {
+        const char *section; // nullptr = root
+        const char *name;    // nullptr = the whole section
+        FieldStatus status;
+    };
+    std::vector<Entry> entries;
+
+    void check(FieldStatus st, const char *section, const char *name) {
+        if (st != FIELD_OK) entries.push_back({ section, name, st });
+    }
+
+    // The message is only built when there is something to report
+    String list(FieldStatus st) const {
+        String out;
+        for (const auto &e : entries) {
+            if (e.status != st) continue;
+            if (out.length()) out += ", ";
+            if (e.section) {
+                out += e.section;
+                if (e.name) out += ".";
+            }
+            if (e.name) out += e.name;
+        }
+        return out;
+    }
+};
+
+// One decoder per field type: missing and wrongly typed/out of range values
+// take the table default. Strings are assigned straight from the document.
+static FieldStatus readField(JsonVariantConst v, bool &out, bool def, int, int) {
+    out = def;
+    if (v.isNull()) return FIELD_MISSING;
+    if (!v.is<bool>()) return FIELD_INVALID;
+    out = v.as<bool>();
+    return FIELD_OK;
+}
+
+static FieldStatus readField(JsonVariantConst v, int &out, int def, int lo, int hi) {
+    out = def;
+    if (v.isNull()) return FIELD_MISSING;
+    if (!v.is<int>()) return FIELD_INVALID;
+    int x = v.as<int>();
+    if (x < lo || x > hi) return FIELD_INVALID;
+    out = x;
+    return FIELD_OK;
+}
+
+static FieldStatus readField(JsonVariantConst v, float &out, float def, float lo, float hi) {
+    out = def;
+    if (v.isNull()) return FIELD_MISSING;
+    if (!v.is<float>()) return FIELD_INVALID;
+    float x = v.as<float>();
+    if (!(x >= lo && x <= hi)) return FIELD_INVALID;
+    out = x;
+    return FIELD_OK;
+}
+
+static FieldStatus readField(JsonVariantConst v, String &out, const char *def, int, int) {
+    if (v.isNull()) {
+        out = def;
+        return FIELD_MISSING;
+    }
+    if (!v.is<const char *>()) {
+        out = def;
+        return FIELD_INVALID;
+    }
+    out = v.as<const char *>();
+    return FIELD_OK;
+}
+
+// Table bounds as constants, for values outside the generated codecs
+#define CONFIG_FIELD_LIMITS(m, def, lo, hi) static constexpr float m##_min = lo, m##_max = hi;
+#define CONFIG_ITEM_LIMITS(m, def, lo, hi) static constexpr float m##_def = def, m##_min = lo, m##_max = hi;
+struct ClimateLimits {
+    CONFIG_CLIMATE_FIELDS(CONFIG_FIELD_LIMITS)
+};
+struct DeviceLimits {
+    CONFIG_DEVICE_FIELDS(CONFIG_FIELD_LIMITS)
+};
+struct SchedulePointLimits {
+    CONFIG_SCHEDULE_POINT_FIELDS(CONFIG_ITEM_LIMITS)
+};
+struct MeterPhaseLimits {
+    CONFIG_METER_PHASE_FIELDS(CONFIG_FIELD_LIMITS)
+};
+#undef CONFIG_ITEM_LIMITS
+#undef CONFIG_FIELD_LIMITS
+
+static bool inRange(float x, float lo, float hi) {
+    return x >= lo && x <= hi; // false for NaN
+}
+
+// Shared by the JSON decoder and runtime changes: a point needs a valid "HH:MM"
+// and a temperature inside the table bounds
+static bool validSchedulePoint(const SchedulePoint &sp) {
+    uint16_t minutes;
+    return ScheduleEngine::parseTime(sp.time, minutes) &&
+           inRange(sp.temp, SchedulePointLimits::temp_min, SchedulePointLimits::temp_max);
+}
+
+// Table expansion: defaults, JSON decode/encode and snapshot pack/unpack per struct
+#define CONFIG_FIELD_DEFAULT(m, def, lo, hi) s.m = def;
+#define CONFIG_FIELD_DECODE(m, def, lo, hi) report.check(readField(obj[#m], s.m, def, lo, hi), section, #m);
+#define CONFIG_FIELD_ENCODE(m, def, lo, hi) obj[#m] = s.m;
+#define CONFIG_FIELD_PACK(m, def, lo, hi) w.put(s.m);
+#define CONFIG_FIELD_UNPACK(m, def, lo, hi) r.get(s.m);
+#define CONFIG_FIELD_EQUAL(m, def, lo, hi) &&a.m == b.m
+#define CONFIG_FIELD_COPY(m, def, lo, hi) dst.m = src.m;
+
+#define CONFIG_CODEC(Type, FIELDS)                                                                   \
+    static void fieldDefaults(Type &s) { FIELDS(CONFIG_FIELD_DEFAULT) }                              \
+    static void decodeFields(JsonObjectConst obj, Type &s, const char *section, FieldReport &report) { \
+        FIELDS(CONFIG_FIELD_DECODE)                                                                  \
+    }                                                                                                \
+    static void encodeFields(JsonObject obj, const Type &s) { FIELDS(CONFIG_FIELD_ENCODE) }          \
+    static void packFields(ByteWriter &w, const Type &s) { FIELDS(CONFIG_FIELD_PACK) }               \
+    static void unpackFields(ByteReader &r, Type &s) { FIELDS(CONFIG_FIELD_UNPACK) }                \
+    static bool fieldsEqual(const Type &a, const Type &b) { return true FIELDS(CONFIG_FIELD_EQUAL); } \
+    static void copyFields(Type &dst, const Type &src) { FIELDS(CONFIG_FIELD_COPY) }
+
+#define CONFIG_SECTION_CODEC(m, Type, FIELDS) CONFIG_CODEC(Type, FIELDS)
+
+CONFIG_CODEC(AppConfig, CONFIG_ROOT_FIELDS)
+CONFIG_CODEC(DeviceConfig, CONFIG_DEVICE_FIELDS)
+CONFIG_SECTIONS(CONFIG_SECTION_CODEC)
+
+static DeviceRole parseRole(const char *s) {
+    if (!strcmp(s, "LOAD")) return DeviceRole::LOAD;
+    if (!strcmp(s, "TRV")) return DeviceRole::TRV;
+    return DeviceRole::UNKNOWN;
+}
+
+static const char *roleName(DeviceRole role) {
+    if (role == DeviceRole::LOAD) return "LOAD";
+    if (role == DeviceRole::TRV) return "TRV";
+    return "UNKNOWN";
+}
+
+// Single pass over the document; parts outside the tables (meter group, devices) follow
+static void decodeConfig(JsonObjectConst root, AppConfig &config, FieldReport &report) {
+    decodeFields(root, config, nullptr, report);
+
+#define CONFIG_DECODE_SECTION(m, Type, FIELDS)                          \
+    {                                                                   \
+        JsonObjectConst obj = root[#m].as<JsonObjectConst>();           \
+        if (obj.isNull()) {                                             \
+            fieldDefaults(config.m);                                    \
+            report.check(FIELD_MISSING, #m, nullptr);                   \
+        } else {                                                        \
+            decodeFields(obj, config.m, #m, report);                    \
+        }                                                               \
+    }
+    CONFIG_SECTIONS(CONFIG_DECODE_SECTION)
+#undef CONFIG_DECODE_SECTION
+
+    // meter group (optional): [{ "id": "AABBCC_0", "max_power_w": 3300 }, ...]
+    config.energy.main_meter_phases.clear();
+    for (JsonVariantConst v : root["energy"]["main_meter_phases"].as<JsonArrayConst>()) {
+        JsonObjectConst ph = v.as<JsonObjectConst>();
+        MeterPhaseConfig mp;
+        mp.id = ph["id"] | "";
+        FieldStatus st = readField(ph["max_power_w"], mp.max_power_w, config.energy.max_power_w,
+                                   MeterPhaseLimits::max_power_w_min, MeterPhaseLimits::max_power_w_max);
+        if (st == FIELD_INVALID) report.check(st, "energy", "main_meter_phases");
+        if (mp.id.length() > 0) config.energy.main_meter_phases.push_back(mp);
+    }
+
+    // devices (optional): only invalid values are reported
+    config.devices.clear();
+    for (JsonPairConst kv : root["devices"].as<JsonObjectConst>()) {
+        JsonObjectConst d = kv.value().as<JsonObjectConst>();
+        DeviceConfig dc;
+        dc.id = kv.key().c_str();
+        FieldReport devReport;
+        decodeFields(d, dc, "devices", devReport);
+        for (const auto &e : devReport.entries) {
+            if (e.status == FIELD_INVALID) report.entries.push_back(e);
+        }
+        dc.role = parseRole(d["role"] | "");
+        for (JsonVariantConst v : d["schedule"].as<JsonArrayConst>()) {
+            JsonObjectConst pt = v.as<JsonObjectConst>();
+            SchedulePoint sp;
+            sp.time = pt["time"] | "";
+            FieldStatus st = readField(pt["temp"], sp.temp, SchedulePointLimits::temp_def,
+                                       SchedulePointLimits::temp_min, SchedulePointLimits::temp_max);
+            sp.days = ScheduleEngine::parseDays(pt["days"]);
+            // A bad point is dropped rather than defaulted: an invented time or temperature would run
+            if (st == FIELD_INVALID || !validSchedulePoint(sp)) {
+                report.check(FIELD_INVALID, "devices", "schedule");
+                continue;
+            }
+            dc.schedule.push_back(sp);
+        }
+        ScheduleEngine::compile(dc);
+        dc.type = DeviceType::UNKNOWN;
+        config.devices[dc.id] = dc;
+    }
+}
+
+static void encodeConfig(JsonObject root, const AppConfig &config) {
+    encodeFields(root, config);
+
+#define CONFIG_ENCODE_SECTION(m, Type, FIELDS) encodeFields(root[#m].to<JsonObject>(), config.m);
+    CONFIG_SECTIONS(CONFIG_ENCODE_SECTION)
+#undef CONFIG_ENCODE_SECTION
+
+    JsonObject e = root["energy"];
+    JsonArray phases = e["main_meter_phases"].to<JsonArray>();
+    for (const auto &mp : config.energy.main_meter_phases) {
+        JsonObject ph = phases.add<JsonObject>();
+        ph["id"] = mp.id;
+        ph["max_power_w"] = mp.max_power_w;
+    }
+
+    JsonObject devs = root["devices"].to<JsonObject>();
+    for (const auto &kv : config.devices) {
+        const DeviceConfig &dc = kv.second;
+        JsonObject d = devs[dc.id.c_str()].to<JsonObject>();
+        encodeFields(d, dc);
+        d["role"] = roleName(dc.role);
+        if (!dc.schedule.empty()) {
+            JsonArray sched = d["schedule"].to<JsonArray>();
+            for (const auto &pt : dc.schedule) {
+                JsonObject p = sched.add<JsonObject>();
+                p["time"] = pt.time;
+                p["temp"] = pt.temp;
+                ScheduleEngine::writeDays(p, pt.days);
+            }
+        }
+    }
+}
+
+static void packConfig(ByteWriter &w, const AppConfig &config) {
+    packFields(w, config);
+
+#define CONFIG_PACK_SECTION(m, Type, FIELDS) packFields(w, config.m);
+    CONFIG_SECTIONS(CONFIG_PACK_SECTION)
+#undef CONFIG_PACK_SECTION
+
+    w.u16((uint16_t)config.energy.main_meter_phases.size());
+    for (const auto &mp : config.energy.main_meter_phases) {
+        w.put(mp.id);
+        w.put(mp.max_power_w);
+    }
+
+    w.u16((uint16_t)config.devices.size());
+    for (const auto &kv : config.devices) {
+        const DeviceConfig &dc = kv.second;
+        w.put(dc.id);
+        packFields(w, dc);
+        w.u8((uint8_t)dc.role);
+        w.u16((uint16_t)dc.schedule.size());
+        for (const auto &pt : dc.schedule) {
+            w.put(pt.time);
+            w.put(pt.temp);
+            w.u8(pt.days);
+        }
+        w.u16((uint16_t)dc.compiledSchedule.size());
+        for (const auto &tr : dc.compiledSchedule) {
+            w.u16(tr.minuteOfWeek);
+            w.put(tr.temp);
+        }
+    }
+}
+
+static bool unpackConfig(ByteReader &r, AppConfig &config) {
+    unpackFields(r, config);
+
+#define CONFIG_UNPACK_SECTION(m, Type, FIELDS) unpackFields(r, config.m);
+    CONFIG_SECTIONS(CONFIG_UNPACK_SECTION)
+#undef CONFIG_UNPACK_SECTION
+
+    config.energy.main_meter_phases.clear();
+    for (uint16_t n = r.u16(); r.ok && n > 0; n--) {
+        MeterPhaseConfig mp;
+        r.get(mp.id);
+        r.get(mp.max_power_w);
+        config.energy.main_meter_phases.push_back(mp);
+    }
+
+    config.devices.clear();
+    for (uint16_t n = r.u16(); r.ok && n > 0; n--) {
+        DeviceConfig dc;
+        r.get(dc.id);
+        unpackFields(r, dc);
+        uint8_t role = r.u8();
+        dc.role = role <= (uint8_t)DeviceRole::UNKNOWN ? (DeviceRole)role : DeviceRole::UNKNOWN;
+        for (uint16_t k = r.u16(); r.ok && k > 0; k--) {
+            SchedulePoint sp;
+            r.get(sp.time);
+            r.get(sp.temp);
+            sp.days = r.u8();
+            dc.schedule.push_back(sp);
+        }
+        for (uint16_t k = r.u16(); r.ok && k > 0; k--) {
+            ScheduleTransition tr;
+            tr.minuteOfWeek = r.u16();
+            r.get(tr.temp);
+            dc.compiledSchedule.push_back(tr);
+        }
+        dc.type = DeviceType::UNKNOWN;
+        config.devices[dc.id] = dc;
+    }
+    return r.ok && r.pos == r.end;
+}
+
+static bool phasesEqual(const EnergyConfig &a, const EnergyConfig &b) {
+    if (a.main_meter_id != b.main_meter_id || a.main_meter_phases.size() != b.main_meter_phases.size()) return false;
+    for (size_t i = 0; i < a.main_meter_phases.size(); i++) {
+        if (a.main_meter_phases[i].id != b.main_meter_phases[i].id ||
+            a.main_meter_phases[i].max_power_w != b.main_meter_phases[i].max_power_w) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Configured part only: ip and type are discovered at runtime
+static bool devicesEqual(const std::map<String, DeviceConfig> &a, const std::map<String, DeviceConfig> &b) {
+    if (a.size() != b.size()) return false;
+    for (auto ia = a.begin(), ib = b.begin(); ia != a.end(); ++ia, ++ib) {
+        const DeviceConfig &da = ia->second;
+        const DeviceConfig &db = ib->second;
+        if (ia->first != ib->first || !fieldsEqual(da, db) || da.role != db.role ||
+            da.schedule.size() != db.schedule.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < da.schedule.size(); i++) {
+            const SchedulePoint &pa = da.schedule[i];
+            const SchedulePoint &pb = db.schedule[i];
+            if (pa.time != pb.time || pa.temp != pb.temp || pa.days != pb.days) return false;
+        }
+    }
+    return true;
+}
+
+// Centralized defaults (see ConfigSchema.h)
 void ConfigManager::setDefaults(AppConfig &config) {
-    config.wifi_ssid = "YOUR_SSID";
-    config.wifi_password = "YOUR_PASSWORD";
-
-    config.energy.max_power_w = 3300;
-    config.energy.buffer_power_w = 200;
-    config.energy.cut_off_delay_s = 10;
-    config.energy.restore_delay_s = 60;
-    config.energy.alarm_enabled = true;
-    config.energy.alarm_freq_hz = 2000;
-    config.energy.main_meter_id = "AABBCC_0";
-
-    config.climate.enabled = true;
-    config.climate.summer_mode = false;
-    config.climate.global_setpoint = 21.0;
-    config.climate.hysteresis = 0.5;
-    config.climate.boiler_relay_id = "DDEEFF_0";
-    config.log_level = 0; // INFO
-    // Default timezone: CET + DST
-    config.tz_gmt_offset_sec = 3600;
-    config.tz_dst_offset_sec = 3600;
+    fieldDefaults(config);
+
+#define CONFIG_DEFAULT_SECTION(m, Type, FIELDS) fieldDefaults(config.m);
+    CONFIG_SECTIONS(CONFIG_DEFAULT_SECTION)
+#undef CONFIG_DEFAULT_SECTION
+
+    config.energy.main_meter_phases.clear();
+    config.devices.clear();
+}
+
+DeviceConfig ConfigManager::makeDevice(const String &id) {
+    DeviceConfig dc;
+    fieldDefaults(dc);
+    dc.id = id;
+    dc.role = DeviceRole::UNKNOWN;
+    dc.type = DeviceType::UNKNOWN;
+    return dc;
 }
 
 // Load configuration with clear, linear logic:
 // - if SD not mounted: log error, set defaults, return false
 // - if file not found: set defaults, save file, return true
-// - if file exists: parse JSON, detect missing fields, fill defaults for missing, resave if needed
+// - if the compiled snapshot matches the JSON (size + mtime, else CRC): load it
+// - otherwise: parse JSON, detect missing fields, fill defaults for missing, resave if needed
+//   (an unreadable JSON falls back to the backup generation)
+// - finally: replay the change journal on top
 bool ConfigManager::load(AppConfig &config) {
+    unsigned long start = millis();
+    lastLoadCached = false;
+    journalRecords = 0;
+    journalBytes = 0;
+
     // 1) Try to read config file from SD dynamically.
     // If SD is not present or file operations fail, fall back to defaults.
+    // A save interrupted by a power cut is finished or rolled back first.
+    recoverAtomic(filename);
+    recoverAtomic(cacheFilename);
 
     // 2) File missing -> create defaults and persist (attempt)
     if (!SD.exists(filename)) {
         SysLog.log("Config file not found. Creating default configuration file.");
         setDefaults(config);
+        applyLogSettings(config);
         if (!save(config)) {
             SysLog.error("Failed to save default config to SD.");
             return false;
         }
+        lastLoadMs = millis() - start;
         return true;
     }
 
-    // 3) File exists -> read and validate
-    File file = SD.open(filename, FILE_READ);
-    if (!file) {
+    // 3) Fast path: snapshot built from a JSON of the same size and mtime
+    CacheHeader key;
+    if (!readJsonKey(key, false, nullptr)) {
         SysLog.error("Unable to open config file. Using defaults.");
         setDefaults(config);
         return false;
     }
+    if (loadCache(config, key, false)) {
+        baseKey = key;
+        seenKey = key;
+        replayJournal(config, key, false);
+        lastLoadCached = true;
+        lastLoadMs = millis() - start;
+        SysLog.log("Config loaded from snapshot in " + String(lastLoadMs) + " ms");
+        return true;
+    }
 
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, file);
-    file.close();
+    // 4) Read the JSON once: its CRC tells whether the snapshot is still good
+    // (file touched but not changed), otherwise parse it and rebuild the snapshot
+    uint8_t *json = nullptr;
+    if (!readJsonKey(key, true, &json)) {
+        SysLog.error("Unable to read config file. Using defaults.");
+        setDefaults(config);
+        return false;
+    }
+    bool ok;
+    if (loadCache(config, key, true)) {
+        saveCache(config, key);
+        baseKey = key;
+        seenKey = key;
+        replayJournal(config, key, true);
+        lastLoadCached = true;
+        ok = true;
+    } else {
+        ok = loadJson(config, json, key);
+    }
+    heap_caps_free(json);
+    if (!ok) ok = loadBackup(config, key);
+    lastLoadMs = millis() - start;
+    if (ok) {
+        SysLog.log(String("Config loaded from ") + (lastLoadCached ? "snapshot" : "JSON") + " in " +
+                   String(lastLoadMs) + " ms");
+    }
+    return ok;
+}
 
+static bool parseJson(const uint8_t *json, size_t len, AppConfig &config, FieldReport &report) {
+    JsonDocument doc(psramJsonAllocator());
+    DeserializationError err = deserializeJson(doc, (const char *)json, len);
     if (err) {
         SysLog.error(String("Config JSON parse error: ") + err.c_str());
+        return false;
+    }
+    decodeConfig(doc.as<JsonObjectConst>(), config, report);
+    return true;
+}
+
+// Logs the fields that fell back to defaults; true if the file should be resaved
+static bool logReport(const FieldReport &report) {
+    if (report.entries.empty()) return false;
+    String missing = report.list(FIELD_MISSING);
+    String invalid = report.list(FIELD_INVALID);
+    if (missing.length()) SysLog.error("Config missing fields: " + missing);
+    if (invalid.length()) SysLog.error("Config invalid fields (defaults used): " + invalid);
+    return true;
+}
+
+bool ConfigManager::loadJson(AppConfig &config, const uint8_t *json, const CacheHeader &key) {
+    FieldReport report;
+    if (!parseJson(json, key.jsonSize, config, report)) {
         setDefaults(config);
         return false;
     }
 
-    bool missing = false;
-    String missingFields = "";
+    // Apply log settings before reporting so the messages below use them
+    applyLogSettings(config);
 
-    // helper to mark missing
-    auto markMissing = [&](const char *name) {
-        missing = true;
-        if (missingFields.length()) missingFields += ", ";
-        missingFields += name;
-    };
+    // The snapshot mirrors the JSON itself, the journal is replayed on top of both
+    if (report.entries.empty()) saveCache(config, key);
+    baseKey = key;
+    seenKey = key;
+    replayJournal(config, key, true);
 
-    // Defaults container to copy missing values from
-    AppConfig defs;
-    setDefaults(defs);
+    // If any fields were missing or invalid, log once and resave corrected file
+    if (logReport(report)) {
+        SysLog.log("Resaving config with defaults for missing fields...");
+        if (!save(config)) {
+            SysLog.error("Failed to resave corrected config to SD.");
+        }
+    }
 
-    // wifi
-    if (!doc["wifi_ssid"].isNull()) config.wifi_ssid = doc["wifi_ssid"].as<String>();
-    else { config.wifi_ssid = defs.wifi_ssid; markMissing("wifi_ssid"); }
+    return true;
+}
 
-    if (!doc["wifi_password"].isNull()) config.wifi_password = doc["wifi_password"].as<String>();
-    else { config.wifi_password = defs.wifi_password; markMissing("wifi_password"); }
+// The JSON is unreadable: keep it as <path>.bad and promote the backup generation
+bool ConfigManager::loadBackup(AppConfig &config, CacheHeader &key) {
+    String bak = String(filename) + ".bak";
+    String bad = String(filename) + ".bad";
+    if (!SD.exists(bak)) return false;
+    SysLog.error("Config unreadable, restoring previous version (kept as " + bad + ")");
+    SD.remove(bad);
+    SD.rename(filename, bad);
+    if (!SD.rename(bak, filename)) return false;
 
-    // log level (numeric: 0=INFO,1=ERROR,2=DEBUG)
-    if (!doc["log_level"].isNull()) {
-        config.log_level = doc["log_level"].as<int>();
-    } else {
-        config.log_level = defs.log_level;
-        markMissing("log_level");
+    uint8_t *json = nullptr;
+    if (!readJsonKey(key, true, &json)) return false;
+    bool ok = loadJson(config, json, key);
+    heap_caps_free(json);
+    return ok;
+}
+
+void ConfigManager::applyLogSettings(const AppConfig &config) {
+    SysLog.setLogLevel(config.log_level);
+    SysLog.setBinaryFormat(config.log_binary);
+    SysLog.setCompressRotated(config.log_compress);
+    SysLog.setNetworkSink(config.syslog.host, (uint16_t)config.syslog.port, config.syslog.binary,
+                          (uint16_t)config.syslog.max_lines_per_sec);
+}
+
+bool ConfigManager::save(const AppConfig &config) {
+    // Attempt to write to SD dynamically. If SD is missing or write fails, return false.
+
+    JsonDocument doc(psramJsonAllocator());
+    encodeConfig(doc.to<JsonObject>(), config);
+
+    // Serialized in memory first: the snapshot key needs the CRC of exactly these bytes
+    CacheHeader key = {};
+    key.jsonSize = measureJson(doc);
+    uint8_t *json = (uint8_t *)heap_caps_malloc(key.jsonSize + 1, MALLOC_CAP_SPIRAM);
+    if (!json) {
+        SysLog.error("Out of memory serializing config.");
+        return false;
     }
+    serializeJson(doc, (char *)json, key.jsonSize + 1);
+    key.jsonCrc = esp_rom_crc32_le(0, json, key.jsonSize);
 
-    // timezone offsets (seconds)
-    if (!doc["tz_gmt_offset_sec"].isNull()) {
-        config.tz_gmt_offset_sec = doc["tz_gmt_offset_sec"].as<int>();
-    } else {
-        config.tz_gmt_offset_sec = defs.tz_gmt_offset_sec;
-        markMissing("tz_gmt_offset_sec");
+    bool written = writeAtomic(filename, json, key.jsonSize, true);
+    heap_caps_free(json);
+    if (!written) {
+        SysLog.error("Failed to write config to SD. SD may be absent.");
+        return false;
     }
-    if (!doc["tz_dst_offset_sec"].isNull()) {
-        config.tz_dst_offset_sec = doc["tz_dst_offset_sec"].as<int>();
-    } else {
-        config.tz_dst_offset_sec = defs.tz_dst_offset_sec;
-        markMissing("tz_dst_offset_sec");
+
+    // The mtime is only known once the file is closed
+    CacheHeader stat;
+    if (readJsonKey(stat, false, nullptr)) {
+        key.jsonMtime = stat.jsonMtime;
+        saveCache(config, key);
     }
 
-    // Apply log level immediately so subsequent logs during load use it
-    SysLog.setLogLevel(config.log_level);
+    // Everything journaled is in the new JSON now. A power cut before the journal is
+    // gone is harmless: its base no longer matches, so it is discarded at load.
+    baseKey = key;
+    seenKey = key;
+    if (journalRecords > 0 || SD.exists(journalFilename)) SD.remove(journalFilename);
+    journalRecords = 0;
+    journalBytes = 0;
+    return true;
+}
+
+// <path>.tmp is complete once closed; only then does the old file move to <path>.bak
+// (or go away) and the new one take its place
+bool ConfigManager::writeAtomic(const char *path, const uint8_t *data, size_t len, bool keepBackup) {
+    String tmp = String(path) + ".tmp";
+    File file = SD.open(tmp, FILE_WRITE);
+    if (!file) return false;
+    size_t written = file.write(data, len);
+    file.flush();
+    file.close();
+    if (written != len) {
+        SD.remove(tmp);
+        return false;
+    }
+
+    if (SD.exists(path)) {
+        if (keepBackup) {
+            String bak = String(path) + ".bak";
+            SD.remove(bak);
+            if (!SD.rename(path, bak)) {
+                SD.remove(tmp);
+                return false;
+            }
+        } else {
+            SD.remove(path);
+        }
+    }
+    return SD.rename(tmp, path);
+}
 
-    // energy - check subfields individually
-    if (!doc["energy"].isNull()) {
-        JsonObject e = doc["energy"];
-        if (!e["max_power_w"].isNull()) config.energy.max_power_w = e["max_power_w"] | defs.energy.max_power_w;
-        else { config.energy.max_power_w = defs.energy.max_power_w; markMissing("energy.max_power_w"); }
+// Finish or roll back a writeAtomic() cut short by a power loss
+void ConfigManager::recoverAtomic(const char *path) {
+    String tmp = String(path) + ".tmp";
+    String bak = String(path) + ".bak";
+    if (SD.exists(path)) {
+        // Interrupted before the renames: the temp file may be partial
+        if (SD.exists(tmp)) SD.remove(tmp);
+        return;
+    }
+    // Between the renames the temp file is complete; otherwise fall back to the backup
+    if (SD.exists(tmp)) {
+        SysLog.log(String("Completing interrupted save of ") + path);
+        SD.rename(tmp, path);
+    } else if (SD.exists(bak)) {
+        SysLog.log(String("Restoring ") + path + " from backup");
+        SD.rename(bak, path);
+    }
+}
 
-        if (!e["buffer_power_w"].isNull()) config.energy.buffer_power_w = e["buffer_power_w"] | defs.energy.buffer_power_w;
-        else { config.energy.buffer_power_w = defs.energy.buffer_power_w; markMissing("energy.buffer_power_w"); }
+// Size and mtime of the JSON; with withCrc also its CRC, and optionally the
+// whole file (PSRAM, NUL terminated, caller frees) read in one go
+bool ConfigManager::readJsonKey(CacheHeader &key, bool withCrc, uint8_t **json) {
+    File file = SD.open(filename, FILE_READ);
+    if (!file) return false;
+    key.jsonSize = file.size();
+    key.jsonMtime = (uint32_t)file.getLastWrite();
+    key.jsonCrc = 0;
+    if (withCrc) {
+        uint8_t *buf = (uint8_t *)heap_caps_malloc(key.jsonSize + 1, MALLOC_CAP_SPIRAM);
+        bool ok = buf && file.read(buf, key.jsonSize) == key.jsonSize;
+        if (ok) {
+            buf[key.jsonSize] = '\0';
+            key.jsonCrc = esp_rom_crc32_le(0, buf, key.jsonSize);
+        }
+        if (ok && json) *json = buf;
+        else heap_caps_free(buf);
+        if (!ok) {
+            file.close();
+            return false;
+        }
+    }
+    file.close();
+    return true;
+}
 
-        if (!e["cut_off_delay_s"].isNull()) config.energy.cut_off_delay_s = e["cut_off_delay_s"] | defs.energy.cut_off_delay_s;
-        else { config.energy.cut_off_delay_s = defs.energy.cut_off_delay_s; markMissing("energy.cut_off_delay_s"); }
+bool ConfigManager::keyMatches(const CacheHeader &stored, const CacheHeader &key, bool matchCrc) {
+    if (stored.jsonSize != key.jsonSize) return false;
+    if (matchCrc) return stored.jsonCrc == key.jsonCrc;
+    return key.jsonMtime != 0 && stored.jsonMtime == key.jsonMtime;
+}
 
-        if (!e["restore_delay_s"].isNull()) config.energy.restore_delay_s = e["restore_delay_s"] | defs.energy.restore_delay_s;
-        else { config.energy.restore_delay_s = defs.energy.restore_delay_s; markMissing("energy.restore_delay_s"); }
+bool ConfigManager::loadCache(AppConfig &config, CacheHeader &key, bool matchCrc) {
+    File file = SD.open(cacheFilename, FILE_READ);
+    if (!file) return false;
+    size_t size = file.size();
+    if (size < sizeof(CacheHeader) || size > CACHE_MAX) {
+        file.close();
+        return false;
+    }
+    uint8_t *buf = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    bool ok = buf && file.read(buf, size) == size;
+    file.close();
+
+    CacheHeader h;
+    if (ok) {
+        memcpy(&h, buf, sizeof(h));
+        ok = h.magic == CACHE_MAGIC && h.version == CACHE_VERSION &&
+             h.payloadSize == size - sizeof(CacheHeader) && keyMatches(h, key, matchCrc);
+    }
+    if (ok) {
+        uint32_t crc = esp_rom_crc32_le(0, buf, offsetof(CacheHeader, crc));
+        ok = esp_rom_crc32_le(crc, buf + sizeof(CacheHeader), h.payloadSize) == h.crc;
+    }
+    if (ok) {
+        // Decoded aside so a damaged snapshot never leaves a half-filled config
+        AppConfig loaded;
+        ByteReader r = { buf, size, sizeof(CacheHeader), true };
+        ok = unpackConfig(r, loaded);
+        if (ok) config = loaded;
+    }
+    heap_caps_free(buf);
+    if (ok) {
+        key.jsonCrc = h.jsonCrc; // Not computed on the fast path
+        applyLogSettings(config);
+    }
+    return ok;
+}
+
+bool ConfigManager::saveCache(const AppConfig &config, const CacheHeader &key) {
+    ByteWriter w;
+    w.buf.resize(sizeof(CacheHeader));
+    packConfig(w, config);
+
+    CacheHeader h = key;
+    h.magic = CACHE_MAGIC;
+    h.version = CACHE_VERSION;
+    h.reserved = 0;
+    h.payloadSize = w.buf.size() - sizeof(CacheHeader);
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&h, offsetof(CacheHeader, crc));
+    h.crc = esp_rom_crc32_le(crc, w.buf.data() + sizeof(CacheHeader), h.payloadSize);
+    memcpy(w.buf.data(), &h, sizeof(h));
+
+    // No backup generation: the snapshot can always be rebuilt from the JSON
+    if (!writeAtomic(cacheFilename, w.buf.data(), w.buf.size(), false)) {
+        SD.remove(cacheFilename);
+        SysLog.error("Failed to write config snapshot.");
+        return false;
+    }
+    return true;
+}
+
+static void packChange(ByteWriter &w, const ConfigChange &change) {
+    w.u8(change.op);
+    switch (change.op) {
+    case ConfigChange::GLOBAL_SETPOINT:
+        w.put(change.setpoint);
+        break;
+    case ConfigChange::DEVICE_PRIORITY:
+        w.put(change.deviceId);
+        w.put(change.priority);
+        break;
+    case ConfigChange::DEVICE_SCHEDULE:
+        w.put(change.deviceId);
+        w.put(change.scheduleEnabled);
+        w.u16((uint16_t)change.schedule.size());
+        for (const auto &pt : change.schedule) {
+            w.put(pt.time);
+            w.put(pt.temp);
+            w.u8(pt.days);
+        }
+        break;
+    }
+}
 
-        if (!e["alarm_enabled"].isNull()) config.energy.alarm_enabled = e["alarm_enabled"] | defs.energy.alarm_enabled;
-        else { config.energy.alarm_enabled = defs.energy.alarm_enabled; markMissing("energy.alarm_enabled"); }
+static bool unpackChange(ByteReader &r, ConfigChange &change) {
+    change.op = (ConfigChange::Op)r.u8();
+    switch (change.op) {
+    case ConfigChange::GLOBAL_SETPOINT:
+        r.get(change.setpoint);
+        break;
+    case ConfigChange::DEVICE_PRIORITY:
+        r.get(change.deviceId);
+        r.get(change.priority);
+        break;
+    case ConfigChange::DEVICE_SCHEDULE:
+        r.get(change.deviceId);
+        r.get(change.scheduleEnabled);
+        for (uint16_t n = r.u16(); r.ok && n > 0; n--) {
+            SchedulePoint sp;
+            r.get(sp.time);
+            r.get(sp.temp);
+            sp.days = r.u8();
+            change.schedule.push_back(sp);
+        }
+        break;
+    default:
+        return false;
+    }
+    return r.ok && r.pos == r.end;
+}
 
-        if (!e["alarm_freq_hz"].isNull()) config.energy.alarm_freq_hz = e["alarm_freq_hz"] | defs.energy.alarm_freq_hz;
-        else { config.energy.alarm_freq_hz = defs.energy.alarm_freq_hz; markMissing("energy.alarm_freq_hz"); }
+// Same ranges the JSON decoder enforces, from the same tables
+static bool validChange(const ConfigChange &change) {
+    switch (change.op) {
+    case ConfigChange::GLOBAL_SETPOINT:
+        return inRange(change.setpoint, ClimateLimits::global_setpoint_min, ClimateLimits::global_setpoint_max);
+    case ConfigChange::DEVICE_PRIORITY:
+        return inRange(change.priority, DeviceLimits::priority_min, DeviceLimits::priority_max);
+    case ConfigChange::DEVICE_SCHEDULE:
+        for (const auto &pt : change.schedule) {
+            if (!validSchedulePoint(pt)) return false;
+        }
+        return true;
+    }
+    return false;
+}
 
-        if (!e["main_meter_id"].isNull()) config.energy.main_meter_id = e["main_meter_id"].as<String>();
-        else { config.energy.main_meter_id = defs.energy.main_meter_id; markMissing("energy.main_meter_id"); }
+bool ConfigManager::applyChange(AppConfig &config, const ConfigChange &change) {
+    if (!validChange(change)) {
+        SysLog.error("Config change rejected: value out of range" +
+                     (change.deviceId.length() ? " for " + change.deviceId : String()));
+        return false;
+    }
+    if (change.op == ConfigChange::GLOBAL_SETPOINT) {
+        config.climate.global_setpoint = change.setpoint;
+        return true;
+    }
+    auto it = config.devices.find(change.deviceId);
+    if (it == config.devices.end()) {
+        SysLog.error("Config change ignored: unknown device " + change.deviceId);
+        return false;
+    }
+    DeviceConfig &dc = it->second;
+    if (change.op == ConfigChange::DEVICE_PRIORITY) {
+        dc.priority = change.priority;
     } else {
-        config.energy = defs.energy;
-        markMissing("energy");
+        dc.schedule_enabled = change.scheduleEnabled;
+        dc.schedule = change.schedule;
+        ScheduleEngine::compile(dc);
     }
+    return true;
+}
 
-    // climate
-    if (!doc["climate"].isNull()) {
-        JsonObject c = doc["climate"];
-        if (!c["enabled"].isNull()) config.climate.enabled = c["enabled"] | defs.climate.enabled;
-        else { config.climate.enabled = defs.climate.enabled; markMissing("climate.enabled"); }
+bool ConfigManager::apply(AppConfig &config, const ConfigChange &change) {
+    if (!applyChange(config, change)) return false;
+    lastChangeMs = millis();
+    if (!appendJournal(change)) {
+        // Kept in memory: force a compaction to write it into the JSON
+        SysLog.error("Failed to journal config change.");
+        journalRecords++;
+        journalBytes = JOURNAL_COMPACT_BYTES;
+    }
+    return true;
+}
 
-        if (!c["summer_mode"].isNull()) config.climate.summer_mode = c["summer_mode"] | defs.climate.summer_mode;
-        else { config.climate.summer_mode = defs.climate.summer_mode; markMissing("climate.summer_mode"); }
+bool ConfigManager::appendJournal(const ConfigChange &change) {
+    ByteWriter rec;
+    rec.u16(0);
+    packChange(rec, change);
+    uint16_t len = rec.buf.size() - 2;
+    memcpy(rec.buf.data(), &len, 2);
+    uint32_t crc = esp_rom_crc32_le(0, rec.buf.data() + 2, len);
+    rec.raw(&crc, 4);
 
-        if (!c["global_setpoint"].isNull()) config.climate.global_setpoint = c["global_setpoint"] | defs.climate.global_setpoint;
-        else { config.climate.global_setpoint = defs.climate.global_setpoint; markMissing("climate.global_setpoint"); }
+    File file = SD.open(journalFilename, FILE_APPEND);
+    if (!file) return false;
+    bool ok = true;
+    if (file.size() == 0) {
+        CacheHeader h = baseKey;
+        h.magic = JOURNAL_MAGIC;
+        h.version = JOURNAL_VERSION;
+        h.reserved = 0;
+        h.payloadSize = 0;
+        h.crc = esp_rom_crc32_le(0, (const uint8_t *)&h, offsetof(CacheHeader, crc));
+        ok = file.write((const uint8_t *)&h, sizeof(h)) == sizeof(h);
+        journalBytes = sizeof(h);
+    }
+    ok = ok && file.write(rec.buf.data(), rec.buf.size()) == rec.buf.size();
+    file.flush();
+    file.close();
+    if (!ok) return false;
+    journalRecords++;
+    journalBytes += rec.buf.size();
+    return true;
+}
 
-        if (!c["hysteresis"].isNull()) config.climate.hysteresis = c["hysteresis"] | defs.climate.hysteresis;
-        else { config.climate.hysteresis = defs.climate.hysteresis; markMissing("climate.hysteresis"); }
+void ConfigManager::replayJournal(AppConfig &config, const CacheHeader &key, bool matchCrc) {
+    journalRecords = 0;
+    journalBytes = 0;
+    File file = SD.open(journalFilename, FILE_READ);
+    if (!file) return;
+    size_t size = file.size();
+    uint8_t *buf = size <= CACHE_MAX ? (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM) : nullptr;
+    bool ok = buf && file.read(buf, size) == size;
+    file.close();
 
-        if (!c["boiler_relay_id"].isNull()) config.climate.boiler_relay_id = c["boiler_relay_id"].as<String>();
-        else { config.climate.boiler_relay_id = defs.climate.boiler_relay_id; markMissing("climate.boiler_relay_id"); }
+    CacheHeader h;
+    if (ok && size >= sizeof(h)) {
+        memcpy(&h, buf, sizeof(h));
+        ok = h.magic == JOURNAL_MAGIC && h.version == JOURNAL_VERSION &&
+             h.crc == esp_rom_crc32_le(0, buf, offsetof(CacheHeader, crc));
     } else {
-        config.climate = defs.climate;
-        markMissing("climate");
+        ok = false;
+    }
+    if (!ok || !keyMatches(h, key, matchCrc)) {
+        // Unreadable, or written against a JSON that has since been replaced
+        if (ok) SysLog.error("Config changed on SD: discarding journaled changes");
+        heap_caps_free(buf);
+        SD.remove(journalFilename);
+        return;
     }
 
-    // devices (optional)
-    config.devices.clear();
-    if (!doc["devices"].isNull()) {
-        JsonObject devs = doc["devices"];
-        for (JsonPair kv : devs) {
-            String id = kv.key().c_str();
-            JsonObject d = kv.value().as<JsonObject>();
-            DeviceConfig dc;
-            dc.id = id;
-            dc.name = d["name"].as<String>();
-            dc.room = d["room"].as<String>();
-            dc.priority = d["priority"] | 0;
-            String roleStr = d["role"].as<String>();
-            if (roleStr == "LOAD") dc.role = DeviceRole::LOAD;
-            else if (roleStr == "TRV") dc.role = DeviceRole::TRV;
-            else dc.role = DeviceRole::UNKNOWN;
-            dc.schedule_enabled = d["schedule_enabled"] | false;
-            if (!d["schedule"].isNull()) {
-                JsonArray sched = d["schedule"];
-                for (JsonObject pt : sched) {
-                    SchedulePoint sp;
-                    sp.time = pt["time"].as<String>();
-                    sp.temp = pt["temp"] | 20.0;
-                    dc.schedule.push_back(sp);
-                }
-            }
-            dc.type = DeviceType::UNKNOWN;
-            config.devices[id] = dc;
-        }
+    // Stop at the first damaged record: a power cut can only tear the last one
+    size_t pos = sizeof(h);
+    uint32_t applied = 0;
+    while (pos + 2 <= size) {
+        uint16_t len;
+        memcpy(&len, buf + pos, 2);
+        if (pos + 2 + len + 4 > size) break;
+        uint32_t crc;
+        memcpy(&crc, buf + pos + 2 + len, 4);
+        if (crc != esp_rom_crc32_le(0, buf + pos + 2, len)) break;
+        ConfigChange change;
+        ByteReader r = { buf, pos + 2 + len, pos + 2, true };
+        if (unpackChange(r, change) && applyChange(config, change)) applied++;
+        journalRecords++;
+        pos += 2 + len + 4;
     }
+    heap_caps_free(buf);
+    journalBytes = pos;
+    lastChangeMs = millis();
 
-    // If any fields were missing, log once and resave corrected file
-    if (missing) {
-        SysLog.error(String("Config missing fields: ") + missingFields);
-        SysLog.log("Resaving config with defaults for missing fields...");
-        if (!save(config)) {
-            SysLog.error("Failed to resave corrected config to SD.");
-        }
+    if (journalRecords > 0) SysLog.log("Config journal: " + String(applied) + " change(s) replayed");
+    if (pos < size) {
+        // Appending after a torn record would hide everything written later
+        SysLog.error("Config journal damaged after " + String(journalRecords) + " change(s), compacting");
+        save(config);
     }
+}
+
+// Stat only: size and mtime of the JSON against the last one loaded, saved or seen.
+// Absent (card out) is not a change.
+bool ConfigManager::diskDiffersFromSeen(CacheHeader &key) {
+    if (!readJsonKey(key, false, nullptr)) return false;
+    return key.jsonSize != seenKey.jsonSize || key.jsonMtime != seenKey.jsonMtime;
+}
 
+bool ConfigManager::changedOnDisk() {
+    CacheHeader key;
+    if (!diskDiffersFromSeen(key)) return false;
+    seenKey.jsonSize = key.jsonSize;
+    seenKey.jsonMtime = key.jsonMtime;
     return true;
 }
 
-bool ConfigManager::save(const AppConfig &config) {
-    // Attempt to write to SD dynamically. If SD is missing or write fails, return false.
+bool ConfigManager::parseReload(Reload &reload) {
+    uint8_t *json = nullptr;
+    if (!readJsonKey(reload.key, true, &json)) return false;
+    FieldReport report;
+    bool ok = parseJson(json, reload.key.jsonSize, reload.config, report);
+    heap_caps_free(json);
+    if (ok) reload.resave = logReport(report);
+    return ok;
+}
+
+uint32_t ConfigManager::commitReload(AppConfig &config, Reload &reload) {
+    AppConfig &next = reload.config;
 
-    JsonDocument doc;
-    doc["wifi_ssid"] = config.wifi_ssid;
-    doc["wifi_password"] = config.wifi_password;
-
-    JsonObject e = doc["energy"].to<JsonObject>();
-    e["max_power_w"] = config.energy.max_power_w;
-    e["buffer_power_w"] = config.energy.buffer_power_w;
-    e["cut_off_delay_s"] = config.energy.cut_off_delay_s;
-    e["restore_delay_s"] = config.energy.restore_delay_s;
-    e["alarm_enabled"] = config.energy.alarm_enabled;
-    e["alarm_freq_hz"] = config.energy.alarm_freq_hz;
-    e["main_meter_id"] = config.energy.main_meter_id;
-
-    JsonObject c = doc["climate"].to<JsonObject>();
-    c["enabled"] = config.climate.enabled;
-    c["summer_mode"] = config.climate.summer_mode;
-    c["global_setpoint"] = config.climate.global_setpoint;
-    c["hysteresis"] = config.climate.hysteresis;
-    c["boiler_relay_id"] = config.climate.boiler_relay_id;
-
-    doc["log_level"] = config.log_level;
-    doc["tz_gmt_offset_sec"] = config.tz_gmt_offset_sec;
-    doc["tz_dst_offset_sec"] = config.tz_dst_offset_sec;
-
-    JsonObject devs = doc["devices"].to<JsonObject>();
+    // Keep what was discovered at runtime; discovered devices missing from the
+    // file stay known, as unconfigured
+    for (auto &kv : next.devices) {
+        auto it = config.devices.find(kv.first);
+        if (it == config.devices.end()) continue;
+        kv.second.ip = it->second.ip;
+        kv.second.type = it->second.type;
+        if (kv.second.name.length() == 0) kv.second.name = it->second.name;
+    }
     for (const auto &kv : config.devices) {
-        const DeviceConfig &dc = kv.second;
-        JsonObject d = devs[dc.id.c_str()].to<JsonObject>();
-        d["name"] = dc.name;
-        d["room"] = dc.room;
-        d["priority"] = dc.priority;
-        if (dc.role == DeviceRole::LOAD) d["role"] = "LOAD";
-        else if (dc.role == DeviceRole::TRV) d["role"] = "TRV";
-        else d["role"] = "UNKNOWN";
-        d["schedule_enabled"] = dc.schedule_enabled;
-        if (!dc.schedule.empty()) {
-            JsonArray sched = d["schedule"].to<JsonArray>();
-            for (const auto &pt : dc.schedule) {
-                JsonObject p = sched.add<JsonObject>();
-                p["time"] = pt.time;
-                p["temp"] = pt.temp;
-            }
-        }
+        const DeviceConfig &old = kv.second;
+        if (old.ip.length() == 0 || next.devices.count(kv.first)) continue;
+        DeviceConfig dc = makeDevice(old.id);
+        dc.name = old.name;
+        dc.ip = old.ip;
+        dc.type = old.type;
+        next.devices[dc.id] = dc;
     }
 
-    File file = SD.open(filename, FILE_WRITE);
-    if (!file) {
-        SysLog.error("Failed to open config file for writing. SD may be absent.");
-        return false;
+    uint32_t changed = 0;
+    if (!fieldsEqual(config, next)) changed |= SECTION_ROOT;
+    if (!fieldsEqual(config.energy, next.energy)) changed |= SECTION_ENERGY;
+    if (!phasesEqual(config.energy, next.energy)) changed |= SECTION_METER;
+    if (!fieldsEqual(config.climate, next.climate)) changed |= SECTION_CLIMATE;
+    if (!fieldsEqual(config.syslog, next.syslog)) changed |= SECTION_SYSLOG;
+    if (!devicesEqual(config.devices, next.devices)) changed |= SECTION_DEVICES;
+
+    // Assigned in place, section by section: the subsystems keep pointers into config
+    if (changed & SECTION_ROOT) copyFields(config, next);
+    if (changed & (SECTION_ENERGY | SECTION_METER)) config.energy = next.energy;
+    if (changed & SECTION_CLIMATE) config.climate = next.climate;
+    if (changed & SECTION_SYSLOG) config.syslog = next.syslog;
+    if (changed & SECTION_DEVICES) config.devices.swap(next.devices);
+    if (changed & (SECTION_ROOT | SECTION_SYSLOG)) applyLogSettings(config);
+
+    // The journal was written against the replaced file: the file wins, as at load
+    if (journalRecords > 0 || SD.exists(journalFilename)) {
+        SysLog.error("Config changed on SD: discarding journaled changes");
+        SD.remove(journalFilename);
     }
-    if (serializeJson(doc, file) == 0) {
-        SysLog.error("Failed to write config to SD.");
-        file.close();
-        return false;
+    journalRecords = 0;
+    journalBytes = 0;
+    baseKey = reload.key;
+    seenKey = reload.key;
+    if (reload.resave) {
+        SysLog.log("Resaving config with defaults for missing fields...");
+        save(config);
+    } else {
+        saveCache(config, reload.key);
+    }
+
+    static const char *const names[] = { "root", "energy", "meter", "climate", "syslog", "devices" };
+    String list;
+    for (int i = 0; i < 6; i++) {
+        if (!(changed & (1u << i))) continue;
+        if (list.length()) list += ", ";
+        list += names[i];
+    }
+    SysLog.log("Config reloaded: " + (list.length() ? list + " changed" : String("no changes")));
+    return changed;
+}
+
+void ConfigManager::loop(const AppConfig &config) {
+    if (journalRecords == 0) return;
+    if (journalBytes < JOURNAL_COMPACT_BYTES && millis() - lastChangeMs < JOURNAL_COMPACT_IDLE_MS) return;
+    // Edited on the card since the last reload poll: saving would overwrite the edit.
+    // seenKey is left alone, so the poll still reloads it (and the file wins over the journal).
+    CacheHeader disk;
+    if (diskDiffersFromSeen(disk)) {
+        SysLog.log("Config file changed on SD, compaction skipped until it is reloaded");
+        lastChangeMs = millis();
+        journalBytes = 0;
+        return;
+    }
+    SysLog.log("Compacting config journal (" + String(journalRecords) + " change(s))");
+    if (!save(config)) {
+        // Retry after another idle period
+        lastChangeMs = millis();
+        journalBytes = 0;
     }
-    file.close();
-    return true;
 }
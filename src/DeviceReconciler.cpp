@@ -0,0 +1,128 @@
+#include "DeviceReconciler.h"
+#include "LogManager.h"
+#include <math.h>
+
+DeviceReconciler::DeviceReconciler(ShellyManager* mgr) : shellyManager(mgr) {
+    mutex = xSemaphoreCreateMutex();
+}
+
+void DeviceReconciler::setDesiredOn(const String& id, bool on, bool releaseWhenReached) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Desired& d = desired[id];
+    // Re-asserting the same desire is a no-op: keep the retry bookkeeping
+    if (!d.hasOn || d.on != on) {
+        d.attempts = 0;
+        d.nextAttempt = 0;
+    }
+    d.hasOn = true;
+    d.on = on;
+    d.onRelease = releaseWhenReached;
+    xSemaphoreGive(mutex);
+}
+
+void DeviceReconciler::setDesiredTarget(const String& id, float temp, bool releaseWhenReached) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Desired& d = desired[id];
+    if (!d.hasTarget || fabsf(d.target - temp) > TARGET_TOLERANCE) {
+        d.attempts = 0;
+        d.nextAttempt = 0;
+    }
+    d.hasTarget = true;
+    d.target = temp;
+    d.targetRelease = releaseWhenReached;
+    xSemaphoreGive(mutex);
+}
+
+void DeviceReconciler::release(const String& id) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    desired.erase(id);
+    xSemaphoreGive(mutex);
+}
+
+void DeviceReconciler::reconcile() {
+    unsigned long now = millis();
+    uint32_t pollCount = shellyManager->getPollCount();
+
+    // Refill the token bucket
+    if (lastRefill == 0) lastRefill = now;
+    tokens += (now - lastRefill) * (RATE_PER_SEC / 1000.0f);
+    if (tokens > RATE_BURST) tokens = RATE_BURST;
+    lastRefill = now;
+
+    // Decide under the lock, send commands (slow HTTP) outside it so the UI never waits
+    std::vector<Action> actions;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    for (auto it = desired.begin(); it != desired.end();) {
+        Desired& d = it->second;
+        ShellyDevice* dev = shellyManager->getDevice(it->first);
+        if (!dev || !dev->getIsOnline()) { ++it; continue; }
+
+        // Judge a command only against a poll taken after it was sent
+        if (d.attempts > 0 && pollCount == d.pollAtCommand) { ++it; continue; }
+
+        bool onDiff = d.hasOn && dev->getIsOn() != d.on;
+        bool targetDiff = d.hasTarget && fabsf(dev->getTargetTemp() - d.target) > TARGET_TOLERANCE;
+
+        if (!onDiff && !targetDiff) {
+            if (d.attempts > 0) {
+                LOG_DEBUG("Reconciler [%s]: converged after %u command(s)", it->first.c_str(), (unsigned)d.attempts);
+            }
+            d.attempts = 0;
+            d.nextAttempt = 0;
+            if (d.onRelease) d.hasOn = false;
+            if (d.targetRelease) d.hasTarget = false;
+            if (!d.hasOn && !d.hasTarget) {
+                it = desired.erase(it);
+                continue;
+            }
+            ++it;
+            continue;
+        }
+
+        if ((long)(now - d.nextAttempt) < 0) { ++it; continue; }
+
+        // Retry budget spent: back off for a while, then start a fresh budget
+        if (d.attempts >= MAX_ATTEMPTS) {
+            SysLog.error(String("Reconciler [") + it->first + "]: not converging after " + String((int)MAX_ATTEMPTS) + " commands, cooling down");
+            d.attempts = 0;
+            d.nextAttempt = now + COOLDOWN_MS;
+            ++it;
+            continue;
+        }
+
+        if (actions.size() >= MAX_COMMANDS_PER_PASS || tokens < 1.0f) {
+            rateLimitedCount++;
+            ++it;
+            continue;
+        }
+        tokens -= 1.0f;
+
+        d.attempts++;
+        d.pollAtCommand = pollCount;
+        unsigned long backoff = RETRY_BASE_MS << (d.attempts - 1);
+        d.nextAttempt = now + (backoff > RETRY_MAX_MS ? RETRY_MAX_MS : backoff);
+
+        // Relay first: one command per device per pass
+        if (onDiff) actions.push_back({it->first, true, d.on, 0.0f});
+        else actions.push_back({it->first, false, false, d.target});
+        ++it;
+    }
+    xSemaphoreGive(mutex);
+
+    for (const auto& a : actions) {
+        commandCount++;
+        if (!execute(a)) failureCount++;
+    }
+}
+
+bool DeviceReconciler::execute(const Action& a) {
+    ShellyDevice* dev = shellyManager->getDevice(a.id);
+    if (!dev) return false;
+
+    if (a.setOn) {
+        LOG_DEBUG("Reconciler [%s]: correcting relay -> %s", a.id.c_str(), a.on ? "ON" : "OFF");
+        return a.on ? dev->turnOn() : dev->turnOff();
+    }
+    LOG_DEBUG("Reconciler [%s]: correcting setpoint -> %.2f", a.id.c_str(), a.target);
+    return dev->setTargetTemperature(a.target);
+}
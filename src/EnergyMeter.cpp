@@ -0,0 +1,276 @@
+#include "EnergyMeter.h"
+#include "LogManager.h"
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <time.h>
+
+static const uint32_t ENERGY_MAGIC = 0x454E5247; // "ENRG"
+static const uint16_t ENERGY_VERSION = 1;
+
+bool EnergyMeter::begin() {
+    size_t imageSize = sizeof(Header) + MAX_DEVICES * sizeof(DeviceRecord);
+    uint8_t* image = (uint8_t*)heap_caps_calloc(1, imageSize, MALLOC_CAP_SPIRAM);
+    if (!image) {
+        SysLog.error("EnergyMeter: failed to allocate PSRAM image");
+        return false;
+    }
+    header = (Header*)image;
+    records = (DeviceRecord*)(image + sizeof(Header));
+
+    if (!restore()) {
+        memset(image, 0, imageSize);
+        header->magic = ENERGY_MAGIC;
+        header->version = ENERGY_VERSION;
+        header->maxDevices = MAX_DEVICES;
+        header->hourlyBuckets = HOURLY_BUCKETS;
+        header->dailyBuckets = DAILY_BUCKETS;
+        headerDirty = true;
+    }
+    lastCheckpoint = millis();
+    SysLog.log(String("EnergyMeter: ready, image ") + String((int)imageSize) + " bytes");
+    return true;
+}
+
+// Local (timezone-adjusted) hour/day numbers since epoch. False while the clock is not set.
+bool EnergyMeter::localTimeKeys(int32_t& hour, int32_t& day) {
+    time_t now = time(nullptr);
+    if (now < 1609459200) return false; // Before Jan 1, 2021 => no NTP/RTC time yet
+
+    struct tm lt, gt;
+    localtime_r(&now, &lt);
+    gmtime_r(&now, &gt);
+    long offset = (lt.tm_hour - gt.tm_hour) * 3600L + (lt.tm_min - gt.tm_min) * 60L;
+    int dayDiff = lt.tm_yday - gt.tm_yday;
+    if (dayDiff == 1 || dayDiff < -1) offset += 86400L;
+    else if (dayDiff == -1 || dayDiff > 1) offset -= 86400L;
+
+    long local = (long)now + offset;
+    hour = (int32_t)(local / 3600L);
+    day = (int32_t)(local / 86400L);
+    return true;
+}
+
+int EnergyMeter::findSlot(const String& id) const {
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (records[i].id[0] != '\0' && strncmp(records[i].id, id.c_str(), ID_LEN) == 0) return i;
+    }
+    return -1;
+}
+
+int EnergyMeter::findOrCreateSlot(const String& id) {
+    int slot = findSlot(id);
+    if (slot >= 0) return slot;
+    if (id.length() == 0 || id.length() >= ID_LEN) return -1;
+
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (records[i].id[0] == '\0') {
+            memset(&records[i], 0, sizeof(DeviceRecord));
+            strncpy(records[i].id, id.c_str(), ID_LEN - 1);
+            integrators[i] = Integrator();
+            integrators[i].dirty = true;
+            return i;
+        }
+    }
+    SysLog.error(String("EnergyMeter: no free slot for ") + id);
+    return -1;
+}
+
+// Close the buckets in progress and zero any buckets skipped while offline
+void EnergyMeter::rollover(int32_t hour, int32_t day) {
+    int32_t prevHour = header->currentHour;
+    int32_t prevDay = header->currentDay;
+    header->currentHour = hour;
+    header->currentDay = day;
+    headerDirty = true;
+
+    // First valid clock since the image was created: energy integrated so far
+    // simply belongs to the current buckets.
+    if (prevHour == 0) return;
+
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        DeviceRecord& rec = records[i];
+        if (rec.id[0] == '\0') continue;
+
+        if (hour != prevHour) {
+            float wh = rec.hourWh + 0.5f;
+            rec.hourly[prevHour % HOURLY_BUCKETS] = (wh > 65535.0f) ? 65535 : (uint16_t)wh;
+            int32_t gap = hour - prevHour;
+            if (gap > HOURLY_BUCKETS) gap = HOURLY_BUCKETS;
+            for (int32_t h = 1; h < gap; h++) rec.hourly[(prevHour + h) % HOURLY_BUCKETS] = 0;
+            rec.hourWh = 0.0f;
+        }
+
+        if (day != prevDay) {
+            rec.daily[prevDay % DAILY_BUCKETS] = (uint32_t)(rec.dayWh + 0.5f);
+            int32_t gap = day - prevDay;
+            if (gap > DAILY_BUCKETS) gap = DAILY_BUCKETS;
+            for (int32_t d = 1; d < gap; d++) rec.daily[(prevDay + d) % DAILY_BUCKETS] = 0;
+            rec.dayWh = 0.0f;
+        }
+        integrators[i].dirty = true;
+    }
+}
+
+void EnergyMeter::addSample(const String& id, float powerW, bool online, unsigned long nowMs) {
+    if (!records) return;
+
+    // Bucket boundaries only need checking once per second, not once per device
+    if (lastKeyCheck == 0 || nowMs - lastKeyCheck >= 1000) {
+        lastKeyCheck = nowMs;
+        int32_t hour, day;
+        if (localTimeKeys(hour, day) && (hour != header->currentHour || day != header->currentDay)) {
+            rollover(hour, day);
+        }
+    }
+
+    int slot = findOrCreateSlot(id);
+    if (slot < 0) return;
+    Integrator& in = integrators[slot];
+
+    if (!online) {
+        in.hasSample = false;
+        return;
+    }
+    if (powerW < 0.0f) powerW = 0.0f; // consumption only
+
+    if (in.hasSample) {
+        unsigned long dt = nowMs - in.lastSampleMs;
+        if (dt > 0 && dt <= MAX_GAP_MS) {
+            float wh = (in.lastPowerW + powerW) * 0.5f * (dt / 3600000.0f);
+            if (wh > 0.0f) {
+                records[slot].hourWh += wh;
+                records[slot].dayWh += wh;
+                in.dirty = true;
+            }
+        }
+    }
+    in.lastPowerW = powerW;
+    in.lastSampleMs = nowMs;
+    in.hasSample = true;
+}
+
+void EnergyMeter::loop() {
+    if (!records) return;
+    unsigned long now = millis();
+    if (now - lastCheckpoint < CHECKPOINT_INTERVAL_MS) return;
+    lastCheckpoint = now;
+    checkpoint();
+}
+
+uint32_t EnergyMeter::recordCrc(const DeviceRecord& rec) {
+    return esp_rom_crc32_le(0, (const uint8_t*)&rec, offsetof(DeviceRecord, crc));
+}
+
+// Write the header and dirty device records in place. A new file (or one restore()
+// rejected) is written in full once, so its size and layout match the image and each
+// checkpoint rewrites only what changed.
+bool EnergyMeter::checkpoint() {
+    if (!records || !SysLog.isSdMounted()) return false;
+
+    bool full = fileStale || !SD.exists(path);
+    File f = SD.open(path, full ? FILE_WRITE : "r+");
+    if (!f) {
+        SysLog.error("EnergyMeter: unable to open checkpoint file");
+        return false;
+    }
+
+    if (full || headerDirty) {
+        f.seek(0);
+        f.write((const uint8_t*)header, sizeof(Header));
+        headerDirty = false;
+    }
+
+    int written = 0;
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (!full && !integrators[i].dirty) continue;
+        records[i].crc = recordCrc(records[i]);
+        f.seek(sizeof(Header) + i * sizeof(DeviceRecord));
+        f.write((const uint8_t*)&records[i], sizeof(DeviceRecord));
+        integrators[i].dirty = false;
+        written++;
+    }
+    f.close();
+    fileStale = false;
+
+    LOG_DEBUG("EnergyMeter: checkpoint wrote %d record(s)", written);
+    return true;
+}
+
+bool EnergyMeter::restore() {
+    if (!SysLog.isSdMounted() || !SD.exists(path)) return false;
+
+    File f = SD.open(path, FILE_READ);
+    if (!f) return false;
+
+    size_t imageSize = sizeof(Header) + MAX_DEVICES * sizeof(DeviceRecord);
+    if (f.size() != imageSize) {
+        f.close();
+        fileStale = true;
+        SysLog.error("EnergyMeter: checkpoint size mismatch, starting fresh");
+        return false;
+    }
+
+    f.read((uint8_t*)header, sizeof(Header));
+    if (header->magic != ENERGY_MAGIC || header->version != ENERGY_VERSION ||
+        header->maxDevices != MAX_DEVICES || header->hourlyBuckets != HOURLY_BUCKETS ||
+        header->dailyBuckets != DAILY_BUCKETS) {
+        f.close();
+        fileStale = true;
+        SysLog.error("EnergyMeter: checkpoint header invalid, starting fresh");
+        return false;
+    }
+
+    f.read((uint8_t*)records, MAX_DEVICES * sizeof(DeviceRecord));
+    f.close();
+
+    int restored = 0;
+    for (int i = 0; i < MAX_DEVICES; i++) {
+        if (records[i].id[0] == '\0') continue;
+        if (records[i].crc != recordCrc(records[i])) {
+            SysLog.error(String("EnergyMeter: dropping corrupt record in slot ") + String(i));
+            memset(&records[i], 0, sizeof(DeviceRecord));
+            integrators[i].dirty = true;
+            continue;
+        }
+        restored++;
+    }
+    SysLog.log(String("EnergyMeter: restored ") + String(restored) + " device(s) from SD");
+    return true;
+}
+
+float EnergyMeter::getHourWh(const String& id, int hoursAgo) const {
+    if (!records || hoursAgo < 0 || hoursAgo >= HOURLY_BUCKETS) return 0.0f;
+    int slot = findSlot(id);
+    if (slot < 0) return 0.0f;
+    if (hoursAgo == 0) return records[slot].hourWh;
+    int32_t hour = header->currentHour - hoursAgo;
+    if (header->currentHour == 0 || hour < 0) return 0.0f;
+    return records[slot].hourly[hour % HOURLY_BUCKETS];
+}
+
+float EnergyMeter::dayWhAt(int slot, int daysAgo) const {
+    if (daysAgo == 0) return records[slot].dayWh;
+    int32_t day = header->currentDay - daysAgo;
+    if (header->currentDay == 0 || day < 0) return 0.0f;
+    return (float)records[slot].daily[day % DAILY_BUCKETS];
+}
+
+float EnergyMeter::getDayWh(const String& id, int daysAgo) const {
+    if (!records || daysAgo < 0 || daysAgo >= DAILY_BUCKETS) return 0.0f;
+    int slot = findSlot(id);
+    if (slot < 0) return 0.0f;
+    return dayWhAt(slot, daysAgo);
+}
+
+float EnergyMeter::getTodayWh(const String& id) const {
+    return getDayWh(id, 0);
+}
+
+float EnergyMeter::getWeekWh(const String& id) const {
+    if (!records) return 0.0f;
+    int slot = findSlot(id);
+    if (slot < 0) return 0.0f;
+    float total = 0.0f;
+    for (int d = 0; d < 7; d++) total += dayWhAt(slot, d);
+    return total;
+}
@@ -0,0 +1,316 @@
+#include "HistoryLog.h"
+#include "LogManager.h"
+#include <esp_rom_crc.h>
+#include <vector>
+
+static const uint32_t HISTORY_MAGIC = 0x48495354; // "HIST"
+
+// Worst case per sample: '1111' + 32-bit delta-of-delta, '11' + 5 + 6 + 32-bit XOR
+static const size_t MAX_SAMPLE_BITS = 4 + 32 + 2 + 5 + 6 + 32;
+
+// MSB-first bit packing over a fixed buffer
+struct BitWriter {
+    uint8_t* buf;
+    size_t pos; // bits written
+
+    void write(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            if (value & (1UL << i)) buf[pos >> 3] |= (uint8_t)(0x80 >> (pos & 7));
+            pos++;
+        }
+    }
+};
+
+struct BitReader {
+    const uint8_t* buf;
+    size_t pos;
+    size_t end;
+
+    bool read(int bits, uint32_t& value) {
+        if (pos + bits > end) return false;
+        value = 0;
+        for (int i = 0; i < bits; i++) {
+            value = (value << 1) | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+            pos++;
+        }
+        return true;
+    }
+};
+
+static uint32_t floatBits(float v) {
+    uint32_t b;
+    memcpy(&b, &v, sizeof(b));
+    return b;
+}
+
+static float bitsFloat(uint32_t b) {
+    float v;
+    memcpy(&v, &b, sizeof(v));
+    return v;
+}
+
+uint32_t HistoryLog::seriesId(const String& name) {
+    uint32_t h = 2166136261UL;
+    for (size_t i = 0; i < name.length(); i++) {
+        h ^= (uint8_t)name[i];
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+uint32_t HistoryLog::blockCrc(const Block& b) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)&b.header, offsetof(BlockHeader, crc));
+    return esp_rom_crc32_le(crc, b.payload, PAYLOAD_SIZE);
+}
+
+HistoryLog::Stream* HistoryLog::findStream(uint32_t id) {
+    Stream* freeSlot = nullptr;
+    for (auto& s : streams) {
+        if (s.used && s.seriesId == id) return &s;
+        if (!s.used && !freeSlot) freeSlot = &s;
+    }
+    if (!freeSlot) return nullptr;
+    freeSlot->used = true;
+    freeSlot->seriesId = id;
+    freeSlot->block.header.count = 0;
+    return freeSlot;
+}
+
+// First sample of a block is stored verbatim: time in the header, value as raw bits
+void HistoryLog::startBlock(Stream& s, uint32_t time, float value) {
+    memset(&s.block, 0, sizeof(Block));
+    s.block.header.magic = HISTORY_MAGIC;
+    s.block.header.seriesId = s.seriesId;
+    s.block.header.firstTime = time;
+    s.block.header.lastTime = time;
+    s.block.header.count = 1;
+
+    BitWriter w = {s.block.payload, 0};
+    s.prevBits = floatBits(value);
+    w.write(s.prevBits, 32);
+    s.block.header.bitCount = (uint16_t)w.pos;
+
+    s.prevTime = time;
+    s.prevDelta = 0;
+    s.prevLeading = 0xFF;
+    s.prevTrailing = 0;
+    s.fileOffset = -1;
+    s.dirty = true;
+}
+
+void HistoryLog::append(uint32_t id, uint32_t time, float value) {
+    Stream* s = findStream(id);
+    if (!s) {
+        SysLog.error("HistoryLog: too many series");
+        return;
+    }
+
+    if (s->block.header.count == 0) {
+        startBlock(*s, time, value);
+        return;
+    }
+    if (time <= s->prevTime) return; // duplicate or clock went back
+
+    // Close the block when the next sample may not fit or it spans too long
+    BlockHeader& h = s->block.header;
+    if (h.bitCount + MAX_SAMPLE_BITS > PAYLOAD_SIZE * 8 || time - h.firstTime > MAX_BLOCK_SPAN) {
+        flush();
+        startBlock(*s, time, value);
+        return;
+    }
+
+    BitWriter w = {s->block.payload, h.bitCount};
+
+    // Timestamp: delta-of-delta
+    int32_t delta = (int32_t)(time - s->prevTime);
+    int32_t dod = delta - s->prevDelta;
+    if (dod == 0) {
+        w.write(0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        w.write(0x2, 2);
+        w.write((uint32_t)(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        w.write(0x6, 3);
+        w.write((uint32_t)(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        w.write(0xE, 4);
+        w.write((uint32_t)(dod + 2047), 12);
+    } else {
+        w.write(0xF, 4);
+        w.write((uint32_t)dod, 32);
+    }
+    s->prevDelta = delta;
+    s->prevTime = time;
+
+    // Value: XOR with the previous one, reusing the previous leading/trailing window if it fits
+    uint32_t bits = floatBits(value);
+    uint32_t x = bits ^ s->prevBits;
+    if (x == 0) {
+        w.write(0, 1);
+    } else {
+        uint8_t leading = (uint8_t)__builtin_clz(x);
+        uint8_t trailing = (uint8_t)__builtin_ctz(x);
+        if (leading > 31) leading = 31;
+        w.write(1, 1);
+        if (s->prevLeading != 0xFF && leading >= s->prevLeading && trailing >= s->prevTrailing) {
+            w.write(0, 1);
+            int len = 32 - s->prevLeading - s->prevTrailing;
+            w.write(x >> s->prevTrailing, len);
+        } else {
+            int len = 32 - leading - trailing;
+            w.write(1, 1);
+            w.write(leading, 5);
+            w.write((uint32_t)(len - 1), 6);
+            w.write(x >> trailing, len);
+            s->prevLeading = leading;
+            s->prevTrailing = trailing;
+        }
+    }
+    s->prevBits = bits;
+
+    h.bitCount = (uint16_t)w.pos;
+    h.lastTime = time;
+    h.count++;
+    s->dirty = true;
+}
+
+void HistoryLog::loop() {
+    unsigned long now = millis();
+    if (now - lastCheckpoint < CHECKPOINT_INTERVAL_MS) return;
+    lastCheckpoint = now;
+    flush();
+}
+
+// Rewrite every dirty block at its reserved offset. A new block reserves the
+// slot at the end of the file on its first write.
+bool HistoryLog::flush() {
+    bool anyDirty = false;
+    for (auto& s : streams) anyDirty |= (s.used && s.dirty);
+    if (!anyDirty || !SysLog.isSdMounted()) return false;
+
+    bool exists = SD.exists(path);
+    File f = SD.open(path, exists ? "r+" : FILE_WRITE);
+    if (!f) {
+        SysLog.error("HistoryLog: unable to open history file");
+        return false;
+    }
+
+    for (auto& s : streams) {
+        if (!s.used || !s.dirty) continue;
+        if (s.fileOffset < 0) {
+            size_t size = f.size();
+            s.fileOffset = (int32_t)(size - size % BLOCK_SIZE); // drop a torn tail block
+        }
+        s.block.header.crc = blockCrc(s.block);
+        f.seek(s.fileOffset);
+        if (f.write((const uint8_t*)&s.block, BLOCK_SIZE) != BLOCK_SIZE) {
+            SysLog.error("HistoryLog: block write failed");
+            break;
+        }
+        s.dirty = false;
+    }
+    f.close();
+    return true;
+}
+
+size_t HistoryLog::decodeBlock(const Block& b, uint32_t fromTime, SampleCallback cb, void* ctx) {
+    const BlockHeader& h = b.header;
+    BitReader r = {b.payload, 0, h.bitCount};
+
+    uint32_t bits;
+    if (!r.read(32, bits)) return 0;
+    uint32_t time = h.firstTime;
+    int32_t delta = 0;
+    uint8_t leading = 0, trailing = 0;
+    size_t emitted = 0;
+
+    if (time >= fromTime) { cb(ctx, h.seriesId, time, bitsFloat(bits)); emitted++; }
+
+    for (uint16_t i = 1; i < h.count; i++) {
+        uint32_t v;
+        int32_t dod;
+        if (!r.read(1, v)) return emitted;
+        if (v == 0) {
+            dod = 0;
+        } else {
+            if (!r.read(1, v)) return emitted;
+            if (v == 0) { if (!r.read(7, v)) return emitted; dod = (int32_t)v - 63; }
+            else {
+                if (!r.read(1, v)) return emitted;
+                if (v == 0) { if (!r.read(9, v)) return emitted; dod = (int32_t)v - 255; }
+                else {
+                    if (!r.read(1, v)) return emitted;
+                    if (v == 0) { if (!r.read(12, v)) return emitted; dod = (int32_t)v - 2047; }
+                    else { if (!r.read(32, v)) return emitted; dod = (int32_t)v; }
+                }
+            }
+        }
+        delta += dod;
+        time += delta;
+
+        if (!r.read(1, v)) return emitted;
+        if (v == 1) {
+            uint32_t ctrl, x;
+            if (!r.read(1, ctrl)) return emitted;
+            if (ctrl == 1) {
+                uint32_t l, len;
+                if (!r.read(5, l) || !r.read(6, len)) return emitted;
+                leading = (uint8_t)l;
+                trailing = (uint8_t)(32 - leading - (len + 1));
+            }
+            int len = 32 - leading - trailing;
+            if (!r.read(len, x)) return emitted;
+            bits ^= (x << trailing);
+        }
+
+        if (time >= fromTime) { cb(ctx, h.seriesId, time, bitsFloat(bits)); emitted++; }
+    }
+    return emitted;
+}
+
+size_t HistoryLog::load(uint32_t windowSec, SampleCallback cb, void* ctx) {
+    if (!SysLog.isSdMounted() || !SD.exists(path)) return 0;
+    File f = SD.open(path, FILE_READ);
+    if (!f) return 0;
+
+    unsigned long t0 = millis();
+    int32_t blocks = (int32_t)(f.size() / BLOCK_SIZE);
+
+    // Pass 1: walk headers backwards. Blocks are reserved in start-time order and
+    // never span more than MAX_BLOCK_SPAN, so we can stop once a block starts
+    // that far before the window.
+    std::vector<int32_t> wanted;
+    uint32_t newest = 0;
+    BlockHeader h;
+    for (int32_t i = blocks - 1; i >= 0; i--) {
+        f.seek((uint32_t)i * BLOCK_SIZE);
+        if (f.read((uint8_t*)&h, sizeof(h)) != sizeof(h) || h.magic != HISTORY_MAGIC) continue;
+        if (h.lastTime > newest) newest = h.lastTime;
+        uint32_t cutoff = (newest > windowSec) ? newest - windowSec : 0;
+        if (h.firstTime + MAX_BLOCK_SPAN + 3600 < cutoff) break; // slack: slots are reserved at first flush
+        if (h.lastTime >= cutoff) wanted.push_back(i);
+    }
+    uint32_t cutoff = (newest > windowSec) ? newest - windowSec : 0;
+
+    // Pass 2: decode forward so each series replays in order
+    Block* block = new Block;
+    size_t samples = 0;
+    int corrupt = 0;
+    for (auto it = wanted.rbegin(); it != wanted.rend(); ++it) {
+        f.seek((uint32_t)(*it) * BLOCK_SIZE);
+        if (f.read((uint8_t*)block, BLOCK_SIZE) != BLOCK_SIZE || block->header.crc != blockCrc(*block)) {
+            corrupt++;
+            continue;
+        }
+        samples += decodeBlock(*block, cutoff, cb, ctx);
+    }
+    delete block;
+    f.close();
+
+    SysLog.log(String("HistoryLog: loaded ") + String((int)samples) + " samples from " +
+               String((int)wanted.size()) + " blocks in " + String(millis() - t0) + " ms");
+    if (corrupt > 0) {
+        SysLog.error(String("HistoryLog: skipped ") + String(corrupt) + " corrupt block(s)");
+    }
+    return samples;
+}
@@ -0,0 +1,57 @@
+#include "JsonAllocator.h"
+#include "LogManager.h"
+#include <esp_heap_caps.h>
+
+class PsramJsonAllocator : public ArduinoJson::Allocator {
+public:
+    volatile uint32_t fallbacks = 0;
+
+    void* allocate(size_t size) override {
+        void* p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+        if (!p) {
+            p = heap_caps_malloc(size, MALLOC_CAP_DEFAULT);
+            if (p) fallbacks++;
+        }
+        return p;
+    }
+
+    void deallocate(void* p) override {
+        heap_caps_free(p);
+    }
+
+    // shrinkToFit() and pool growth: a block moved to internal RAM stays there
+    // only if PSRAM cannot take it
+    void* reallocate(void* p, size_t size) override {
+        void* r = heap_caps_realloc(p, size, MALLOC_CAP_SPIRAM);
+        if (!r) {
+            r = heap_caps_realloc(p, size, MALLOC_CAP_DEFAULT);
+            if (r) fallbacks++;
+        }
+        return r;
+    }
+};
+
+static PsramJsonAllocator allocator;
+
+ArduinoJson::Allocator* psramJsonAllocator() {
+    return &allocator;
+}
+
+HeapStats readHeapStats() {
+    HeapStats s;
+    s.internalFree = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    s.internalMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    s.internalLargest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    s.fragmentation = s.internalFree ? (uint8_t)(100 - (uint64_t)s.internalLargest * 100 / s.internalFree) : 0;
+    s.psramFree = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    s.jsonFallbacks = allocator.fallbacks;
+    return s;
+}
+
+void logHeapStats(const String& context) {
+    HeapStats s = readHeapStats();
+    SysLog.log(context + " heap: internal " + String(s.internalFree / 1024) + " KB free (min " +
+               String(s.internalMinFree / 1024) + " KB, largest " + String(s.internalLargest / 1024) +
+               " KB, frag " + String(s.fragmentation) + "%), PSRAM " + String(s.psramFree / 1024) +
+               " KB free, JSON fallbacks " + String(s.jsonFallbacks));
+}
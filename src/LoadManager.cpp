@@ -1,92 +1,114 @@
 #include "LoadManager.h"
 
-LoadManager::LoadManager(ShellyManager* mgr, EnergyConfig* cfg) : shellyManager(mgr), config(cfg) {}
+LoadManager::LoadManager(ShellyManager* mgr, DeviceReconciler* rec, EnergyConfig* cfg)
+    : shellyManager(mgr), reconciler(rec), config(cfg) {}
+
+// Slot 0 is the aggregate of the meter group, slot p+1 is meter phase p.
+// Both come from the cached shared poll in ShellyManager, so no HTTP happens here.
+float LoadManager::slotPower(int slot) const {
+    if (slot == 0) return shellyManager->getTotalPower();
+    return shellyManager->getPhasePower(slot - 1);
+}
+
+float LoadManager::slotLimit(int slot) const {
+    if (slot == 0) return config->max_power_w;
+    return config->main_meter_phases[slot - 1].max_power_w;
+}
+
+bool LoadManager::isShed(const String& id) const {
+    for (const auto& sd : shedDevices) {
+        if (sd.id == id) return true;
+    }
+    return false;
+}
+
+// Highest priority active LOAD wired to the overloaded phase. Loads without a phase
+// assignment are only used as a fallback for a phase overload, since shedding them
+// may not relieve it. For the aggregate limit (phase -1) every load qualifies.
+// The load index is ordered on before off, then by priority: the first match wins
+// and the walk stops at the first load that is off. Returns a device slot, -1 if none.
+int LoadManager::pickShedCandidate(int phase) {
+    const DeviceStates& st = shellyManager->getStates();
+    int fallback = -1;
+
+    for (uint16_t i : st.loads) {
+        if (!st.isOn[i] || st.priority[i] <= 0) break;
+        if (isShed(shellyManager->getDeviceAt(i).getId())) continue; // turn-off already requested
+
+        if (phase < 0 || st.phase[i] == phase) return i;
+        if (fallback < 0 && st.phase[i] < 0) fallback = i;
+    }
+    return fallback;
+}
+
+// A shed device comes back only when both the aggregate and its own phase
+// have at least buffer_power_w of headroom.
+bool LoadManager::canRestore(int phase) const {
+    if (slotPower(0) >= (config->max_power_w - config->buffer_power_w)) return false;
+    if (phase >= 0 && phase < (int)config->main_meter_phases.size()) {
+        int slot = phase + 1;
+        if (slotPower(slot) >= (slotLimit(slot) - config->buffer_power_w)) return false;
+    }
+    return true;
+}
 
 void LoadManager::update() {
     unsigned long now = millis();
     if (now - lastCheck < 250) return; // Check every 250ms
     lastCheck = now;
-    
-    float totalPower = shellyManager->getTotalPower(config->main_meter_id);
-    
-    if (totalPower > config->max_power_w) {
-        if (!isOverloaded) {
-            isOverloaded = true;
-            overloadStartTime = now;
+
+    size_t slotCount = 1 + config->main_meter_phases.size();
+    if (limits.size() != slotCount) limits.assign(slotCount, LimitState());
+
+    bool anyOverload = false;
+    for (size_t slot = 0; slot < slotCount; slot++) {
+        LimitState& st = limits[slot];
+
+        if (slotPower(slot) <= slotLimit(slot)) {
+            st.isOverloaded = false;
+            continue;
         }
-        
-        // Alarm
-        if (config->alarm_enabled) {
-            M5.Speaker.tone(config->alarm_freq_hz, 500); // 500ms beep
+
+        anyOverload = true;
+        if (!st.isOverloaded) {
+            st.isOverloaded = true;
+            st.overloadStartTime = now;
         }
-        
+
         // Check delay
-        if (now - overloadStartTime > (config->cut_off_delay_s * 1000)) {
-            // Shed a device
-            ShellyDevice* candidate = nullptr;
-            int maxPrio = -1;
-            
-            auto devices = shellyManager->getAllDevices();
-            for (auto* dev : devices) {
-                if (dev->getRole() == DeviceRole::LOAD && dev->getIsOn() && dev->getPriority() > 0) {
-                    if (dev->getPriority() > maxPrio) {
-                        maxPrio = dev->getPriority();
-                        candidate = dev;
-                    }
-                }
-            }
-            
-            if (candidate) {
-                candidate->turnOff();
-                shedDevices.push_back({candidate->getId(), now});
-                // Reset timer to avoid shedding everything at once? 
-                // Or keep shedding if still overloaded?
-                // Prompt says "If duration > cut_off_delay: Turn OFF active device".
-                // It implies one action. If power stays high, we need to shed another.
-                // So I should reset start time or have a "last shed time".
-                // I'll reset overloadStartTime to give time for power to drop.
-                overloadStartTime = now; 
+        if (now - st.overloadStartTime > (unsigned long)(config->cut_off_delay_s * 1000)) {
+            int phase = (int)slot - 1;
+            int candidate = pickShedCandidate(phase);
+            if (candidate >= 0) {
+                const String& id = shellyManager->getDeviceAt(candidate).getId();
+                // Held off by the reconciler until restored
+                reconciler->setDesiredOn(id, false);
+                shedDevices.push_back({id, phase, now});
+                // Shed one device per cut_off_delay: reset the timer so the meter
+                // can reflect the drop before another device is turned off.
+                st.overloadStartTime = now;
             }
         }
-    } else {
-        isOverloaded = false;
-        
-        // Restore logic
-        if (totalPower < (config->max_power_w - config->buffer_power_w)) {
+    }
+
+    if (anyOverload) {
+        // Alarm
+        if (config->alarm_enabled) {
+            M5.Speaker.tone(config->alarm_freq_hz, 500); // 500ms beep
+        }
+        return;
+    }
+
+    // Restore logic: last shed device first, one device per restore_delay.
+    // After each restore the next device's timer restarts, so power can settle.
+    if (!shedDevices.empty()) {
+        ShedDevice& last = shedDevices.back();
+        if (canRestore(last.phase) && now - last.shedTime > (unsigned long)(config->restore_delay_s * 1000)) {
+            // Released once the device is back on, so manual control works again
+            reconciler->setDesiredOn(last.id, true, true);
+            shedDevices.pop_back();
             if (!shedDevices.empty()) {
-                // Check if we can restore
-                // We need to ensure we don't oscillate.
-                // We restore one device, wait for restore_delay.
-                // The prompt says "Restore devices after restore_delay".
-                // This could mean "Wait X seconds of safe power, then restore".
-                
-                // I'll use the timestamp of the last shed device.
-                // If (now - lastShedTime) > restore_delay, restore.
-                // But we might have multiple shed devices.
-                
-                // Let's look at the last shed device.
-                ShedDevice& last = shedDevices.back();
-                if (now - last.shedTime > (config->restore_delay_s * 1000)) {
-                    // Restore
-                    ShellyDevice* dev = shellyManager->getDevice(last.id);
-                    if (dev) {
-                        dev->turnOn();
-                    }
-                    shedDevices.pop_back();
-                    // Reset time for next restore?
-                    // If we restore one, power goes up. We need to wait again.
-                    // So we should update the shedTime of the *next* device in list to now?
-                    // Or just rely on the loop.
-                    // If we restore, power increases. Next loop, we check power again.
-                    // If still safe, we check next device.
-                    // But we need a delay between restores.
-                    // So I should enforce a delay since LAST ACTION.
-                    // I'll use `overloadStartTime` as `lastActionTime`? No.
-                    // I'll update the shedTime of the remaining devices to now, so they wait another cycle?
-                    if (!shedDevices.empty()) {
-                        shedDevices.back().shedTime = now;
-                    }
-                }
+                shedDevices.back().shedTime = now;
             }
         }
     }
@@ -0,0 +1,363 @@
+#include "LogArchive.h"
+#include <esp_heap_caps.h>
+
+// --- Block codec ---
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// Length continuation bytes (255 = more follow)
+static bool putLength(uint8_t* dst, size_t cap, size_t& o, size_t len) {
+    while (len >= 255) {
+        if (o >= cap) return false;
+        dst[o++] = 255;
+        len -= 255;
+    }
+    if (o >= cap) return false;
+    dst[o++] = (uint8_t)len;
+    return true;
+}
+
+static bool putSequence(uint8_t* dst, size_t cap, size_t& o, const uint8_t* lit, size_t litLen,
+                        uint16_t offset, size_t matchLen) {
+    if (o >= cap) return false;
+    size_t token = o++;
+    dst[token] = (uint8_t)((litLen >= 15 ? 15 : litLen) << 4);
+    if (litLen >= 15 && !putLength(dst, cap, o, litLen - 15)) return false;
+    if (o + litLen > cap) return false;
+    memcpy(dst + o, lit, litLen);
+    o += litLen;
+    if (matchLen == 0) return true; // Last sequence: literals only
+
+    if (o + 2 > cap) return false;
+    dst[o++] = offset & 0xFF;
+    dst[o++] = offset >> 8;
+    size_t ml = matchLen - 4;
+    dst[token] |= (uint8_t)(ml >= 15 ? 15 : ml);
+    if (ml >= 15 && !putLength(dst, cap, o, ml - 15)) return false;
+    return true;
+}
+
+// Greedy LZ77 with a 4-byte hash; 0 if the output would not be smaller than cap
+size_t LogArchive::compressFrame(const uint8_t* src, size_t n, uint8_t* dst, size_t cap, uint16_t* table) {
+    const size_t tableSize = (size_t)1 << HASH_BITS;
+    for (size_t i = 0; i < tableSize; i++) table[i] = 0xFFFF;
+
+    size_t o = 0;
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + 4 <= n) {
+        uint32_t seq = read32(src + i);
+        uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        uint16_t cand = table[h];
+        table[h] = (uint16_t)i;
+        if (cand == 0xFFFF || read32(src + cand) != seq) {
+            i++;
+            continue;
+        }
+        size_t len = 4;
+        while (i + len < n && src[cand + len] == src[i + len]) len++;
+        if (!putSequence(dst, cap, o, src + anchor, i - anchor, (uint16_t)(i - cand), len)) return 0;
+        i += len;
+        anchor = i;
+    }
+    if (!putSequence(dst, cap, o, src + anchor, n - anchor, 0, 0)) return 0;
+    return o;
+}
+
+size_t LogArchive::decompressFrame(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+    size_t ip = 0;
+    size_t op = 0;
+    while (ip < n) {
+        uint8_t token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= n) return 0;
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (ip + lit > n || op + lit > cap) return 0;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip >= n) break; // Last sequence
+
+        if (ip + 2 > n) return 0;
+        size_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        size_t len = token & 15;
+        if (len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= n) return 0;
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += 4;
+        if (offset == 0 || offset > op || op + len > cap) return 0;
+        for (size_t k = 0; k < len; k++, op++) dst[op] = dst[op - offset]; // May overlap
+    }
+    return op;
+}
+
+// --- Generations ---
+
+void LogArchive::setBasePath(const char* path) {
+    if (path == base) return;
+    abortCompression();
+    base = path;
+    cPending = true;
+}
+
+String LogArchive::plainPath(int gen) const {
+    if (gen == 0) return String(base);
+    return String(base) + "." + String(gen);
+}
+
+size_t LogArchive::fileSize(const String& path) {
+    File f = SD.open(path, FILE_READ);
+    if (!f) return 0;
+    size_t s = f.size();
+    f.close();
+    return s;
+}
+
+String LogArchive::generationPath(int gen) {
+    String p = plainPath(gen);
+    if (SD.exists(p)) return p;
+    if (gen > 0 && SD.exists(packedPath(gen))) return packedPath(gen);
+    return String();
+}
+
+int LogArchive::generationCount() {
+    int n = 0;
+    for (int g = 1; g <= MAX_GENERATIONS; g++) {
+        if (generationPath(g).length() > 0) n = g;
+    }
+    return n;
+}
+
+void LogArchive::rotate(size_t budget) {
+    abortCompression();
+    cPending = true;
+
+    SD.remove(plainPath(MAX_GENERATIONS));
+    SD.remove(packedPath(MAX_GENERATIONS));
+    SD.remove(indexPath(MAX_GENERATIONS));
+    for (int g = MAX_GENERATIONS - 1; g >= 0; g--) {
+        if (g > 0 && SD.exists(plainPath(g))) SD.rename(plainPath(g), plainPath(g + 1));
+        if (g > 0 && SD.exists(packedPath(g))) SD.rename(packedPath(g), packedPath(g + 1));
+        if (SD.exists(indexPath(g))) SD.rename(indexPath(g), indexPath(g + 1));
+    }
+    SD.rename(plainPath(0), plainPath(1));
+    enforceBudget(budget);
+}
+
+// Oldest generations go first; the live file is never touched
+void LogArchive::enforceBudget(size_t budget) {
+    size_t sizes[MAX_GENERATIONS + 1];
+    size_t total = 0;
+    for (int g = 0; g <= MAX_GENERATIONS; g++) {
+        String p = generationPath(g);
+        sizes[g] = p.length() > 0 ? fileSize(p) : 0;
+        total += sizes[g];
+    }
+    for (int g = MAX_GENERATIONS; g >= 1 && total > budget; g--) {
+        if (sizes[g] == 0) continue;
+        if (cIn && cGen == g) abortCompression();
+        SD.remove(plainPath(g));
+        SD.remove(packedPath(g));
+        SD.remove(indexPath(g));
+        total -= sizes[g];
+    }
+}
+
+// --- Background compression ---
+
+bool LogArchive::allocBuffers() {
+    if (cRaw) return true;
+    cRaw = (uint8_t*)heap_caps_malloc(FRAME_SIZE, MALLOC_CAP_SPIRAM);
+    cPacked = (uint8_t*)heap_caps_malloc(FRAME_SIZE, MALLOC_CAP_SPIRAM);
+    cTable = (uint16_t*)heap_caps_malloc(sizeof(uint16_t) << HASH_BITS, MALLOC_CAP_SPIRAM);
+    if (!cRaw || !cPacked || !cTable) {
+        heap_caps_free(cRaw);
+        heap_caps_free(cPacked);
+        heap_caps_free(cTable);
+        cRaw = cPacked = nullptr;
+        cTable = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void LogArchive::abortCompression() {
+    if (!cIn && !cOut) return;
+    if (cIn) cIn.close();
+    if (cOut) cOut.close();
+    SD.remove(tempPath(cGen));
+}
+
+void LogArchive::finishCompression() {
+    cIn.close();
+    cOut.close();
+    // The .lz only appears once complete; a plain file next to it is a leftover
+    if (!SD.rename(tempPath(cGen), packedPath(cGen))) {
+        SD.remove(tempPath(cGen));
+        cPending = false;
+        return;
+    }
+    SD.remove(plainPath(cGen));
+}
+
+bool LogArchive::compressStep() {
+    if (!cIn) {
+        if (!cPending) return false;
+        cGen = 0;
+        for (int g = 1; g <= MAX_GENERATIONS; g++) {
+            if (!SD.exists(plainPath(g))) continue;
+            if (SD.exists(packedPath(g))) {
+                SD.remove(plainPath(g)); // Interrupted after the rename
+                continue;
+            }
+            cGen = g;
+            break;
+        }
+        if (cGen == 0) {
+            cPending = false;
+            return false;
+        }
+        if (!allocBuffers()) {
+            cPending = false;
+            return false;
+        }
+        cIn = SD.open(plainPath(cGen), FILE_READ);
+        cOut = SD.open(tempPath(cGen), FILE_WRITE);
+        uint32_t magic = MAGIC;
+        if (!cIn || !cOut || cOut.write((const uint8_t*)&magic, 4) != 4) {
+            abortCompression();
+            cPending = false;
+            return false;
+        }
+    }
+
+    size_t n = cIn.read(cRaw, FRAME_SIZE);
+    if (n == 0) {
+        finishCompression();
+        return true;
+    }
+    size_t c = compressFrame(cRaw, n, cPacked, n - 1, cTable);
+    uint16_t hdr[2] = { (uint16_t)n, (uint16_t)c };
+    bool ok = cOut.write((const uint8_t*)hdr, sizeof(hdr)) == sizeof(hdr);
+    if (ok) ok = c ? cOut.write(cPacked, c) == c : cOut.write(cRaw, n) == n;
+    if (!ok) {
+        abortCompression();
+        cPending = false;
+    }
+    return true;
+}
+
+// --- Reader ---
+
+bool LogArchive::Reader::open(const String& path) {
+    close();
+    file = SD.open(path, FILE_READ);
+    if (!file) return false;
+    uint32_t magic = 0;
+    compressed = file.read((uint8_t*)&magic, 4) == 4 && magic == MAGIC;
+    if (compressed) {
+        frame = (uint8_t*)heap_caps_malloc(FRAME_SIZE, MALLOC_CAP_SPIRAM);
+        packed = (uint8_t*)heap_caps_malloc(FRAME_SIZE, MALLOC_CAP_SPIRAM);
+        if (!frame || !packed) {
+            close();
+            return false;
+        }
+    }
+    return seek(0);
+}
+
+void LogArchive::Reader::close() {
+    if (file) file.close();
+    heap_caps_free(frame);
+    heap_caps_free(packed);
+    frame = packed = nullptr;
+    compressed = false;
+    pos = totalSize = frameStart = frameLen = 0;
+    frameOffset = 4;
+}
+
+size_t LogArchive::Reader::size() {
+    if (!file) return 0;
+    if (!compressed) return file.size();
+    if (totalSize) return totalSize;
+    uint32_t off = 4;
+    uint16_t hdr[2];
+    while (file.seek(off) && file.read((uint8_t*)hdr, sizeof(hdr)) == sizeof(hdr)) {
+        totalSize += hdr[0];
+        off += sizeof(hdr) + (hdr[1] ? hdr[1] : hdr[0]);
+    }
+    return totalSize;
+}
+
+// Walk frame headers (from the current frame when reading forward) and decode the
+// frame containing `target`
+bool LogArchive::Reader::loadFrameAt(size_t target) {
+    size_t start = 0;
+    uint32_t off = 4;
+    if (frameLen > 0 && target >= frameStart + frameLen) {
+        start = frameStart + frameLen;
+        off = frameOffset;
+    }
+    uint16_t hdr[2];
+    for (;;) {
+        if (!file.seek(off) || file.read((uint8_t*)hdr, sizeof(hdr)) != sizeof(hdr)) return false;
+        size_t stored = hdr[1] ? hdr[1] : hdr[0];
+        if (hdr[0] == 0 || hdr[0] > FRAME_SIZE || stored > FRAME_SIZE) return false;
+        uint32_t next = off + sizeof(hdr) + stored;
+        if (target < start + hdr[0]) {
+            uint8_t* dst = hdr[1] ? packed : frame;
+            if (file.read(dst, stored) != stored) return false;
+            if (hdr[1] && decompressFrame(packed, stored, frame, FRAME_SIZE) != hdr[0]) return false;
+            frameStart = start;
+            frameLen = hdr[0];
+            frameOffset = next;
+            return true;
+        }
+        start += hdr[0];
+        off = next;
+    }
+}
+
+bool LogArchive::Reader::seek(size_t p) {
+    if (!file) return false;
+    pos = p;
+    if (!compressed) return file.seek(p);
+    return true;
+}
+
+size_t LogArchive::Reader::read(uint8_t* buf, size_t len) {
+    if (!file) return 0;
+    if (!compressed) {
+        size_t n = file.read(buf, len);
+        pos += n;
+        return n;
+    }
+    size_t done = 0;
+    while (done < len) {
+        if (frameLen == 0 || pos < frameStart || pos >= frameStart + frameLen) {
+            if (!loadFrameAt(pos)) break;
+        }
+        size_t avail = frameStart + frameLen - pos;
+        size_t n = (len - done < avail) ? len - done : avail;
+        memcpy(buf + done, frame + (pos - frameStart), n);
+        done += n;
+        pos += n;
+    }
+    return done;
+}
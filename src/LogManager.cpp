@@ -1,5 +1,8 @@
 #include "LogManager.h"
+#include <esp_heap_caps.h>
 #include <time.h>
+#include <sys/time.h>
+#include <stdarg.h>
 
 LogManager SysLog;
 
@@ -10,6 +13,20 @@ void LogManager::begin() {
     M5.Display.setFont(&fonts::FreeMono12pt7b);
     M5.Display.setTextColor(TFT_WHITE, TFT_BLACK);
     tryRemount();
+
+    // Async SD writer. Without it (allocation failure) writeToSD() falls back to
+    // synchronous open/append/close.
+    _ring = xRingbufferCreateWithCaps(RING_SIZE, RINGBUF_TYPE_BYTEBUF, MALLOC_CAP_SPIRAM);
+    _block = (uint8_t*)heap_caps_malloc(BLOCK_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA);
+    if (!_ring || !_block) {
+        Serial.println("LogManager: async SD writer unavailable, using direct writes");
+        return;
+    }
+    // Lowest priority: only runs when the control and UI loops are idle
+    if (xTaskCreatePinnedToCore(writerTask, "LogWriter", 6144, this, 0, &_writerHandle, 1) != pdPASS) {
+        Serial.println("LogManager: failed to create writer task");
+        _writerHandle = nullptr;
+    }
 }
 
 void LogManager::setSdPins(int cs, int sck, int mosi, int miso) {
@@ -29,6 +46,7 @@ bool LogManager::tryRemount() {
         ok = SD.begin();
     }
     _sdMounted = ok;
+    if (ok) _reopen = true;
     return ok;
 }
 
@@ -40,6 +58,18 @@ void LogManager::setLogLevel(int numericLevel) {
     SysLog.log("Config Loaded, Log Level Set to " + String(int(_level)));
 }
 
+static const char* logFileFor(bool binary) {
+    return binary ? "/system.blg" : "/system.log";
+}
+
+// The file itself is switched by the writer task on its next reopen
+void LogManager::setBinaryFormat(bool enabled) {
+    if (enabled == _binary) return;
+    _binary = enabled;
+    _generation++;
+    _reopen = true;
+}
+
 String LogManager::makeTimestamp() {
     time_t now = time(nullptr);
     char buf[32];
@@ -57,11 +87,20 @@ String LogManager::makeTimestamp() {
 void LogManager::emit(Level lvl, const String& prefix, const String& msg, uint16_t color) {
     // Emit only if message level <= current configured level
     if (lvl > _level) return;
+    if (netTextEnabled() && netAllow()) netEnqueue(lvl, false, (const uint8_t*)msg.c_str(), msg.length());
+
+    if (_binary) {
+        uint8_t rec[REC_MAX];
+        writeRecord(rec, encodeText(rec, lvl, msg.c_str()));
+        if (_screenLogging) printToScreen(makeTimestamp() + prefix + msg, color);
+        return;
+    }
 
     String fullMsg = makeTimestamp() + prefix + msg;
     Serial.println(fullMsg);
     if (_screenLogging) printToScreen(fullMsg, color);
-    if (_sdMounted) writeToSD(fullMsg);
+    fullMsg += "\r\n";
+    sdWrite((const uint8_t*)fullMsg.c_str(), fullMsg.length());
 }
 
 void LogManager::log(const String& msg) {
@@ -76,12 +115,328 @@ void LogManager::debug(const String& msg) {
     emit(DEBUG, " [DBG]: ", msg, TFT_CYAN);
 }
 
+// FNV-1a: ids depend only on the text, so they stay valid across firmware builds
+static uint32_t fnv1a(const char* s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Little endian append; false (and nothing written) once the record is full
+static bool putArg(uint8_t* out, size_t cap, size_t& n, const void* v, size_t size) {
+    if (n + size > cap) return false;
+    memcpy(out + n, v, size);  // ESP32 is little endian
+    n += size;
+    return true;
+}
+
+static bool putInt(uint8_t* out, size_t cap, size_t& n, int64_t v, bool wide) {
+    if (wide) return putArg(out, cap, n, &v, 8);
+    int32_t v32 = (int32_t)v;
+    return putArg(out, cap, n, &v32, 4);
+}
+
+// Copies the variadic arguments in the order and width the format string implies.
+// Arguments that no longer fit are left out, the decoder prints them as '?'.
+static size_t packArgs(uint8_t* out, size_t cap, const char* fmt, va_list args) {
+    size_t n = 0;
+    for (const char* p = fmt; *p; p++) {
+        if (*p != '%') continue;
+        if (*++p == '%') continue;
+        while (*p && strchr("-+ #0", *p)) p++;
+        if (*p == '*') {
+            if (!putInt(out, cap, n, va_arg(args, int), false)) return n;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                if (!putInt(out, cap, n, va_arg(args, int), false)) return n;
+                p++;
+            }
+            while (*p >= '0' && *p <= '9') p++;
+        }
+
+        char len = 0;
+        if (*p == 'h') { p++; if (*p == 'h') p++; }
+        else if (*p == 'l') { p++; len = 'l'; if (*p == 'l') { p++; len = 'q'; } }
+        else if (*p == 'j' || *p == 'z' || *p == 't' || *p == 'L') len = *p++;
+
+        bool ok = true;
+        switch (*p) {
+            case 'd': case 'i':
+                if (len == 'q') ok = putInt(out, cap, n, va_arg(args, long long), true);
+                else if (len == 'j') ok = putInt(out, cap, n, va_arg(args, intmax_t), true);
+                else if (len == 'l') ok = putInt(out, cap, n, va_arg(args, long), false);
+                else if (len == 'z') ok = putInt(out, cap, n, (int64_t)va_arg(args, size_t), false);
+                else if (len == 't') ok = putInt(out, cap, n, va_arg(args, ptrdiff_t), false);
+                else ok = putInt(out, cap, n, va_arg(args, int), false);
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                if (len == 'q') ok = putInt(out, cap, n, (int64_t)va_arg(args, unsigned long long), true);
+                else if (len == 'j') ok = putInt(out, cap, n, (int64_t)va_arg(args, uintmax_t), true);
+                else if (len == 'l') ok = putInt(out, cap, n, (int64_t)va_arg(args, unsigned long), false);
+                else if (len == 'z') ok = putInt(out, cap, n, (int64_t)va_arg(args, size_t), false);
+                else if (len == 't') ok = putInt(out, cap, n, va_arg(args, ptrdiff_t), false);
+                else ok = putInt(out, cap, n, (int64_t)va_arg(args, unsigned int), false);
+                break;
+            case 'c':
+                ok = putInt(out, cap, n, va_arg(args, int), false);
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+                float f = (len == 'L') ? (float)va_arg(args, long double) : (float)va_arg(args, double);
+                ok = putArg(out, cap, n, &f, 4);
+                break;
+            }
+            case 's': {
+                const char* str = va_arg(args, const char*);
+                if (!str) str = "(null)";
+                size_t sl = strlen(str);
+                if (sl > 255) sl = 255;
+                if (n + 1 + sl > cap) return n;
+                out[n++] = (uint8_t)sl;
+                memcpy(out + n, str, sl);
+                n += sl;
+                break;
+            }
+            case 'p': {
+                uint32_t v = (uint32_t)(uintptr_t)va_arg(args, void*);
+                ok = putArg(out, cap, n, &v, 4);
+                break;
+            }
+            case 'n':
+                (void)va_arg(args, int*);
+                break;
+            default:
+                return n;  // Unknown conversion or end of string: stop
+        }
+        if (!ok) return n;
+    }
+    return n;
+}
+
+void LogManager::logf(Level lvl, const char* file, const char* fmt, ...) {
+    if (lvl > _level) return;
+
+    const char* prefix = " [INF]: ";
+    uint16_t color = TFT_WHITE;
+    if (lvl == ERROR) { prefix = " [ERR]: "; color = TFT_RED; }
+    else if (lvl == DEBUG) { prefix = " [DBG]: "; color = TFT_CYAN; }
+
+    va_list args;
+    char buf[256];
+    bool formatted = false;
+    if (_binary) {
+        // Nothing is formatted for SD/Serial: the arguments are copied as they are
+        uint32_t id;
+        uint16_t source;
+        bool define;
+        uint8_t rec[REC_MAX];
+        if (lookupFormat(file, fmt, id, source, define)) {
+            if (define) {
+                FormatSlot fs = { fmt, file, id, source, 0 };
+                size_t len = encodeFormat(rec, fs);
+                Serial.write(rec, len);
+            }
+            size_t n = beginEvent(rec, lvl, source, id);
+            va_start(args, fmt);
+            n += packArgs(rec + n, REC_MAX - n, fmt, args);
+            va_end(args);
+            writeRecord(rec, endRecord(rec, n));
+        } else {
+            // Format table full: this site is logged as plain text
+            va_start(args, fmt);
+            vsnprintf(buf, sizeof(buf), fmt, args);
+            va_end(args);
+            formatted = true;
+            writeRecord(rec, encodeText(rec, lvl, buf));
+        }
+        if (!_screenLogging && !netTextEnabled()) return;
+    }
+
+    if (!formatted) {
+        va_start(args, fmt);
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+    }
+
+    if (!_binary) {
+        emit(lvl, prefix, buf, color);
+        return;
+    }
+    if (netTextEnabled() && netAllow()) netEnqueue(lvl, false, (const uint8_t*)buf, strlen(buf));
+    if (_screenLogging) printToScreen(makeTimestamp() + prefix + buf, color);
+}
+
+// Registers the call site's format; the SD writer defines it from the table. false
+// if the table is full. define: first use in this generation, for Serial.
+bool LogManager::lookupFormat(const char* file, const char* fmt, uint32_t& id, uint16_t& source, bool& define) {
+    size_t slot = ((uintptr_t)fmt >> 2) % FORMAT_SLOTS;
+    uint32_t gen = _generation;
+    bool found = false;
+    portENTER_CRITICAL(&_formatLock);
+    for (size_t i = 0; i < FORMAT_SLOTS; i++) {
+        FormatSlot& fs = _formats[(slot + i) % FORMAT_SLOTS];
+        if (fs.fmt == fmt) {
+            id = fs.id;
+            source = fs.source;
+            define = fs.generation != gen;
+            fs.generation = gen;
+            portEXIT_CRITICAL(&_formatLock);
+            return true;
+        }
+        if (!fs.fmt) {
+            slot = (slot + i) % FORMAT_SLOTS;
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_formatLock);
+    if (!found) return false;
+
+    const char* base = strrchr(file, '/');
+    id = fnv1a(fmt);
+    if (id == 0) id = 1;  // 0 is reserved for plain text
+    source = (uint16_t)fnv1a(base ? base + 1 : file);
+    define = true;
+
+    // Another task may have taken the slot meanwhile: same site is fine, else give up
+    portENTER_CRITICAL(&_formatLock);
+    FormatSlot& fs = _formats[slot];
+    bool ok = fs.fmt == fmt;
+    if (!fs.fmt) {
+        fs.fmt = fmt;
+        fs.file = file;
+        fs.id = id;
+        fs.source = source;
+        fs.generation = gen;
+        _formatOrder[_formatCount++] = (uint8_t)slot;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&_formatLock);
+    return ok;
+}
+
+size_t LogManager::encodeFormat(uint8_t* rec, const FormatSlot& fs) {
+    size_t n = beginRecord(rec, REC_FORMAT);
+    const char* base = strrchr(fs.file, '/');
+    base = base ? base + 1 : fs.file;
+    size_t fileLen = strlen(base);
+    if (fileLen > 255) fileLen = 255;
+    size_t fmtLen = strlen(fs.fmt);
+    if (n + 7 + fileLen + fmtLen > REC_MAX) fmtLen = REC_MAX - n - 7 - fileLen;
+    memcpy(rec + n, &fs.id, 4);
+    memcpy(rec + n + 4, &fs.source, 2);
+    rec[n + 6] = (uint8_t)fileLen;
+    memcpy(rec + n + 7, base, fileLen);
+    memcpy(rec + n + 7 + fileLen, fs.fmt, fmtLen);
+    return endRecord(rec, n + 7 + fileLen + fmtLen);
+}
+
+// Definitions registered since the last call, into the staging block or straight into
+// `direct`; returns the bytes written to `direct`. Every event is registered before it
+// is queued, so its definition lands ahead of it whatever the ring dropped.
+size_t LogManager::defineFormats(File* direct) {
+    if (!_fileBinary) return 0;
+    uint8_t rec[REC_MAX];
+    size_t written = 0;
+    for (;;) {
+        FormatSlot fs;
+        portENTER_CRITICAL(&_formatLock);
+        bool pending = _fileDefined < _formatCount;
+        if (pending) fs = _formats[_formatOrder[_fileDefined]];
+        portEXIT_CRITICAL(&_formatLock);
+        if (!pending) return written;
+        _fileDefined++;
+        size_t len = encodeFormat(rec, fs);
+        if (direct) written += direct->write(rec, len);
+        else writerWrite(rec, len);
+    }
+}
+
+size_t LogManager::beginRecord(uint8_t* rec, uint8_t type) {
+    rec[0] = REC_SYNC;
+    rec[1] = type;
+    return 4;
+}
+
+size_t LogManager::endRecord(uint8_t* rec, size_t len) {
+    uint16_t payload = (uint16_t)(len - 4);
+    memcpy(rec + 2, &payload, 2);
+    return len;
+}
+
+size_t LogManager::beginEvent(uint8_t* rec, Level lvl, uint16_t source, uint32_t fmtId) {
+    size_t n = beginRecord(rec, REC_EVENT);
+    uint8_t level = (uint8_t)lvl;
+    uint32_t sec;
+    uint16_t ms;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if (tv.tv_sec > 1609459200) { // Same validity threshold as makeTimestamp()
+        sec = (uint32_t)tv.tv_sec;
+        ms = (uint16_t)(tv.tv_usec / 1000);
+    } else {
+        uint32_t now = millis();
+        sec = now / 1000;
+        ms = now % 1000;
+        level |= LEVEL_UPTIME;
+    }
+    memcpy(rec + n, &sec, 4);
+    memcpy(rec + n + 4, &ms, 2);
+    rec[n + 6] = level;
+    memcpy(rec + n + 7, &source, 2);
+    memcpy(rec + n + 9, &fmtId, 4);
+    return n + 13;
+}
+
+size_t LogManager::encodeText(uint8_t* rec, Level lvl, const char* text) {
+    size_t n = beginEvent(rec, lvl, 0, 0);
+    size_t len = strlen(text);
+    if (n + len > REC_MAX) len = REC_MAX - n;  // Long lines are truncated rather than allocated
+    memcpy(rec + n, text, len);
+    return endRecord(rec, n + len);
+}
+
+// Writer-side marker (rotation, dropped lines) in the current file format
+size_t LogManager::encodeNote(uint8_t* out, const char* text) {
+    if (_fileBinary) return encodeText(out, INFO, text);
+    size_t len = strlen(text);
+    if (len + 2 > REC_MAX) len = REC_MAX - 2;
+    memcpy(out, text, len);
+    out[len++] = '\r';
+    out[len++] = '\n';
+    return len;
+}
+
+void LogManager::writeRecord(const uint8_t* rec, size_t len) {
+    Serial.write(rec, len);
+    sdWrite(rec, len);
+    if (netRecordsEnabled() && netAllow()) netEnqueue((Level)(rec[10] & 0x7F), true, rec, len);
+}
+
+void LogManager::sdWrite(const uint8_t* data, size_t len) {
+    if (!_sdMounted) return;
+    if (_writerHandle) enqueueToSD(data, len);
+    else writeToSD(data, len);
+}
+
 void LogManager::printToScreen(const String& line, uint16_t color) {
     M5.Display.setTextColor(color, TFT_BLACK);
     M5.Display.println(line);
 }
 
-void LogManager::writeToSD(const String& line) {
+void LogManager::writeToSD(const uint8_t* data, size_t len) {
+    if (_reopen) {
+        _reopen = false;  // Remounted or switched format: pick the file, define everything again
+        _fileBinary = _binary;
+        _logPath = logFileFor(_fileBinary);
+        _fileDefined = 0;
+    }
     File f = SD.open(_logPath, FILE_APPEND);
     if (!f) {
         _sdMounted = false;
@@ -89,32 +444,405 @@ void LogManager::writeToSD(const String& line) {
     }
     if (f.size() > _maxLogSize) {
         f.close();
-        SD.remove(_logPath);
+        _archive.setBasePath(_logPath);
+        _archive.rotate(_maxDiskBytes);
+        _generation++;
+        _fileDefined = 0;
         f = SD.open(_logPath, FILE_WRITE);
-        if (f) f.println("--- Log Rotated ---");
+        if (f) {
+            uint8_t note[REC_MAX];
+            f.write(note, encodeNote(note, "--- Log Rotated ---"));
+        }
     }
     if (f) {
-        f.println(line);
+        defineFormats(&f);
+        f.write(data, len);
         f.close();
     }
 }
 
+// Non-blocking: the bytes are copied into the PSRAM ring or dropped and counted
+void LogManager::enqueueToSD(const uint8_t* data, size_t len) {
+    if (xRingbufferSend(_ring, data, len, 0) != pdTRUE) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void LogManager::writerTask(void* param) {
+    ((LogManager*)param)->writerLoop();
+}
+
+bool LogManager::writerOpen() {
+    if (_file) _file.close();
+    _fileBinary = _binary;
+    _logPath = logFileFor(_fileBinary);
+    _archive.setBasePath(_logPath);
+    _file = SD.open(_logPath, FILE_APPEND);
+    if (!_file) return false;
+    _fileSize = _file.size();
+    return true;
+}
+
+// Append to the staging block; a full block goes to SD in one write. The first
+// block after open is shortened so later writes start on a BLOCK_SIZE boundary.
+void LogManager::writerWrite(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        if (_blockLen == 0) _blockSince = millis();
+        size_t room = BLOCK_SIZE - ((_fileSize + _blockLen) % BLOCK_SIZE);
+        size_t n = (len < room) ? len : room;
+        memcpy(_block + _blockLen, data, n);
+        _blockLen += n;
+        data += n;
+        len -= n;
+        if ((_fileSize + _blockLen) % BLOCK_SIZE == 0) writerFlush();
+    }
+}
+
+void LogManager::writerFlush() {
+    if (_blockLen == 0) return;
+    // A file opened here gets every known definition ahead of the staged block, which
+    // may hold events whose definitions went to the previous file
+    if (!_file || _reopen) {
+        _reopen = false;
+        if (!_sdMounted || !writerOpen()) {
+            _blockLen = 0;  // No card: lines are lost, like the synchronous path
+            return;
+        }
+        _fileDefined = 0;
+        _fileSize += defineFormats(&_file);
+    }
+
+    if (_fileSize > _maxLogSize) {
+        _file.close();
+        _archive.rotate(_maxDiskBytes);
+        _generation++;
+        _file = SD.open(_logPath, FILE_WRITE);
+        _fileSize = 0;
+        if (_file) {
+            uint8_t note[REC_MAX];
+            _fileSize += _file.write(note, encodeNote(note, "--- Log Rotated ---"));
+            _fileDefined = 0;
+            _fileSize += defineFormats(&_file);
+        }
+    }
+
+    if (!_file || _file.write(_block, _blockLen) != _blockLen) {
+        _sdMounted = false;
+        if (_file) _file.close();
+        _blockLen = 0;
+        return;
+    }
+    _file.flush();
+    _fileSize += _blockLen;
+    _blockLen = 0;
+}
+
+void LogManager::writerLoop() {
+    bool compressing = true;  // Picks up generations left uncompressed by a reboot
+    for (;;) {
+        size_t len = 0;
+        TickType_t wait = compressing ? 1 : pdMS_TO_TICKS(250);
+        uint8_t* data = (uint8_t*)xRingbufferReceiveUpTo(_ring, &len, wait, BLOCK_SIZE);
+        if (data) {
+            defineFormats(nullptr);
+            writerWrite(data, len);
+            vRingbufferReturnItem(_ring, data);
+        } else if (_compressRotated && _sdMounted) {
+            // Idle: one frame at a time, so new lines never wait behind a whole file
+            compressing = _archive.compressStep();
+        } else {
+            compressing = false;
+        }
+
+        if (_dropped != _droppedReported) {
+            uint32_t dropped = _dropped;
+            String text = "--- " + String(dropped - _droppedReported) + " log line(s) dropped ---";
+            _droppedReported = dropped;
+            uint8_t note[REC_MAX];
+            writerWrite(note, encodeNote(note, text.c_str()));
+        }
+
+        // Time threshold: don't keep a partial block around for long
+        if (_blockLen > 0 && millis() - _blockSince >= FLUSH_INTERVAL_MS) writerFlush();
+    }
+}
+
+// Tail of the log, continuing into older generations when the live file is short.
+// Only the bytes shown are read (and decompressed).
 String LogManager::getLogContent() {
     if (!_sdMounted) return "SD Not Mounted";
+    if (_binary) return String("Binary log ") + _logPath + ": decode with tools/logdecode.py";
 
-    File f = SD.open(_logPath, FILE_READ);
-    if (!f) return "Log file not found";
-
-    String content;
-    size_t size = f.size();
     const size_t readSize = 2048;
-    if (size > readSize) {
-        f.seek(size - readSize);
-        content = "...[truncated]...\n";
-    }
-    while (f.available()) {
-        content += (char)f.read();
+    String content;
+    size_t need = readSize;
+    bool truncated = false;
+    bool found = false;
+    for (int gen = 0; gen <= LogArchive::MAX_GENERATIONS; gen++) {
+        String path = _archive.generationPath(gen);
+        if (path.length() == 0) continue;
+        found = true;
+        if (need == 0) {
+            truncated = true;
+            break;
+        }
+
+        LogArchive::Reader reader;
+        if (!reader.open(path)) break;
+        size_t size = reader.size();
+        size_t n = (size < need) ? size : need;
+        if (size > n) truncated = true;
+        reader.seek(size - n);
+
+        String piece;
+        uint8_t buf[256];
+        size_t left = n;
+        while (left > 0) {
+            size_t got = reader.read(buf, (left < sizeof(buf)) ? left : sizeof(buf));
+            if (got == 0) break;
+            for (size_t i = 0; i < got; i++) piece += (char)buf[i];
+            left -= got;
+        }
+        content = piece + content;
+        need -= n;
+        if (truncated) break;
     }
-    f.close();
+    if (!found) return "Log file not found";
+    if (truncated) content = "...[truncated]...\n" + content;
     return content;
 }
+
+// --- Network sink ---
+
+// Any task: the network task applies the new host and port itself (see netLoop())
+void LogManager::setNetworkSink(const String& host, uint16_t port, bool binary, uint16_t maxLinesPerSec) {
+    char next[sizeof(_netHostNext)];
+    snprintf(next, sizeof(next), "%s", host.c_str());
+    uint32_t now = millis();
+    // Settings are applied again on every config change: only a new target makes
+    // the task resolve the host and resend the record formats
+    portENTER_CRITICAL(&_netLock);
+    bool retarget = strcmp(next, _netHostNext) != 0 || port != _netPortNext || binary != _netBinary;
+    bool changed = retarget || maxLinesPerSec != _netRate;
+    if (changed) {
+        memcpy(_netHostNext, next, sizeof(next));
+        _netPortNext = port;
+        _netBinary = binary;
+        _netOn = next[0] != '\0';
+        _netRate = maxLinesPerSec;
+        _netTokens = (uint32_t)maxLinesPerSec * 2000;
+        _netRefill = now;
+        if (retarget) _netChanged = true;
+    }
+    portEXIT_CRITICAL(&_netLock);
+
+    if (!_netOn || _netHandle) return;
+    _netRing = xRingbufferCreateWithCaps(NET_RING_SIZE, RINGBUF_TYPE_NOSPLIT, MALLOC_CAP_SPIRAM);
+    if (!_netRing) {
+        Serial.println("LogManager: network sink unavailable");
+        return;
+    }
+    if (xTaskCreatePinnedToCore(netTask, "LogNet", 8192, this, 0, &_netHandle, 1) != pdPASS) {
+        Serial.println("LogManager: failed to create network task");
+        _netHandle = nullptr;
+    }
+}
+
+// Token bucket shared by all logging tasks; 0 lines/s = unlimited
+bool LogManager::netAllow() {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&_netLock);
+    if (_netRate == 0) {
+        portEXIT_CRITICAL(&_netLock);
+        return true;
+    }
+    uint32_t cap = (uint32_t)_netRate * 2000;
+    uint64_t tokens = _netTokens + (uint64_t)(now - _netRefill) * _netRate;
+    _netTokens = tokens > cap ? cap : (uint32_t)tokens;
+    _netRefill = now;
+    bool ok = _netTokens >= 1000;
+    if (ok) _netTokens -= 1000;
+    portEXIT_CRITICAL(&_netLock);
+    if (!ok) _netLimited.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
+
+// Non-blocking: reserves the item in the queue and fills it in place
+void LogManager::netEnqueue(Level lvl, bool binary, const uint8_t* data, size_t len) {
+    const size_t maxText = NET_DATAGRAM_MAX - 128;  // Room for the syslog header
+    if (len > maxText) len = maxText;
+    void* slot = nullptr;
+    if (xRingbufferSendAcquire(_netRing, &slot, sizeof(NetItem) + len, 0) != pdTRUE) {
+        _netDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    NetItem* item = (NetItem*)slot;
+    item->level = (uint8_t)lvl;
+    item->binary = binary;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if (tv.tv_sec > 1609459200) {
+        item->sec = (uint32_t)tv.tv_sec;
+        item->ms = (uint16_t)(tv.tv_usec / 1000);
+    } else {
+        uint32_t now = millis();
+        item->sec = now / 1000;
+        item->ms = now % 1000;
+        item->level |= LEVEL_UPTIME;
+    }
+    memcpy(item + 1, data, len);
+    xRingbufferSendComplete(_netRing, slot);
+}
+
+void LogManager::netTask(void* param) {
+    ((LogManager*)param)->netLoop();
+}
+
+bool LogManager::netResolve() {
+    if (_netResolved) return true;
+    if (_netResolveAt != 0 && millis() - _netResolveAt < NET_RESOLVE_RETRY_MS) return false;
+    _netResolveAt = millis();
+    IPAddress ip;
+    if (!ip.fromString(_netHost) && !WiFi.hostByName(_netHost, ip)) return false;
+    _netIp = ip;
+    _netResolved = true;
+    snprintf(_netSelf, sizeof(_netSelf), "%s", WiFi.localIP().toString().c_str());
+    return true;
+}
+
+void LogManager::netSend(const uint8_t* data, size_t len) {
+    if (!_udp.beginPacket(_netIp, _netPort) || _udp.write(data, len) != len || !_udp.endPacket()) {
+        _netDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Appends a binary record to the datagram, sending it first if the record does not fit
+void LogManager::netPack(uint8_t* datagram, size_t& used, uint32_t& since, const uint8_t* data, size_t len) {
+    if (used + len > NET_DATAGRAM_MAX) {
+        netSend(datagram, used);
+        used = 0;
+    }
+    if (used == 0) since = millis();
+    memcpy(datagram + used, data, len);
+    used += len;
+}
+
+// Definitions not sent to the collector yet, ahead of the next record. Like the SD
+// writer they come from the format table, never through the queue, so a full queue
+// cannot lose one; netLoop() starts over periodically and after a drop.
+void LogManager::netDefine(uint8_t* datagram, size_t& used, uint32_t& since) {
+    uint8_t rec[REC_MAX];
+    for (;;) {
+        FormatSlot fs;
+        portENTER_CRITICAL(&_formatLock);
+        bool pending = _netDefined < _formatCount;
+        if (pending) fs = _formats[_formatOrder[_netDefined]];
+        portEXIT_CRITICAL(&_formatLock);
+        if (!pending) return;
+        _netDefined++;
+        netPack(datagram, used, since, rec, encodeFormat(rec, fs));
+    }
+}
+
+// RFC 5424: <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA MSG
+size_t LogManager::formatSyslog(char* out, size_t cap, const NetItem& item, const char* text, size_t len,
+                                const char* sd) {
+    static const uint8_t severity[] = { 6, 3, 7 };  // INFO=informational, ERROR=error, DEBUG=debug
+    uint8_t lvl = item.level & 0x7F;
+    int pri = 16 * 8 + severity[lvl <= DEBUG ? lvl : 0];  // Facility local0
+
+    char ts[32] = "-";  // Clock not set: NILVALUE
+    if (!(item.level & LEVEL_UPTIME)) {
+        time_t t = item.sec;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        size_t n = strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+        snprintf(ts + n, sizeof(ts) - n, ".%03uZ", (unsigned)item.ms);
+    }
+    int n = snprintf(out, cap, "<%d>1 %s %s HomeAIO - - %s ", pri, ts, _netSelf, sd);
+    if (n < 0) return 0;
+    if ((size_t)n >= cap) return cap - 1;
+    if (len > cap - n) len = cap - n;
+    memcpy(out + n, text, len);
+    return n + len;
+}
+
+// Records are held in the queue while Wi-Fi is down; once it is full the callers
+// drop and count. Binary records are packed into datagrams of up to NET_DATAGRAM_MAX
+// bytes and sent when full or NET_BATCH_MS after the first one. UDP can lose any of
+// them and a collector can start late, so the format definitions are sent again every
+// NET_DEFINE_INTERVAL_MS, after a drop and when the collector changes.
+void LogManager::netLoop() {
+    uint8_t datagram[NET_DATAGRAM_MAX];
+    size_t used = 0;
+    uint32_t since = 0;
+    uint32_t definedAt = millis();
+    uint32_t reportedDropped = 0;
+    uint32_t reportedLimited = 0;
+    for (;;) {
+        if (_netChanged) {
+            _netChanged = false;
+            portENTER_CRITICAL(&_netLock);
+            memcpy(_netHost, _netHostNext, sizeof(_netHost));
+            _netPort = _netPortNext;
+            portEXIT_CRITICAL(&_netLock);
+            _netResolved = false;
+            _netResolveAt = 0;
+            _netDefined = 0;
+        }
+        if (!_netHost[0] || WiFi.status() != WL_CONNECTED || !netResolve()) {
+            vTaskDelay(pdMS_TO_TICKS(500));
+            continue;
+        }
+
+        uint32_t wait = NET_BATCH_MS;
+        if (used > 0) {
+            uint32_t age = millis() - since;
+            wait = age < NET_BATCH_MS ? NET_BATCH_MS - age : 0;
+        }
+        size_t len = 0;
+        uint8_t* data = (uint8_t*)xRingbufferReceive(_netRing, &len, pdMS_TO_TICKS(wait));
+        if (data) {
+            const NetItem* item = (const NetItem*)data;
+            const uint8_t* payload = data + sizeof(NetItem);
+            size_t plen = len - sizeof(NetItem);
+
+            uint32_t dropped = _netDropped;
+            uint32_t limited = _netLimited;
+            bool report = dropped != reportedDropped || limited != reportedLimited;
+
+            if (item->binary) {
+                if (dropped != reportedDropped || millis() - definedAt >= NET_DEFINE_INTERVAL_MS) {
+                    _netDefined = 0;
+                    definedAt = millis();
+                }
+                netDefine(datagram, used, since);
+                if (report) {
+                    uint8_t note[REC_MAX];
+                    char text[96];
+                    snprintf(text, sizeof(text), "--- %lu line(s) not sent, %lu over the rate limit ---",
+                             (unsigned long)(dropped - reportedDropped), (unsigned long)(limited - reportedLimited));
+                    netPack(datagram, used, since, note, encodeText(note, ERROR, text));
+                }
+                netPack(datagram, used, since, payload, plen);
+            } else {
+                char sd[80] = "-";
+                if (report) {
+                    snprintf(sd, sizeof(sd), "[drop@32473 queue=\"%lu\" rate=\"%lu\"]",
+                             (unsigned long)(dropped - reportedDropped), (unsigned long)(limited - reportedLimited));
+                }
+                char line[NET_DATAGRAM_MAX];
+                netSend((const uint8_t*)line, formatSyslog(line, sizeof(line), *item, (const char*)payload, plen, sd));
+            }
+            if (report) {
+                reportedDropped = dropped;
+                reportedLimited = limited;
+            }
+            vRingbufferReturnItem(_netRing, data);
+        }
+        if (used > 0 && millis() - since >= NET_BATCH_MS) {
+            netSend(datagram, used);
+            used = 0;
+        }
+    }
+}
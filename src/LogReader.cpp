@@ -0,0 +1,306 @@
+#include "LogReader.h"
+#include <esp_heap_caps.h>
+#include <esp_rom_crc.h>
+#include <algorithm>
+
+bool LogReader::open(const String& path, const String& indexPath) {
+    close();
+    if (!reader.open(path)) return false;
+    chunk = (uint8_t*)heap_caps_malloc(CHUNK_SIZE, MALLOC_CAP_SPIRAM);
+    if (!chunk) {
+        close();
+        return false;
+    }
+    logPath = path;
+    idxPath = indexPath;
+    headCrc = computeHeadCrc();
+    if (!loadIndex()) {
+        entries.clear();
+        scanned = 0;
+        totalLines = 0;
+        savedClosed = 0;
+    }
+    scan();
+    updateMatches();
+    saveIndex();
+    return true;
+}
+
+void LogReader::close() {
+    reader.close();
+    heap_caps_free(chunk);
+    chunk = nullptr;
+    chunkStart = 0;
+    chunkLen = 0;
+    entries.clear();
+    matches.clear();
+    matchedEntries = 0;
+    scanned = 0;
+    totalLines = 0;
+    savedClosed = 0;
+}
+
+bool LogReader::refresh() {
+    if (!isOpen()) return false;
+    uint32_t before = scanned;
+
+    // A read handle keeps the size it had at open: reopen to see the appended lines
+    if (!reader.open(logPath)) return false;
+    chunkLen = 0;
+    uint32_t crc = computeHeadCrc();
+    if (crc != headCrc) {
+        // Rotated or recreated under us: start over
+        headCrc = crc;
+        entries.clear();
+        matches.clear();
+        matchedEntries = 0;
+        scanned = 0;
+        totalLines = 0;
+        savedClosed = 0;
+        before = UINT32_MAX;
+    }
+    scan();
+    updateMatches();
+    saveIndex();
+    return scanned != before;
+}
+
+uint32_t LogReader::computeHeadCrc() {
+    uint8_t head[HEAD_BYTES];
+    if (!reader.seek(0)) return 0;
+    size_t n = reader.read(head, sizeof(head));
+    return esp_rom_crc32_le(0, head, n);
+}
+
+bool LogReader::loadIndex() {
+    File f = SD.open(idxPath, FILE_READ);
+    if (!f) return false;
+    IndexHeader h;
+    bool ok = f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && h.magic == INDEX_MAGIC &&
+              h.headCrc == headCrc && h.scanned <= reader.size() && h.count > 0;
+    if (ok) {
+        entries.resize(h.count);
+        size_t bytes = h.count * sizeof(IndexEntry);
+        ok = f.read((uint8_t*)entries.data(), bytes) == bytes;
+    }
+    f.close();
+    if (!ok) return false;
+
+    scanned = h.scanned;
+    savedClosed = h.count - 1;
+    totalLines = entries.back().line + entries.back().lines;
+    return true;
+}
+
+// Rewritten only when a span was closed; the open (last) span is rescanned on load anyway
+void LogReader::saveIndex() {
+    size_t closed = entries.empty() ? 0 : entries.size() - 1;
+    if (closed <= savedClosed) return;
+    File f = SD.open(idxPath, FILE_WRITE);
+    if (!f) return;
+    IndexHeader h = { INDEX_MAGIC, headCrc, scanned, (uint32_t)entries.size() };
+    f.write((const uint8_t*)&h, sizeof(h));
+    f.write((const uint8_t*)entries.data(), entries.size() * sizeof(IndexEntry));
+    f.close();
+    savedClosed = closed;
+}
+
+uint32_t LogReader::readLineAt(uint32_t offset, char* buf, size_t& len) {
+    len = 0;
+    uint32_t pos = offset;
+    for (;;) {
+        if (pos < chunkStart || pos >= chunkStart + chunkLen) {
+            if (!reader.seek(pos)) break;
+            chunkStart = pos;
+            chunkLen = reader.read(chunk, CHUNK_SIZE);
+            if (chunkLen == 0) break;
+        }
+        const uint8_t* p = chunk + (pos - chunkStart);
+        size_t avail = chunkStart + chunkLen - pos;
+        const uint8_t* nl = (const uint8_t*)memchr(p, '\n', avail);
+        size_t n = nl ? (size_t)(nl - p) : avail;
+        size_t copy = std::min(n, MAX_LINE - len);
+        memcpy(buf + len, p, copy);
+        len += copy;
+        pos += n;
+        if (nl) {
+            if (len > 0 && buf[len - 1] == '\r') len--;
+            buf[len] = '\0';
+            return pos + 1;
+        }
+    }
+    buf[len] = '\0';
+    return offset; // Incomplete last line: not visible until it is terminated
+}
+
+// Extends the index from the last (still open) span to the end of the data
+void LogReader::scan() {
+    uint32_t offset = 0;
+    totalLines = 0;
+    if (!entries.empty()) {
+        IndexEntry last = entries.back();
+        entries.pop_back();
+        offset = last.offset;
+        totalLines = last.line;
+        if (matchedEntries > entries.size()) {
+            while (!matches.empty() && matches.back() >= last.offset) matches.pop_back();
+            matchedEntries = entries.size();
+        }
+    }
+
+    char buf[MAX_LINE + 1];
+    for (;;) {
+        size_t len;
+        uint32_t next = readLineAt(offset, buf, len);
+        if (next == offset) break;
+        uint32_t t = parseTime(buf, len);
+        bool start = entries.empty() || entries.back().lines >= INDEX_LINES ||
+                     (t != 0 && entries.back().time / 60 != t / 60);
+        if (start) entries.push_back({ offset, totalLines, t, 0, 0, 0 });
+        IndexEntry& e = entries.back();
+        e.lines++;
+        e.levels |= parseLevel(buf, len);
+        totalLines++;
+        offset = next;
+    }
+    scanned = offset;
+}
+
+void LogReader::setLevelMask(uint8_t mask) {
+    mask &= MASK_ALL;
+    if (mask == 0) mask = MASK_ALL;
+    if (mask == levelMask) return;
+    levelMask = mask;
+    matches.clear();
+    matchedEntries = 0;
+    updateMatches();
+}
+
+// Spans without a wanted level are skipped without reading them
+void LogReader::updateMatches() {
+    if (levelMask == MASK_ALL) return;
+    char buf[MAX_LINE + 1];
+    for (; matchedEntries < entries.size(); matchedEntries++) {
+        const IndexEntry& e = entries[matchedEntries];
+        if (!(e.levels & levelMask)) continue;
+        uint32_t offset = e.offset;
+        for (uint16_t i = 0; i < e.lines; i++) {
+            size_t len;
+            uint32_t next = readLineAt(offset, buf, len);
+            if (next == offset) break;
+            if (parseLevel(buf, len) & levelMask) matches.push_back(offset);
+            offset = next;
+        }
+    }
+}
+
+size_t LogReader::entryForLine(uint32_t line) const {
+    auto it = std::upper_bound(entries.begin(), entries.end(), line,
+                               [](uint32_t l, const IndexEntry& e) { return l < e.line; });
+    return it == entries.begin() ? 0 : (size_t)(it - entries.begin()) - 1;
+}
+
+size_t LogReader::readLines(uint32_t first, size_t count, LineCallback cb, void* ctx) {
+    char buf[MAX_LINE + 1];
+    size_t done = 0;
+    if (levelMask != MASK_ALL) {
+        for (uint32_t pos = first; done < count && pos < matches.size(); pos++) {
+            size_t len;
+            if (readLineAt(matches[pos], buf, len) == matches[pos]) break;
+            cb(ctx, pos, buf, parseLevel(buf, len));
+            done++;
+        }
+        return done;
+    }
+
+    if (first >= totalLines || entries.empty()) return 0;
+    const IndexEntry& e = entries[entryForLine(first)];
+    uint32_t offset = e.offset;
+    for (uint32_t line = e.line; done < count && line < totalLines; line++) {
+        size_t len;
+        uint32_t next = readLineAt(offset, buf, len);
+        if (next == offset) break;
+        if (line >= first) {
+            cb(ctx, line, buf, parseLevel(buf, len));
+            done++;
+        }
+        offset = next;
+    }
+    return done;
+}
+
+uint32_t LogReader::findTime(uint32_t t) {
+    // The clock can jump (NTP sync), so times are only mostly ordered:
+    // take the first span starting at or after t and check the one before it too
+    size_t i = 0;
+    while (i < entries.size() && (entries[i].time == 0 || entries[i].time < t)) i++;
+    size_t from = (i > 0) ? i - 1 : 0;
+    size_t to = std::min(i + 1, entries.size());
+
+    char buf[MAX_LINE + 1];
+    for (size_t k = from; k < to; k++) {
+        uint32_t offset = entries[k].offset;
+        uint32_t line = entries[k].line;
+        for (uint16_t n = 0; n < entries[k].lines; n++, line++) {
+            size_t len;
+            uint32_t next = readLineAt(offset, buf, len);
+            if (next == offset) break;
+            uint32_t lt = parseTime(buf, len);
+            if (lt != 0 && lt >= t) {
+                if (levelMask == MASK_ALL) return line;
+                return (uint32_t)(std::lower_bound(matches.begin(), matches.end(), offset) - matches.begin());
+            }
+            offset = next;
+        }
+    }
+    return lineCount();
+}
+
+uint32_t LogReader::timeAt(uint32_t pos) {
+    uint32_t t = 0;
+    readLines(pos, 1, [](void* ctx, uint32_t, const char* text, uint8_t) {
+        *(uint32_t*)ctx = parseTime(text, strlen(text));
+    }, &t);
+    return t;
+}
+
+static bool digits(const char* p, int n, int& out) {
+    out = 0;
+    for (int i = 0; i < n; i++) {
+        if (p[i] < '0' || p[i] > '9') return false;
+        out = out * 10 + (p[i] - '0');
+    }
+    return true;
+}
+
+uint32_t LogReader::parseTime(const char* line, size_t len) {
+    // Uptime stamps ("123.456s") have no date and are not placed in time
+    if (len < 19 || line[4] != '-' || line[7] != '-' || line[10] != ' ' || line[13] != ':' || line[16] != ':') {
+        return 0;
+    }
+    int y, mo, d, h, mi, s;
+    if (!digits(line, 4, y) || !digits(line + 5, 2, mo) || !digits(line + 8, 2, d) ||
+        !digits(line + 11, 2, h) || !digits(line + 14, 2, mi) || !digits(line + 17, 2, s)) {
+        return 0;
+    }
+    // Days since 1970-01-01 (civil calendar)
+    y -= mo <= 2;
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (mo + (mo > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int32_t days = era * 146097 + doe - 719468;
+    return (uint32_t)days * 86400UL + h * 3600UL + mi * 60UL + s;
+}
+
+uint8_t LogReader::parseLevel(const char* line, size_t len) {
+    // "<timestamp> [INF]: ..." - the tag follows a timestamp of at most ~20 chars
+    size_t end = std::min(len, (size_t)32);
+    for (size_t i = 0; i + 5 < end; i++) {
+        if (line[i] != '[' || line[i + 4] != ']') continue;
+        if (!strncmp(line + i + 1, "INF", 3)) return MASK_INFO;
+        if (!strncmp(line + i + 1, "ERR", 3)) return MASK_ERROR;
+        if (!strncmp(line + i + 1, "DBG", 3)) return MASK_DEBUG;
+    }
+    return MASK_OTHER;
+}
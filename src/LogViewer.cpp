@@ -0,0 +1,271 @@
+#include "LogViewer.h"
+#include "ui/ui.h"
+#include "LogManager.h"
+
+LogViewer logViewer;
+
+LogViewer::LogViewer()
+    : screen(nullptr), list(nullptr), slider(nullptr), fileLabel(nullptr),
+      generation(0), topPos(0), followTail(true), dragAccum(0) {
+    for (int i = 0; i < ROWS; i++) rows[i] = nullptr;
+}
+
+void LogViewer::attach(lv_obj_t* parent) {
+    if (!parent) return;
+    lv_obj_t* btn = lv_btn_create(parent);
+    lv_obj_set_size(btn, 80, 40);
+    lv_obj_align(btn, LV_ALIGN_TOP_RIGHT, -10, 5);
+    lv_obj_t* lbl = lv_label_create(btn);
+    lv_label_set_text(lbl, "LOG");
+    lv_obj_center(lbl);
+    lv_obj_add_event_cb(btn, onOpen, LV_EVENT_CLICKED, this);
+}
+
+void LogViewer::create() {
+    screen = lv_obj_create(NULL);
+    lv_obj_set_style_bg_color(screen, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_clear_flag(screen, LV_OBJ_FLAG_SCROLLABLE);
+
+    // Barra superiore: indietro, filtro livello, salti nel tempo, generazione
+    lv_obj_t* back = lv_btn_create(screen);
+    lv_obj_set_size(back, 140, 50);
+    lv_obj_set_pos(back, 10, 10);
+    lv_obj_t* lbl = lv_label_create(back);
+    lv_label_set_text(lbl, "Indietro");
+    lv_obj_center(lbl);
+    lv_obj_add_event_cb(back, onBack, LV_EVENT_CLICKED, this);
+
+    static const char* filterMap[] = {"Tutti", "Info+Errori", "Errori", ""};
+    lv_obj_t* filter = lv_btnmatrix_create(screen);
+    lv_btnmatrix_set_map(filter, filterMap);
+    lv_btnmatrix_set_btn_ctrl_all(filter, LV_BTNMATRIX_CTRL_CHECKABLE);
+    lv_btnmatrix_set_one_checked(filter, true);
+    lv_btnmatrix_set_btn_ctrl(filter, 0, LV_BTNMATRIX_CTRL_CHECKED);
+    lv_obj_set_size(filter, 400, 50);
+    lv_obj_set_pos(filter, 160, 10);
+    lv_obj_add_event_cb(filter, onFilter, LV_EVENT_VALUE_CHANGED, this);
+
+    static const char* navMap[] = {"Inizio", "-1 ora", "+1 ora", "Fine", ""};
+    lv_obj_t* nav = lv_btnmatrix_create(screen);
+    lv_btnmatrix_set_map(nav, navMap);
+    lv_obj_set_size(nav, 400, 50);
+    lv_obj_set_pos(nav, 570, 10);
+    lv_obj_add_event_cb(nav, onNav, LV_EVENT_VALUE_CHANGED, this);
+
+    lv_obj_t* older = lv_btn_create(screen);
+    lv_obj_set_size(older, 50, 50);
+    lv_obj_set_pos(older, 980, 10);
+    lbl = lv_label_create(older);
+    lv_label_set_text(lbl, LV_SYMBOL_LEFT);
+    lv_obj_center(lbl);
+    lv_obj_add_event_cb(older, onOlder, LV_EVENT_CLICKED, this);
+
+    fileLabel = lv_label_create(screen);
+    lv_obj_set_width(fileLabel, 160);
+    lv_obj_set_pos(fileLabel, 1040, 12);
+    lv_label_set_long_mode(fileLabel, LV_LABEL_LONG_CLIP);
+    lv_obj_set_style_text_color(fileLabel, lv_color_hex(0xAAAAAA), LV_PART_MAIN);
+    lv_obj_set_style_text_align(fileLabel, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
+
+    lv_obj_t* newer = lv_btn_create(screen);
+    lv_obj_set_size(newer, 50, 50);
+    lv_obj_set_pos(newer, 1220, 10);
+    lbl = lv_label_create(newer);
+    lv_label_set_text(lbl, LV_SYMBOL_RIGHT);
+    lv_obj_center(lbl);
+    lv_obj_add_event_cb(newer, onNewer, LV_EVENT_CLICKED, this);
+
+    // Lista: righe fisse, il contenuto cambia con la posizione (niente scroll LVGL)
+    list = lv_obj_create(screen);
+    lv_obj_set_size(list, 1220, ROWS * ROW_HEIGHT + 16);
+    lv_obj_set_pos(list, 10, 70);
+    lv_obj_set_style_bg_color(list, lv_color_hex(0x101010), LV_PART_MAIN);
+    lv_obj_set_style_border_color(list, lv_color_hex(0x404040), LV_PART_MAIN);
+    lv_obj_set_style_pad_all(list, 8, LV_PART_MAIN);
+    lv_obj_clear_flag(list, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_add_flag(list, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(list, onListPressing, LV_EVENT_PRESSING, this);
+    lv_obj_add_event_cb(list, onListPressing, LV_EVENT_PRESSED, this);
+
+    for (int i = 0; i < ROWS; i++) {
+        rows[i] = lv_label_create(list);
+        lv_obj_set_size(rows[i], 1200, ROW_HEIGHT);
+        lv_obj_set_pos(rows[i], 0, i * ROW_HEIGHT);
+        lv_label_set_long_mode(rows[i], LV_LABEL_LONG_CLIP);
+        lv_obj_set_style_text_font(rows[i], &lv_font_montserrat_16, LV_PART_MAIN);
+        lv_label_set_text(rows[i], "");
+    }
+
+    slider = lv_slider_create(screen);
+    lv_obj_set_size(slider, 20, ROWS * ROW_HEIGHT);
+    lv_obj_set_pos(slider, 1245, 78);
+    lv_slider_set_range(slider, 0, 1);
+    lv_obj_add_event_cb(slider, onSlider, LV_EVENT_VALUE_CHANGED, this);
+}
+
+void LogViewer::show() {
+    if (!screen) create();
+    openGeneration(generation);
+    lv_scr_load_anim(screen, LV_SCR_LOAD_ANIM_FADE_IN, 200, 0, false);
+}
+
+bool LogViewer::openGeneration(int gen) {
+    reader.close();
+    generation = gen;
+    if (!SysLog.isSdMounted() || SysLog.isBinaryFormat()) {
+        render();
+        return false;
+    }
+    String path = SysLog.getGenerationPath(gen);
+    uint8_t mask = reader.getLevelMask();
+    if (path.length() == 0 || !reader.open(path, SysLog.getIndexPath(gen))) {
+        render();
+        return false;
+    }
+    reader.setLevelMask(mask);
+    followTail = true;
+    topPos = maxTop();
+    render();
+    return true;
+}
+
+uint32_t LogViewer::maxTop() const {
+    uint32_t n = reader.lineCount();
+    return n > (uint32_t)ROWS ? n - ROWS : 0;
+}
+
+void LogViewer::scrollTo(uint32_t pos) {
+    uint32_t last = maxTop();
+    topPos = pos > last ? last : pos;
+    followTail = (topPos == last);
+    render();
+}
+
+void LogViewer::onLine(void* ctx, uint32_t pos, const char* text, uint8_t levelMask) {
+    LogViewer* self = (LogViewer*)ctx;
+    int i = (int)(pos - self->topPos);
+    if (i < 0 || i >= ROWS) return;
+    uint32_t color = 0xFFFFFF;
+    if (levelMask == LogReader::MASK_ERROR) color = 0xFF4040;
+    else if (levelMask == LogReader::MASK_DEBUG) color = 0x00C0C0;
+    else if (levelMask == LogReader::MASK_OTHER) color = 0x909090;
+    lv_obj_set_style_text_color(self->rows[i], lv_color_hex(color), LV_PART_MAIN);
+    lv_label_set_text(self->rows[i], text);
+}
+
+void LogViewer::render() {
+    if (!screen) return;
+    size_t shown = reader.isOpen() ? reader.readLines(topPos, ROWS, onLine, this) : 0;
+    for (int i = (int)shown; i < ROWS; i++) lv_label_set_text(rows[i], "");
+
+    // Cursore in alto = inizio del file
+    uint32_t last = maxTop();
+    lv_slider_set_range(slider, 0, last > 0 ? (int32_t)last : 1);
+    lv_slider_set_value(slider, (int32_t)(last - topPos), LV_ANIM_OFF);
+    updateInfo();
+}
+
+void LogViewer::updateInfo() {
+    char buf[64];
+    if (!SysLog.isSdMounted()) {
+        lv_label_set_text(fileLabel, "SD assente");
+    } else if (SysLog.isBinaryFormat()) {
+        lv_label_set_text(fileLabel, "Log binario");
+        lv_label_set_text(rows[0], "Log in formato binario: decodificare con tools/logdecode.py");
+    } else if (!reader.isOpen()) {
+        lv_label_set_text(fileLabel, generation == 0 ? "Nessun log" : "Nessuna gen.");
+    } else {
+        if (generation == 0) lv_snprintf(buf, sizeof(buf), "Attuale\n%lu righe", (unsigned long)reader.lineCount());
+        else lv_snprintf(buf, sizeof(buf), "Gen. %d\n%lu righe", generation, (unsigned long)reader.lineCount());
+        lv_label_set_text(fileLabel, buf);
+    }
+}
+
+void LogViewer::update() {
+    if (!reader.isOpen() || generation != 0) return;
+    if (!reader.refresh()) return;
+    if (followTail) topPos = maxTop();
+    render();
+}
+
+void LogViewer::onOpen(lv_event_t* e) {
+    ((LogViewer*)lv_event_get_user_data(e))->show();
+}
+
+void LogViewer::onBack(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    self->reader.close();  // Libera cache e indice finché la schermata non serve
+    loadScreen(SCREEN_ID_MAIN);
+}
+
+void LogViewer::onFilter(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    lv_obj_t* obj = lv_event_get_target(e);
+    static const uint8_t masks[] = {
+        LogReader::MASK_ALL,
+        LogReader::MASK_INFO | LogReader::MASK_ERROR | LogReader::MASK_OTHER,
+        LogReader::MASK_ERROR,
+    };
+    uint16_t id = lv_btnmatrix_get_selected_btn(obj);
+    if (id >= sizeof(masks)) return;
+
+    // Mantiene la riga in cima (o la più vicina) cambiando filtro
+    uint32_t t = self->reader.timeAt(self->topPos);
+    self->reader.setLevelMask(masks[id]);
+    if (self->followTail || t == 0) self->scrollTo(self->maxTop());
+    else self->scrollTo(self->reader.findTime(t));
+}
+
+void LogViewer::onNav(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    uint16_t id = lv_btnmatrix_get_selected_btn(lv_event_get_target(e));
+    if (id == 0) {
+        self->scrollTo(0);
+    } else if (id == 3) {
+        self->scrollTo(self->maxTop());
+    } else if (id == 1 || id == 2) {
+        uint32_t t = self->reader.timeAt(self->topPos);
+        if (t == 0) return;  // Riga senza orario (prima della sincronizzazione)
+        if (id == 1) self->scrollTo(self->reader.findTime(t > 3600 ? t - 3600 : 0));
+        else self->scrollTo(self->reader.findTime(t + 3600));
+    }
+}
+
+void LogViewer::onOlder(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    if (self->generation >= LogArchive::MAX_GENERATIONS) return;
+    if (SysLog.getGenerationPath(self->generation + 1).length() == 0) return;
+    self->openGeneration(self->generation + 1);
+}
+
+void LogViewer::onNewer(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    if (self->generation == 0) return;
+    self->openGeneration(self->generation - 1);
+}
+
+void LogViewer::onSlider(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    int32_t v = lv_slider_get_value(self->slider);
+    uint32_t last = self->maxTop();
+    self->scrollTo(v >= (int32_t)last ? 0 : last - (uint32_t)v);
+}
+
+// Trascinamento verticale: una riga ogni ROW_HEIGHT pixel, verso il basso = righe precedenti
+void LogViewer::onListPressing(lv_event_t* e) {
+    LogViewer* self = (LogViewer*)lv_event_get_user_data(e);
+    if (lv_event_get_code(e) == LV_EVENT_PRESSED) {
+        self->dragAccum = 0;
+        return;
+    }
+    lv_point_t v;
+    lv_indev_get_vect(lv_indev_get_act(), &v);
+    if (v.y == 0) return;
+    self->dragAccum += v.y;
+    int32_t lines = self->dragAccum / ROW_HEIGHT;
+    if (lines == 0) return;
+    self->dragAccum -= lines * ROW_HEIGHT;
+
+    int64_t pos = (int64_t)self->topPos - lines;
+    self->scrollTo(pos < 0 ? 0 : (uint32_t)pos);
+}
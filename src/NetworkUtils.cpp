@@ -1,5 +1,7 @@
 #include "NetworkUtils.h"
+#include "Arena.h"
 #include <WiFi.h>
+#include <algorithm>
 
 HttpResult httpGet(String url) {
     HTTPClient http;
@@ -34,6 +36,75 @@ HttpResult httpPost(String url, String body) {
     return res;
 }
 
+// Collects what HTTPClient writes (plain or chunked body) into one growing arena
+// allocation; nothing else allocates from the arena meanwhile, so it grows in place
+class ArenaSink : public Stream {
+public:
+    explicit ArenaSink(Arena& arena) : arena(arena) {}
+
+    char* data = nullptr;
+    size_t length = 0;
+
+    bool reserve(size_t size) {
+        if (size + 1 <= capacity) return true;
+        char* grown = (char*)arena.reallocate(data, size + 1);
+        if (!grown) return false;
+        data = grown;
+        capacity = size + 1;
+        return true;
+    }
+
+    size_t write(const uint8_t* buf, size_t len) override {
+        size_t want = length + len;
+        if (want + 1 > capacity && !reserve(std::max(want, capacity * 2)) && !reserve(want)) return 0;
+        memcpy(data + length, buf, len);
+        length += len;
+        data[length] = '\0';
+        return len;
+    }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+
+private:
+    Arena& arena;
+    size_t capacity = 0;
+};
+
+static HttpView readBody(HTTPClient& http, int httpCode, Arena& arena) {
+    HttpView res = { httpCode, "", 0 };
+    if (httpCode <= 0) return res;
+    ArenaSink sink(arena);
+    int size = http.getSize(); // -1 when chunked
+    if (size > 0) sink.reserve(size);
+    http.writeToStream(&sink);
+    if (sink.data) {
+        res.payload = sink.data;
+        res.length = sink.length;
+    }
+    return res;
+}
+
+HttpView httpGet(Arena& arena, const char* url) {
+    HTTPClient http;
+    http.begin(url);
+    http.setTimeout(2000);
+    HttpView res = readBody(http, http.GET(), arena);
+    http.end();
+    return res;
+}
+
+HttpView httpPost(Arena& arena, const char* url, const char* body) {
+    HTTPClient http;
+    http.begin(url);
+    http.setTimeout(2000);
+    http.addHeader("Content-Type", "application/json");
+    HttpView res = readBody(http, http.POST((uint8_t*)body, strlen(body)), arena);
+    http.end();
+    return res;
+}
+
 // Set WiFi SDIO pins (useful for M5Tab5)
 void setWifiPins(int clk, int cmd, int d0, int d1, int d2, int d3, int rst) {
     WiFi.setPins(clk, cmd, d0, d1, d2, d3, rst);
@@ -1,77 +1,279 @@
 #include "RoomDataManager.h"
+#include "LogManager.h"
+#include <time.h>
+#include <math.h>
+#include <algorithm>
 
 // Implementazione RoomData
 
 RoomData::RoomData(String name) 
-    : roomName(name), currentTemp(19.0), setpoint(20.0) {
+    : roomName(name), currentTemp(NAN), minTemp(NAN), setpoint(NAN), heatingDemand(0), totalPower(0.0f),
+      series(nullptr), historyId(HistoryLog::seriesId(name)), lastLoggedMinute(0),
+      traceHead(0), traceSeq(0),
+      lastTemp(NAN), tempSum(0.0f), tempCount(0), targetSum(0.0f), sinceRecompute(0),
+      traceMinute(0), traceSum(0.0f), traceCount(0) {
+    for (auto& p : chartTrace) p = LV_CHART_POINT_NONE;
 }
 
-void RoomData::addTemperature(float temp) {
+void RoomData::pushTrace(float temp) {
+    chartTrace[traceHead] = (lv_coord_t)lroundf(temp * 10.0f);
+    traceHead = (traceHead + 1) % ROOM_CHART_POINTS;
+    chartTrace[traceHead] = LV_CHART_POINT_NONE;  // Il punto più vecchio diventa il separatore
+    traceSeq++;
+}
+
+void RoomData::updateMember(RoomMember& m, const RoomMember& next) {
+    bool minAffected = m.hasTemp && m.temp <= minTemp;
+    
+    // Togli il vecchio contributo
+    if (m.hasTemp) {
+        tempSum -= m.temp;
+        targetSum -= m.target;
+        tempCount--;
+    }
+    if (m.demand) heatingDemand--;
+    totalPower -= m.power;
+    
+    m = next;
+    
+    // Aggiungi il nuovo
+    if (m.hasTemp) {
+        tempSum += m.temp;
+        targetSum += m.target;
+        tempCount++;
+    }
+    if (m.demand) heatingDemand++;
+    totalPower += m.power;
+    
+    // Le somme correnti accumulano errori di arrotondamento: si ricalcolano dai membri
+    // quando cambia il membro con la minima e comunque ogni RECOMPUTE_EVERY aggiornamenti
+    if (minAffected || ++sinceRecompute >= RECOMPUTE_EVERY) {
+        recompute();
+    } else {
+        if (m.hasTemp && (isnan(minTemp) || m.temp < minTemp)) minTemp = m.temp;
+        if (tempCount == 0) {
+            tempSum = 0.0f;
+            targetSum = 0.0f;
+        }
+        if (totalPower < 0.0f) totalPower = 0.0f;
+    }
+    
+    if (tempCount > 0) {
+        currentTemp = tempSum / tempCount;
+        setpoint = targetSum / tempCount;
+    } else {
+        currentTemp = NAN;
+        setpoint = NAN;
+    }
+}
+
+// Aggregati esatti dai soli membri della stanza (pochi dispositivi)
+void RoomData::recompute() {
+    minTemp = NAN;
+    tempSum = 0.0f;
+    targetSum = 0.0f;
+    tempCount = 0;
+    heatingDemand = 0;
+    totalPower = 0.0f;
+    for (const auto& m : members) {
+        if (m.hasTemp) {
+            tempSum += m.temp;
+            targetSum += m.target;
+            tempCount++;
+            if (isnan(minTemp) || m.temp < minTemp) minTemp = m.temp;
+        }
+        if (m.demand) heatingDemand++;
+        totalPower += m.power;
+    }
+    sinceRecompute = 0;
+}
+
+bool RoomData::addTemperature(float temp) {
     uint32_t currentMinute = millis() / 60000;
+    lastTemp = temp;
     
-    // Rimuovi punti più vecchi di 30 minuti
-    while (!history.empty() && (currentMinute - history[0].timestamp) > 30) {
-        history.erase(history.begin());
+    // Traccia del grafico: chiude la media del minuto precedente
+    if (traceCount > 0 && currentMinute != traceMinute) {
+        pushTrace(traceSum / traceCount);
+        traceSum = 0.0f;
+        traceCount = 0;
     }
+    traceMinute = currentMinute;
+    traceSum += temp;
+    traceCount++;
     
-    // Aggiungi nuovo punto
-    TempPoint point;
-    point.timestamp = currentMinute;
-    point.temperature = temp;
-    history.push_back(point);
+    // Storico lungo: solo con orologio valido, così i timestamp restano confrontabili
+    uint32_t now;
+    if (!RoomDataManager::getEpochSeconds(now)) return false;
+    if (!series) series = TimeSeries::create();  // Allocato alla prima misura (PSRAM)
+    return series && series->add(now, temp);
+}
+
+void RoomData::restoreMinute(uint32_t time, float temp) {
+    if (!series) series = TimeSeries::create();
+    if (!series) return;
+    series->addMinute(time, temp);
+    lastLoggedMinute = time;  // Già su SD: non riscriverlo quando il minuto si chiude
 }
 
 float RoomData::getLastTemperature() const {
-    if (history.empty()) return currentTemp;
-    return history.back().temperature;
+    if (isnan(lastTemp)) return currentTemp;
+    return lastTemp;
 }
 
 // Implementazione RoomDataManager
 
 RoomDataManager::RoomDataManager() 
-    : rooms{
-        RoomData("Camera Letto"),
-        RoomData("Salotto"),
-        RoomData("Cameretta"),
-        RoomData("Bagno")
-    },
-    currentRoomIndex(0) {
+    : currentRoomIndex(0),
+      hysteresis(0.5f),
+      powerSeries(nullptr),
+      powerHistoryId(HistoryLog::seriesId("power")),
+      powerLastLoggedMinute(0) {
 }
 
-RoomData& RoomDataManager::getRoom(int index) {
-    if (index >= 0 && index < 4) {
-        return rooms[index];
+void RoomDataManager::begin(const AppConfig& config) {
+    for (auto* r : rooms) {
+        TimeSeries::destroy(r->series);
+        delete r;
+    }
+    rooms.clear();
+    deviceIndex.clear();
+    hysteresis = config.climate.hysteresis;
+    
+    // Stanze uniche, in ordine alfabetico
+    std::vector<String> names;
+    for (const auto& kv : config.devices) {
+        const String& room = kv.second.room;
+        if (room.length() == 0) continue;
+        if (std::find(names.begin(), names.end(), room) == names.end()) names.push_back(room);
+    }
+    std::sort(names.begin(), names.end(), [](const String& a, const String& b) { return a.compareTo(b) < 0; });
+    
+    for (const auto& name : names) rooms.push_back(new RoomData(name));
+    
+    for (const auto& kv : config.devices) {
+        RoomData* room = findRoom(kv.second.room);
+        if (!room) continue;
+        int roomIdx = (int)(std::find(rooms.begin(), rooms.end(), room) - rooms.begin());
+        RoomMember m;
+        m.id = kv.first;
+        room->members.push_back(m);
+        deviceIndex[kv.first] = std::make_pair(roomIdx, (int)room->members.size() - 1);
     }
-    return rooms[0];
+    
+    if (currentRoomIndex >= (int)rooms.size()) currentRoomIndex = 0;
+    SysLog.log(String("RoomDataManager: ") + String((int)rooms.size()) + " room(s), " +
+               String((int)deviceIndex.size()) + " device(s) assigned");
 }
 
-void RoomDataManager::setCurrentRoom(int index) {
-    if (index >= 0 && index < 4) {
-        currentRoomIndex = index;
+RoomData* RoomDataManager::findRoom(const String& name) {
+    for (auto* r : rooms) {
+        if (r->roomName == name) return r;
     }
+    return nullptr;
 }
 
-int RoomDataManager::getCurrentRoomIndex() const {
-    return currentRoomIndex;
+void RoomDataManager::onDeviceState(const DeviceState& ds) {
+    auto it = deviceIndex.find(ds.id);
+    if (it == deviceIndex.end()) return;
+    RoomData* room = rooms[it->second.first];
+    RoomMember& m = room->members[it->second.second];
+    
+    RoomMember next;
+    next.id = m.id;
+    next.known = true;
+    next.power = ds.isOnline ? ds.power : 0.0f;
+    if (ds.role == DeviceRole::TRV && ds.isOnline) {
+        next.hasTemp = true;
+        next.temp = ds.currentTemp;
+        next.target = ds.targetTemp;
+        // Stesso criterio del ClimateController per la richiesta caldaia
+        next.demand = ds.valvePos > 10.0f || ds.currentTemp < (ds.targetTemp - hysteresis);
+    }
+    
+    if (m.known && m.hasTemp == next.hasTemp && m.temp == next.temp && m.target == next.target &&
+        m.demand == next.demand && m.power == next.power) {
+        return;  // Invariato: nessun lavoro
+    }
+    room->updateMember(m, next);
 }
 
-RoomData& RoomDataManager::getCurrentRoom() {
-    return rooms[currentRoomIndex];
+void RoomDataManager::update() {
+    for (auto* room : rooms) {
+        if (!room->hasTemperature()) continue;
+        if (room->addTemperature(room->currentTemp)) {
+            logClosedMinute(room->series, room->historyId, room->lastLoggedMinute);
+        }
+    }
+}
+
+void RoomDataManager::logClosedMinute(TimeSeries* ts, uint32_t id, uint32_t& lastLogged) {
+    SeriesPoint p;
+    if (!ts || !ts->lastClosed(TimeSeries::TIER_1MIN, p) || p.time <= lastLogged) return;
+    historyLog.append(id, p.time, p.avg);
+    lastLogged = p.time;
 }
 
-void RoomDataManager::generateRandomTemp(int roomIndex) {
-    if (roomIndex >= 0 && roomIndex < 4) {
-        float temp = 19.0 + (random(0, 50) / 100.0); // 19.0 - 19.5
-        rooms[roomIndex].addTemperature(temp);
-        rooms[roomIndex].currentTemp = temp;
+void RoomDataManager::onHistorySample(void* ctx, uint32_t seriesId, uint32_t time, float value) {
+    RoomDataManager* self = (RoomDataManager*)ctx;
+    if (seriesId == self->powerHistoryId) {
+        if (!self->powerSeries) self->powerSeries = TimeSeries::create();
+        if (self->powerSeries) self->powerSeries->addMinute(time, value);
+        self->powerLastLoggedMinute = time;
+        return;
+    }
+    for (auto* room : self->rooms) {
+        if (room->historyId == seriesId) {
+            room->restoreMinute(time, value);
+            return;
+        }
     }
 }
 
-void RoomDataManager::generateAllRandomTemps() {
-    for (int i = 0; i < 4; i++) {
-        generateRandomTemp(i);
+void RoomDataManager::loadHistory() {
+    historyLog.load(24UL * 3600UL, onHistorySample, this);
+}
+
+void RoomDataManager::loop() {
+    historyLog.loop();
+}
+
+bool RoomDataManager::getEpochSeconds(uint32_t& out) {
+    time_t now = time(nullptr);
+    if (now < 1609459200) return false;  // Prima del 1/1/2021 => NTP non ancora sincronizzato
+    out = (uint32_t)now;
+    return true;
+}
+
+void RoomDataManager::addPowerSample(float watts) {
+    uint32_t now;
+    if (!getEpochSeconds(now)) return;
+    if (!powerSeries) powerSeries = TimeSeries::create();
+    if (powerSeries && powerSeries->add(now, watts)) {
+        logClosedMinute(powerSeries, powerHistoryId, powerLastLoggedMinute);
     }
 }
 
+RoomData* RoomDataManager::getRoom(int index) {
+    if (index >= 0 && index < (int)rooms.size()) {
+        return rooms[index];
+    }
+    return nullptr;
+}
+
+void RoomDataManager::setCurrentRoom(int index) {
+    if (index >= 0 && index < (int)rooms.size()) {
+        currentRoomIndex = index;
+    }
+}
+
+int RoomDataManager::getCurrentRoomIndex() const {
+    return currentRoomIndex;
+}
+
+RoomData* RoomDataManager::getCurrentRoom() {
+    return getRoom(currentRoomIndex);
+}
+
 // Definizione dell'istanza globale
 RoomDataManager roomDataManager;
@@ -0,0 +1,88 @@
+#include "ScheduleEngine.h"
+#include "LogManager.h"
+#include <algorithm>
+
+bool ScheduleEngine::parseTime(const String& timeStr, uint16_t& minutes) {
+    int split = timeStr.indexOf(':');
+    if (split <= 0) return false;
+    long h = timeStr.substring(0, split).toInt();
+    long m = timeStr.substring(split + 1).toInt();
+    if (h < 0 || h > 23 || m < 0 || m > 59) return false;
+    minutes = (uint16_t)(h * 60 + m);
+    return true;
+}
+
+uint8_t ScheduleEngine::parseDays(JsonVariantConst v) {
+    if (v.isNull()) return SCHEDULE_DAYS_ALL;
+    if (v.is<const char*>()) {
+        String s = v.as<String>();
+        if (s == "weekdays") return SCHEDULE_DAYS_WEEKDAYS;
+        if (s == "weekend") return SCHEDULE_DAYS_WEEKEND;
+        return SCHEDULE_DAYS_ALL;
+    }
+    uint8_t mask = 0;
+    for (JsonVariantConst d : v.as<JsonArrayConst>()) {
+        int day = d | -1;
+        if (day >= 0 && day <= 6) mask |= (1 << day);
+    }
+    return mask ? mask : SCHEDULE_DAYS_ALL;
+}
+
+void ScheduleEngine::writeDays(JsonObject obj, uint8_t days) {
+    if (days == SCHEDULE_DAYS_ALL) return; // default, keep the file compact
+    if (days == SCHEDULE_DAYS_WEEKDAYS) { obj["days"] = "weekdays"; return; }
+    if (days == SCHEDULE_DAYS_WEEKEND) { obj["days"] = "weekend"; return; }
+    JsonArray arr = obj["days"].to<JsonArray>();
+    for (int d = 0; d < 7; d++) {
+        if (days & (1 << d)) arr.add(d);
+    }
+}
+
+void ScheduleEngine::compile(DeviceConfig& dc) {
+    dc.compiledSchedule.clear();
+    for (const auto& pt : dc.schedule) {
+        uint16_t mins;
+        if (!parseTime(pt.time, mins)) {
+            SysLog.error(String("Schedule [") + dc.id + "]: invalid time \"" + pt.time + "\" ignored");
+            continue;
+        }
+        for (int d = 0; d < 7; d++) {
+            if (pt.days & (1 << d)) {
+                dc.compiledSchedule.push_back({(uint16_t)(d * MINUTES_PER_DAY + mins), pt.temp});
+            }
+        }
+    }
+
+    // Sort by time; for duplicate minutes the point listed last wins
+    std::stable_sort(dc.compiledSchedule.begin(), dc.compiledSchedule.end(),
+                     [](const ScheduleTransition& a, const ScheduleTransition& b) { return a.minuteOfWeek < b.minuteOfWeek; });
+    auto& v = dc.compiledSchedule;
+    size_t out = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+        if (out > 0 && v[out - 1].minuteOfWeek == v[i].minuteOfWeek) v[out - 1] = v[i];
+        else v[out++] = v[i];
+    }
+    v.resize(out);
+    v.shrink_to_fit();
+}
+
+bool ScheduleEngine::lookup(const std::vector<ScheduleTransition>& transitions, uint16_t minuteOfWeek,
+                            float& temp, uint16_t& nextChange) {
+    if (transitions.empty()) return false;
+
+    // First transition strictly after now; the active one is just before it,
+    // or the last one of the week when none has happened yet this week.
+    auto it = std::upper_bound(transitions.begin(), transitions.end(), minuteOfWeek,
+                               [](uint16_t m, const ScheduleTransition& t) { return m < t.minuteOfWeek; });
+    const ScheduleTransition& active = (it == transitions.begin()) ? transitions.back() : *(it - 1);
+    const ScheduleTransition& next = (it == transitions.end()) ? transitions.front() : *it;
+
+    temp = active.temp;
+    uint16_t delta = (uint16_t)((next.minuteOfWeek + MINUTES_PER_WEEK - minuteOfWeek) % MINUTES_PER_WEEK);
+    nextChange = (delta == 0) ? MINUTES_PER_WEEK : delta;
+    return true;
+}
+
+uint16_t ScheduleEngine::minuteOfWeek(const struct tm& timeinfo) {
+    return (uint16_t)(timeinfo.tm_wday * MINUTES_PER_DAY + timeinfo.tm_hour * 60 + timeinfo.tm_min);
+}
@@ -1,136 +1,227 @@
 #include "ShellyDevice.h"
 #include "NetworkUtils.h"
+#include "Arena.h"
 #include "LogManager.h"
+#include <algorithm>
+
+// --- Hot state ---
+
+void DeviceStates::reserve(size_t n) {
+    isOn.reserve(n);
+    isOnline.reserve(n);
+    power.reserve(n);
+    currentTemp.reserve(n);
+    targetTemp.reserve(n);
+    valvePos.reserve(n);
+    role.reserve(n);
+    priority.reserve(n);
+    phase.reserve(n);
+    loads.reserve(n);
+    trvs.reserve(n);
+}
 
-// --- Base Class ---
-
-ShellyDevice::ShellyDevice(String ip, String id, int channel, DeviceRole role, int priority)
-    : ip(ip), id(id), channelIndex(channel), role(role), priority(priority) {}
-
-ShellyDevice* ShellyDevice::create(DeviceType type, String ip, String id, int channel, DeviceRole role, int priority) {
-    ShellyDevice* dev = nullptr;
-    switch (type) {
-        case DeviceType::SHELLY_GEN1:
-            dev = new ShellyGen1(ip, id, channel, role, priority);
-            break;
-        case DeviceType::SHELLY_GEN2:
-            dev = new ShellyGen2(ip, id, channel, role, priority);
-            break;
-        case DeviceType::SHELLY_BLU_TRV:
-            dev = new ShellyBluTrv(ip, id, channel, role, priority);
-            break;
-        default:
-            return nullptr;
-    }
+uint16_t DeviceStates::add(DeviceRole r, int prio) {
+    isOn.push_back(0);
+    isOnline.push_back(0);
+    power.push_back(0.0f);
+    currentTemp.push_back(0.0f);
+    targetTemp.push_back(0.0f);
+    valvePos.push_back(0.0f);
+    role.push_back(r);
+    priority.push_back(prio);
+    phase.push_back(-1);
+    uint16_t slot = (uint16_t)(size() - 1);
+    indexRole(slot);
+    return slot;
+}
+
+void DeviceStates::setOn(uint16_t slot, bool on) {
+    if (isOn[slot] == on) return;
+    isOn[slot] = on;
+    if (role[slot] == DeviceRole::LOAD) placeLoad(slot);
+}
+
+void DeviceStates::setRole(uint16_t slot, DeviceRole r) {
+    if (role[slot] == r) return;
+    unindexRole(slot);
+    role[slot] = r;
+    indexRole(slot);
+}
+
+void DeviceStates::setPriority(uint16_t slot, int prio) {
+    if (priority[slot] == prio) return;
+    priority[slot] = prio;
+    if (role[slot] == DeviceRole::LOAD) placeLoad(slot);
+}
+
+// Shedding order: the first matching entry is the best candidate. Ties keep slot order.
+bool DeviceStates::loadBefore(uint16_t a, uint16_t b) const {
+    if (isOn[a] != isOn[b]) return isOn[a] > isOn[b];
+    if (priority[a] != priority[b]) return priority[a] > priority[b];
+    return a < b;
+}
+
+// Moves one load to its place after its key changed: O(loads), no allocation
+void DeviceStates::placeLoad(uint16_t slot) {
+    auto it = std::find(loads.begin(), loads.end(), slot);
+    if (it != loads.end()) loads.erase(it);
+    auto pos = std::lower_bound(loads.begin(), loads.end(), slot,
+                                [this](uint16_t a, uint16_t b) { return loadBefore(a, b); });
+    loads.insert(pos, slot);
+}
+
+void DeviceStates::indexRole(uint16_t slot) {
+    if (role[slot] == DeviceRole::LOAD) placeLoad(slot);
+    else if (role[slot] == DeviceRole::TRV) trvs.push_back(slot);
+}
 
-    if (dev) {
-        dev->deviceType = type;
+void DeviceStates::unindexRole(uint16_t slot) {
+    if (role[slot] == DeviceRole::UNKNOWN) return;
+    std::vector<uint16_t>& list = (role[slot] == DeviceRole::LOAD) ? loads : trvs;
+    auto it = std::find(list.begin(), list.end(), slot);
+    if (it != list.end()) list.erase(it);
+}
+
+// --- Dispatch ---
+
+ShellyDevice::ShellyDevice(DeviceType type, const String& ip, const String& id, int channel, DeviceStates* states, uint16_t slot)
+    : ip(ip), id(id), channelIndex(channel), deviceType(type), states(states), slot(slot) {}
+
+bool ShellyDevice::turnOn() {
+    switch (deviceType) {
+        case DeviceType::SHELLY_GEN1: return setOutputGen1(true);
+        case DeviceType::SHELLY_GEN2: return setOutputGen2(true);
+        default: return false;
     }
-    return dev;
 }
 
-// --- Shelly Gen 1 (Shelly 1, 1PM, 2.5, 3EM) ---
+bool ShellyDevice::turnOff() {
+    switch (deviceType) {
+        case DeviceType::SHELLY_GEN1: return setOutputGen1(false);
+        case DeviceType::SHELLY_GEN2: return setOutputGen2(false);
+        default: return false;
+    }
+}
 
-ShellyGen1::ShellyGen1(String ip, String id, int channel, DeviceRole role, int priority)
-    : ShellyDevice(ip, id, channel, role, priority) {}
+void ShellyDevice::update() {
+    switch (deviceType) {
+        case DeviceType::SHELLY_GEN1: updateGen1(); break;
+        case DeviceType::SHELLY_GEN2: updateGen2(); break;
+        case DeviceType::SHELLY_BLU_TRV: updateBluTrv(); break;
+        default: break;
+    }
+}
 
-void ShellyGen1::turnOn() {
-    if (!hasRelay) {
-        SysLog.log(String("Shelly/GEN1 [") + id + "]: ERR turnOn ignored - Roller mode or meter-only channel not supported for control.");
-        return;
+void ShellyDevice::fetchMetadata() {
+    switch (deviceType) {
+        case DeviceType::SHELLY_GEN1: fetchMetadataGen1(); break;
+        case DeviceType::SHELLY_GEN2: fetchMetadataGen2(); break;
+        default: break;
     }
+}
 
-    String url = "http://" + ip + "/relay/" + String(channelIndex) + "?turn=on";
-    SysLog.debug(String("Shelly/GEN1 [") + id + "]: sending turnOn -> " + url);
-    HttpResult r = httpGet(url);
-    SysLog.debug(String("Shelly/GEN1 [") + id + "]: turnOn HTTP code=" + String(r.code) + " payload=" + r.payload);
-    
-    if (r.code == 200) {
-        isOn = true; 
+void ShellyDevice::applyStatus(JsonVariantConst status) {
+    switch (deviceType) {
+        case DeviceType::SHELLY_GEN1: applyStatusGen1(status); break;
+        case DeviceType::SHELLY_GEN2: applyStatusGen2(status); break;
+        case DeviceType::SHELLY_BLU_TRV: applyStatusBluTrv(status); break;
+        default: break;
     }
 }
 
-void ShellyGen1::turnOff() {
+bool ShellyDevice::setTargetTemperature(float temp) {
+    return deviceType == DeviceType::SHELLY_BLU_TRV && setTargetTempBluTrv(temp);
+}
+
+// --- Shelly Gen 1 (Shelly 1, 1PM, 2.5, 3EM) ---
+
+bool ShellyDevice::setOutputGen1(bool on) {
+    const char* cmd = on ? "turnOn" : "turnOff";
     if (!hasRelay) {
-        SysLog.log(String("Shelly/GEN1 [") + id + "]: ERR turnOff ignored - Roller mode or meter-only channel not supported for control.");
-        return;
+        SysLog.log(String("Shelly/GEN1 [") + id + "]: ERR " + cmd + " ignored - Roller mode or meter-only channel not supported for control.");
+        return false;
     }
 
-    String url = "http://" + ip + "/relay/" + String(channelIndex) + "?turn=off";
-    SysLog.debug(String("Shelly/GEN1 [") + id + "]: sending turnOff -> " + url);
-    HttpResult r = httpGet(url);
-    SysLog.debug(String("Shelly/GEN1 [") + id + "]: turnOff HTTP code=" + String(r.code) + " payload=" + r.payload);
+    const char* url = pollArena.format("http://%s/relay/%d?turn=%s", ip.c_str(), channelIndex, on ? "on" : "off");
+    LOG_DEBUG("Shelly/GEN1 [%s]: sending %s -> %s", id.c_str(), cmd, url);
+    HttpView r = httpGet(pollArena, url);
+    LOG_DEBUG("Shelly/GEN1 [%s]: %s HTTP code=%d payload=%s", id.c_str(), cmd, r.code, r.payload);
     
-    if (r.code == 200) {
-        isOn = false;
+    if (r.code != 200) {
+        LOG_ERROR("Shelly/GEN1 [%s]: %s failed code=%d", id.c_str(), cmd, r.code);
+        return false;
     }
+    setOn(on);
+    return true;
 }
 
-void ShellyGen1::update() {
-    String url = "http://" + ip + "/status";
-    HttpResult r = httpGet(url);
+void ShellyDevice::updateGen1() {
+    HttpView r = httpGet(pollArena, pollArena.format("http://%s/status", ip.c_str()));
     
-    if (r.code <= 0 || r.payload.length() == 0) {
-        SysLog.error(String("Shelly/GEN1 [") + id + "]: empty /status response from " + ip);
-        isOnline = false;
+    if (r.code <= 0 || r.length == 0) {
+        LOG_ERROR("Shelly/GEN1 [%s]: empty /status response from %s", id.c_str(), ip.c_str());
+        setOnline(false);
         return;
     }
 
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, r.payload);
+    JsonDocument doc(pollArena.json());
+    DeserializationError err = deserializeJson(doc, r.payload, r.length);
     if (err) {
-                SysLog.log(String("Shelly/GEN1 [") + id + "]: WARNING - detected 'roller' mode (unsupported for control).");
-        isOnline = false;
+        LOG_ERROR("Shelly/GEN1 [%s]: JSON error: %s", id.c_str(), err.c_str());
+        setOnline(false);
         return;
     }
 
-    isOnline = true;
+    applyStatusGen1(doc);
+}
+
+void ShellyDevice::applyStatusGen1(JsonVariantConst doc) {
+    setOnline(true);
 
     // --- ROLLER SHUTTER MODE CHECK (Shelly 2.5) ---
     if (!doc["rollers"].isNull()) {
         hasRelay = false; 
-        isOn = false; 
+        setOn(false); 
         if (!doc["meters"].isNull() && doc["meters"].size() > 0) {
-            power = doc["meters"][0]["power"];
+            setPower(doc["meters"][0]["power"].as<float>());
         } else {
-            power = 0.0f;
+            setPower(0.0f);
         }
-        SysLog.debug(String("Shelly/GEN1 [") + id + "]: ROLLER SHUTTER mode (unsupported for control). Power=" + String(power));
+        LOG_DEBUG("Shelly/GEN1 [%s]: ROLLER SHUTTER mode (unsupported for control). Power=%.2f", id.c_str(), getPower());
         return; 
     }
 
     // --- STANDARD RELAY / EMETERS LOGIC ---
     if (!doc["relays"].isNull() && doc["relays"].size() > channelIndex) {
-        isOn = doc["relays"][channelIndex]["ison"];
+        setOn(doc["relays"][channelIndex]["ison"].as<bool>());
         hasRelay = true;
     } else {
-        isOn = false;
+        setOn(false);
         hasRelay = false;
     }
 
     bool powerFound = false;
     if (!doc["meters"].isNull() && doc["meters"].size() > channelIndex) {
-        power = doc["meters"][channelIndex]["power"];
+        setPower(doc["meters"][channelIndex]["power"].as<float>());
         powerFound = true;
     } 
     else if (!doc["emeters"].isNull() && doc["emeters"].size() > channelIndex) {
-        power = doc["emeters"][channelIndex]["power"];
+        setPower(doc["emeters"][channelIndex]["power"].as<float>());
         powerFound = true;
     }
 
-    if (!powerFound) power = 0.0f;
+    if (!powerFound) setPower(0.0f);
 
-    SysLog.debug(String("Shelly/GEN1 [") + id + "]: On=" + String(isOn) + " Pwr=" + String(power) + " Rel=" + String(hasRelay));
+    LOG_DEBUG("Shelly/GEN1 [%s]: On=%d Pwr=%.2f Rel=%d", id.c_str(), getIsOn(), getPower(), hasRelay);
 }
 
-void ShellyGen1::fetchMetadata() {
-    String url = "http://" + ip + "/settings";
-    HttpResult r = httpGet(url);
+void ShellyDevice::fetchMetadataGen1() {
+    HttpView r = httpGet(pollArena, pollArena.format("http://%s/settings", ip.c_str()));
     
-    if (r.code <= 0 || r.payload.length() == 0) return;
+    if (r.code <= 0 || r.length == 0) return;
 
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, r.payload);
+    JsonDocument doc(pollArena.json());
+    DeserializationError err = deserializeJson(doc, r.payload, r.length);
     if (err) return;
 
     if (!doc["mode"].isNull()) {
@@ -165,89 +256,117 @@ void ShellyGen1::fetchMetadata() {
     SysLog.log(String("Shelly/GEN1 [") + id + "]: fetched metadata name=\"" + friendlyName + "\"");
 }
 
-// --- Shelly Gen 2 ---
+// --- Shelly Gen 2 (RPC over HTTP) ---
 
-ShellyGen2::ShellyGen2(String ip, String id, int channel, DeviceRole role, int priority)
-    : ShellyDevice(ip, id, channel, role, priority) {}
-
-void ShellyGen2::turnOn() {
-    // Gen2 uses RPC over HTTP
-    String body = "{\"id\":1, \"method\":\"Switch.Set\", \"params\":{\"id\":" + String(channelIndex) + ", \"on\":true}}";
-    String url = "http://" + ip + "/rpc";
-
-    SysLog.debug(String("Shelly/GEN2 [") + id + "]: sending Switch.Set ON -> " + url + " body=" + body);
-    HttpResult r = httpPost(url, body); // assume httpPost is available
-
-    if (r.code == 200) {
-        isOn = true;
-    } else {
-        SysLog.error(String("Shelly/GEN2 [") + id + "]: turnOn failed code=" + String(r.code) + " resp=" + r.payload);
-    }
+// RPC failures come back as HTTP 200 with an "error" object instead of "result"
+static bool rpcAccepted(const HttpView& r) {
+    if (r.code != 200) return false;
+    JsonDocument doc(pollArena.json());
+    if (deserializeJson(doc, r.payload, r.length)) return false;
+    return doc["error"].isNull();
 }
 
-void ShellyGen2::turnOff() {
-    String body = "{\"id\":1, \"method\":\"Switch.Set\", \"params\":{\"id\":" + String(channelIndex) + ", \"on\":false}}";
-    String url = "http://" + ip + "/rpc";
+bool ShellyDevice::setOutputGen2(bool on) {
+    const char* body = pollArena.format("{\"id\":1, \"method\":\"Switch.Set\", \"params\":{\"id\":%d, \"on\":%s}}", channelIndex, on ? "true" : "false");
+    const char* url = pollArena.format("http://%s/rpc", ip.c_str());
 
-    SysLog.debug(String("Shelly/GEN2 [") + id + "]: sending Switch.Set OFF -> " + url + " body=" + body);
-    HttpResult r = httpPost(url, body);
+    LOG_DEBUG("Shelly/GEN2 [%s]: sending Switch.Set %s -> %s body=%s", id.c_str(), on ? "ON" : "OFF", url, body);
+    HttpView r = httpPost(pollArena, url, body);
 
-    if (r.code == 200) {
-        isOn = false;
-    } else {
-        SysLog.error(String("Shelly/GEN2 [") + id + "]: turnOff failed code=" + String(r.code) + " resp=" + r.payload);
+    if (rpcAccepted(r)) {
+        setOn(on);
+        return true;
     }
+    LOG_ERROR("Shelly/GEN2 [%s]: %s failed code=%d resp=%s", id.c_str(), on ? "turnOn" : "turnOff", r.code, r.payload);
+    return false;
 }
 
-void ShellyGen2::update() {
+void ShellyDevice::updateGen2() {
     // Retrieve the specific Switch component status
-    String body = "{\"id\":1, \"method\":\"Switch.GetStatus\", \"params\":{\"id\":" + String(channelIndex) + "}}";
-    String url = "http://" + ip + "/rpc";
-    HttpResult r = httpPost(url, body);
+    const char* body = pollArena.format("{\"id\":1, \"method\":\"Switch.GetStatus\", \"params\":{\"id\":%d}}", channelIndex);
+    HttpView r = httpPost(pollArena, pollArena.format("http://%s/rpc", ip.c_str()), body);
 
     if (r.code <= 0) {
-        SysLog.error(String("Shelly/GEN2 [") + id + "]: empty /rpc response from " + ip);
-        isOnline = false;
+        LOG_ERROR("Shelly/GEN2 [%s]: empty /rpc response from %s", id.c_str(), ip.c_str());
+        setOnline(false);
         return;
     }
 
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, r.payload);
+    JsonDocument doc(pollArena.json());
+    DeserializationError err = deserializeJson(doc, r.payload, r.length);
     if (err) {
-        SysLog.error(String("Shelly/GEN2 [") + id + "]: JSON error: " + String(err.c_str()));
-        isOnline = false; 
+        LOG_ERROR("Shelly/GEN2 [%s]: JSON error: %s", id.c_str(), err.c_str());
+        setOnline(false); 
         return;
     }
 
     // Response structure: { "id": 1, "result": { "output": true, "apower": 12.5, ... } }
     if (!doc["result"].isNull()) {
-        isOnline = true;
-        isOn = doc["result"]["output"];
+        setOnline(true);
+        setOn(doc["result"]["output"].as<bool>());
         // apower is the instantaneous active power
         if (!doc["result"]["apower"].isNull()) {
-            power = doc["result"]["apower"];
+            setPower(doc["result"]["apower"].as<float>());
         } else {
-            power = 0.0f;
+            setPower(0.0f);
         }
         
-        SysLog.debug(String("Shelly/GEN2 [") + id + "]: On=" + String(isOn) + " Pwr=" + String(power));
+        LOG_DEBUG("Shelly/GEN2 [%s]: On=%d Pwr=%.2f", id.c_str(), getIsOn(), getPower());
     } else {
-        SysLog.error(String("Shelly/GEN2 [") + id + "]: API Error or component not found: " + r.payload);
-        isOnline = false;
+        LOG_ERROR("Shelly/GEN2 [%s]: API Error or component not found: %s", id.c_str(), r.payload);
+        setOnline(false);
+    }
+}
+
+void ShellyDevice::applyStatusGen2(JsonVariantConst status) {
+    // Shelly.GetStatus result: { "switch:0": {...}, "em1:0": {...}, "em:0": {...}, ... }
+    char key[24];
+    snprintf(key, sizeof(key), "switch:%d", channelIndex);
+    JsonVariantConst sw = status[key];
+    if (!sw.isNull()) {
+        setOnline(true);
+        setOn(sw["output"].as<bool>());
+        setPower(sw["apower"] | 0.0f);
+        LOG_DEBUG("Shelly/GEN2 [%s]: On=%d Pwr=%.2f", id.c_str(), getIsOn(), getPower());
+        return;
+    }
+
+    // Meter-only channels (Pro EM / Pro 3EM in monophase mode)
+    snprintf(key, sizeof(key), "em1:%d", channelIndex);
+    JsonVariantConst em1 = status[key];
+    if (!em1.isNull()) {
+        setOnline(true);
+        setOn(false);
+        setPower(em1["act_power"] | 0.0f);
+        LOG_DEBUG("Shelly/GEN2 [%s]: meter Pwr=%.2f", id.c_str(), getPower());
+        return;
+    }
+
+    // Pro 3EM in triphase mode: a single "em:0" component, the channel selects the phase
+    static const char* phaseKeys[] = { "a_act_power", "b_act_power", "c_act_power" };
+    JsonVariantConst em = status["em:0"];
+    if (!em.isNull() && channelIndex >= 0 && channelIndex < 3) {
+        setOnline(true);
+        setOn(false);
+        setPower(em[phaseKeys[channelIndex]] | 0.0f);
+        LOG_DEBUG("Shelly/GEN2 [%s]: phase meter Pwr=%.2f", id.c_str(), getPower());
+        return;
     }
+
+    LOG_ERROR("Shelly/GEN2 [%s]: channel not found in Shelly.GetStatus", id.c_str());
+    setOnline(false);
 }
 
-void ShellyGen2::fetchMetadata() {
+void ShellyDevice::fetchMetadataGen2() {
     // 1. Retrieve device configuration (global name)
     // Use Sys.GetConfig
-    String sysBody = "{\"id\":1, \"method\":\"Sys.GetConfig\"}";
-    String url = "http://" + ip + "/rpc";
-    HttpResult rSys = httpPost(url, sysBody);
+    const char* url = pollArena.format("http://%s/rpc", ip.c_str());
+    HttpView rSys = httpPost(pollArena, url, "{\"id\":1, \"method\":\"Sys.GetConfig\"}");
     
     String globalName = "";
     if (rSys.code == 200) {
-        JsonDocument docSys;
-        if (!deserializeJson(docSys, rSys.payload)) {
+        JsonDocument docSys(pollArena.json());
+        if (!deserializeJson(docSys, rSys.payload, rSys.length)) {
             if (!docSys["result"]["device"]["name"].isNull()) {
                 globalName = docSys["result"]["device"]["name"].as<String>();
             }
@@ -255,13 +374,13 @@ void ShellyGen2::fetchMetadata() {
     }
 
     // 2. Retrieve channel configuration (switch name)
-    String swBody = "{\"id\":2, \"method\":\"Switch.GetConfig\", \"params\":{\"id\":" + String(channelIndex) + "}}";
-    HttpResult rSw = httpPost(url, swBody);
+    const char* swBody = pollArena.format("{\"id\":2, \"method\":\"Switch.GetConfig\", \"params\":{\"id\":%d}}", channelIndex);
+    HttpView rSw = httpPost(pollArena, url, swBody);
     
     String chName = "";
     if (rSw.code == 200) {
-        JsonDocument docSw;
-        if (!deserializeJson(docSw, rSw.payload)) {
+        JsonDocument docSw(pollArena.json());
+        if (!deserializeJson(docSw, rSw.payload, rSw.length)) {
             if (!docSw["result"]["name"].isNull()) {
                 chName = docSw["result"]["name"].as<String>();
             }
@@ -284,40 +403,63 @@ void ShellyGen2::fetchMetadata() {
 
 // --- Shelly Blu TRV ---
 
-ShellyBluTrv::ShellyBluTrv(String gatewayIp, String id, int componentId, DeviceRole role, int priority)
-    : ShellyDevice(gatewayIp, id, componentId, role, priority), componentId(componentId) {}
-
-void ShellyBluTrv::turnOn() {} 
-void ShellyBluTrv::turnOff() {} 
-
-void ShellyBluTrv::setTargetTemperature(float temp) {
-    String body = "{\"id\":1, \"method\":\"Thermostat.SetTargetTemp\", \"params\":{\"id\":" + String(componentId) + ", \"target_C\":" + String(temp) + "}}";
-    String url = "http://" + ip + "/rpc";
-    SysLog.debug(String("Shelly/BLU_TRV [") + id + "]: RPC set target temp -> " + url + " body=" + body);
-    HttpResult r = httpPost(url, body);
-    if (r.code <= 0) {
-        SysLog.error(String("Shelly/BLU_TRV [") + id + "]: RPC set target temp failed");
+bool ShellyDevice::setTargetTempBluTrv(float temp) {
+    const char* body = pollArena.format("{\"id\":1, \"method\":\"Thermostat.SetTargetTemp\", \"params\":{\"id\":%d, \"target_C\":%.2f}}", channelIndex, temp);
+    const char* url = pollArena.format("http://%s/rpc", ip.c_str());
+    LOG_DEBUG("Shelly/BLU_TRV [%s]: RPC set target temp -> %s body=%s", id.c_str(), url, body);
+    HttpView r = httpPost(pollArena, url, body);
+    if (!rpcAccepted(r)) {
+        LOG_ERROR("Shelly/BLU_TRV [%s]: RPC set target temp failed code=%d resp=%s", id.c_str(), r.code, r.payload);
+        return false;
     }
-    targetTemp = temp;
+    // Only mirror the new setpoint once the gateway accepted it
+    states->targetTemp[slot] = temp;
+    return true;
 }
 
-void ShellyBluTrv::update() {
-    String body = "{\"id\":1, \"method\":\"Thermostat.GetStatus\", \"params\":{\"id\":" + String(componentId) + "}}";
-    String url = "http://" + ip + "/rpc";
-    SysLog.debug(String("Shelly/BLU_TRV [") + id + "]: RPC get status -> " + url + " body=" + body);
-    HttpResult r = httpPost(url, body);
+void ShellyDevice::updateBluTrv() {
+    const char* body = pollArena.format("{\"id\":1, \"method\":\"Thermostat.GetStatus\", \"params\":{\"id\":%d}}", channelIndex);
+    const char* url = pollArena.format("http://%s/rpc", ip.c_str());
+    LOG_DEBUG("Shelly/BLU_TRV [%s]: RPC get status -> %s body=%s", id.c_str(), url, body);
+    HttpView r = httpPost(pollArena, url, body);
 
-    if (r.code <= 0) { SysLog.error(String("Shelly/BLU_TRV [") + id + "]: empty /rpc response"); isOnline = false; return; }
+    if (r.code <= 0) { LOG_ERROR("Shelly/BLU_TRV [%s]: empty /rpc response", id.c_str()); setOnline(false); return; }
 
-    JsonDocument doc;
-    if (!deserializeJson(doc, r.payload) && !doc["result"].isNull()) {
-        isOnline = true;
-        currentTemp = doc["result"]["current_C"];
-        targetTemp = doc["result"]["target_C"];
+    JsonDocument doc(pollArena.json());
+    if (!deserializeJson(doc, r.payload, r.length) && !doc["result"].isNull()) {
+        setOnline(true);
+        states->currentTemp[slot] = doc["result"]["current_C"].as<float>();
+        states->targetTemp[slot] = doc["result"]["target_C"].as<float>();
+        if (!doc["result"]["pos"].isNull()) states->valvePos[slot] = doc["result"]["pos"].as<float>();
     } else {
-        SysLog.error(String("Shelly/BLU_TRV [") + id + "]: RPC parse error or missing result");
-        isOnline = false;
+        LOG_ERROR("Shelly/BLU_TRV [%s]: RPC parse error or missing result", id.c_str());
+        setOnline(false);
     }
 }
 
-void ShellyBluTrv::fetchMetadata() {}
\ No newline at end of file
+// Shelly.GetStatus result of the gateway: TRVs show up as "blutrv:<id>" (current_C,
+// target_C, pos) and/or as a "thermostat:<id>" component (current_C, target_C).
+void ShellyDevice::applyStatusBluTrv(JsonVariantConst status) {
+    char key[24];
+    snprintf(key, sizeof(key), "blutrv:%d", channelIndex);
+    JsonVariantConst trv = status[key];
+    snprintf(key, sizeof(key), "thermostat:%d", channelIndex);
+    JsonVariantConst th = status[key];
+    if (trv.isNull() && th.isNull()) {
+        LOG_ERROR("Shelly/BLU_TRV [%s]: component not found in gateway status", id.c_str());
+        setOnline(false);
+        return;
+    }
+
+    JsonVariantConst src = trv.isNull() ? th : trv;
+    setOnline(true);
+    states->currentTemp[slot] = src["current_C"] | getCurrentTemp();
+    states->targetTemp[slot] = src["target_C"] | getTargetTemp();
+    if (!trv.isNull() && !trv["pos"].isNull()) {
+        states->valvePos[slot] = trv["pos"].as<float>();
+    } else if (!th.isNull() && !th["pos"].isNull()) {
+        states->valvePos[slot] = th["pos"].as<float>();
+    }
+
+    LOG_DEBUG("Shelly/BLU_TRV [%s]: Cur=%.2f Tgt=%.2f Pos=%.2f", id.c_str(), getCurrentTemp(), getTargetTemp(), getValvePos());
+}
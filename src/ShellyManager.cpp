@@ -1,26 +1,80 @@
 #include "ShellyManager.h"
 #include "NetworkUtils.h"
+#include "JsonAllocator.h"
+#include "Arena.h"
 #include "LogManager.h"
+#include "ConfigManager.h"
 #include <SD.h>
+#include <algorithm>
 #include <ArduinoJson.h>
 
-ShellyManager::ShellyManager(AppConfig* config) : config(config) {}
+ShellyManager::ShellyManager(AppConfig* config) : config(config) {
+    pool.reserve(POOL_RESERVE);
+    states.reserve(POOL_RESERVE);
+}
+
+ShellyDevice* ShellyManager::addDevice(DeviceType type, const String& ip, const String& id, int channel,
+                                       DeviceRole role, int priority, int phase) {
+    if (type != DeviceType::SHELLY_GEN1 && type != DeviceType::SHELLY_GEN2 && type != DeviceType::SHELLY_BLU_TRV) {
+        return nullptr;
+    }
+    uint16_t slot = states.add(role, priority);
+    states.phase[slot] = phase;
+    pool.emplace_back(type, ip, id, channel, &states, slot);
+    slots[id] = slot;
+    rebuildPollIndexes();
+    return &pool[slot];
+}
+
+// Which devices each poll covers. Changes only with discovery or the meter config.
+void ShellyManager::rebuildPollIndexes() {
+    meterSlots.assign(meterPhaseIds.size(), -1);
+    for (size_t i = 0; i < meterPhaseIds.size(); i++) {
+        auto it = slots.find(meterPhaseIds[i]);
+        if (it != slots.end()) meterSlots[i] = it->second;
+    }
+
+    singleSlots.clear();
+    gatewayTrvSlots.clear();
+    for (const ShellyDevice& dev : pool) {
+        uint16_t slot = dev.getSlot();
+        if (dev.getType() == DeviceType::SHELLY_BLU_TRV) {
+            gatewayTrvSlots.push_back(slot);
+        } else if (std::find(meterSlots.begin(), meterSlots.end(), (int)slot) == meterSlots.end()) {
+            singleSlots.push_back(slot);
+        }
+    }
+}
 
 void ShellyManager::begin() {
     for (auto& kv : config->devices) {
         DeviceConfig& cfg = kv.second;
         if (cfg.ip.length() > 0) {
             if (cfg.type == DeviceType::SHELLY_BLU_TRV) {
-                 ShellyDevice* dev = ShellyDevice::create(cfg.type, cfg.ip, cfg.id, 200, cfg.role, cfg.priority); 
-                 if (dev) devices[cfg.id] = dev;
+                 addDevice(cfg.type, cfg.ip, cfg.id, 200, cfg.role, cfg.priority, cfg.phase);
                 String typeStr = (cfg.type == DeviceType::SHELLY_GEN2) ? "GEN2" : (cfg.type == DeviceType::SHELLY_BLU_TRV) ? "BLU_TRV" : "GEN1";
                 SysLog.log(String("ShellyManager: added static device Shelly/") + typeStr + " [" + cfg.id + "]");
             }
         }
     }
+    configureMeterGroup();
     SysLog.log("ShellyManager: begin completed");
 }
 
+void ShellyManager::configureMeterGroup() {
+    meterPhaseIds.clear();
+    const EnergyConfig& e = config->energy;
+    if (!e.main_meter_phases.empty()) {
+        for (const auto& mp : e.main_meter_phases) meterPhaseIds.push_back(mp.id);
+    } else if (e.main_meter_id.length() > 0) {
+        meterPhaseIds.push_back(e.main_meter_id);
+    }
+    phasePower.assign(meterPhaseIds.size(), 0.0f);
+    meterTotalPower = 0.0f;
+    rebuildPollIndexes();
+    SysLog.log(String("ShellyManager: main meter group has ") + String((int)meterPhaseIds.size()) + " phase(s)");
+}
+
 void ShellyManager::update() {
     unsigned long now = millis();
     
@@ -30,13 +84,115 @@ void ShellyManager::update() {
     }
     
     if (now - lastUpdate > 1000) {
-        for (auto& kv : devices) {
-            kv.second->update();
+        // Meter channels and BLU TRVs are refreshed by the shared polls below
+        for (uint16_t slot : singleSlots) {
+            pool[slot].update();
+        }
+        pollMeterGroup();
+        pollTrvGateways();
+
+        // Integrate energy once per poll so buckets see every fresh reading
+        if (energyMeter) {
+            for (const ShellyDevice& dev : pool) {
+                uint16_t i = dev.getSlot();
+                energyMeter->addSample(dev.getId(), states.power[i], states.isOnline[i], now);
+            }
         }
+        pollCount++;
         lastUpdate = now;
     }
 }
 
+// Refresh every phase channel of the main meter with one status request per meter IP
+// (a 3EM exposes MAC_0..2 on the same IP), then cache per-phase and aggregate power.
+void ShellyManager::pollMeterGroup() {
+    std::vector<ShellyDevice*>& phaseDevs = scratchDevices;
+    phaseDevs.assign(meterSlots.size(), nullptr);
+    for (size_t i = 0; i < meterSlots.size(); i++) {
+        if (meterSlots[i] >= 0) phaseDevs[i] = &pool[meterSlots[i]];
+    }
+
+    std::vector<bool>& polled = scratchPolled;
+    polled.assign(phaseDevs.size(), false);
+    for (size_t i = 0; i < phaseDevs.size(); i++) {
+        ShellyDevice* first = phaseDevs[i];
+        if (!first || polled[i]) continue;
+
+        JsonDocument doc(pollArena.json());
+        JsonVariantConst status;
+        bool ok = fetchSharedStatus(first->getIp(), first->getType(), doc, status);
+
+        for (size_t j = i; j < phaseDevs.size(); j++) {
+            ShellyDevice* dev = phaseDevs[j];
+            if (!dev || polled[j] || dev->getIp() != first->getIp()) continue;
+            if (ok) dev->applyStatus(status);
+            else dev->markOffline();
+            polled[j] = true;
+        }
+    }
+
+    float total = 0.0f;
+    for (size_t i = 0; i < phaseDevs.size(); i++) {
+        phasePower[i] = (phaseDevs[i] && phaseDevs[i]->getIsOnline()) ? phaseDevs[i]->getPower() : 0.0f;
+        total += phasePower[i];
+    }
+    meterTotalPower = total;
+}
+
+bool ShellyManager::fetchSharedStatus(const String& ip, DeviceType type, JsonDocument& doc, JsonVariantConst& status) {
+    HttpView r;
+    if (type == DeviceType::SHELLY_GEN1) {
+        r = httpGet(pollArena, pollArena.format("http://%s/status", ip.c_str()));
+    } else {
+        r = httpPost(pollArena, pollArena.format("http://%s/rpc", ip.c_str()), "{\"id\":1, \"method\":\"Shelly.GetStatus\"}");
+    }
+
+    if (r.code <= 0 || r.length == 0 || deserializeJson(doc, r.payload, r.length)) {
+        LOG_ERROR("ShellyManager: shared status poll failed for %s code=%d", ip.c_str(), r.code);
+        return false;
+    }
+
+    status = (type == DeviceType::SHELLY_GEN1) ? doc.as<JsonVariantConst>() : doc["result"].as<JsonVariantConst>();
+    if (status.isNull()) {
+        LOG_ERROR("ShellyManager: shared status from %s has no result", ip.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Group BLU TRVs by gateway IP: six TRVs behind one gateway cost one Shelly.GetStatus
+// round trip per poll instead of six Thermostat.GetStatus calls.
+void ShellyManager::pollTrvGateways() {
+    std::vector<ShellyDevice*>& trvs = scratchDevices;
+    trvs.clear();
+    for (uint16_t slot : gatewayTrvSlots) {
+        trvs.push_back(&pool[slot]);
+    }
+
+    std::vector<bool>& polled = scratchPolled;
+    polled.assign(trvs.size(), false);
+    for (size_t i = 0; i < trvs.size(); i++) {
+        if (polled[i]) continue;
+        const String& gatewayIp = trvs[i]->getIp();
+
+        JsonDocument doc(pollArena.json());
+        JsonVariantConst status;
+        bool ok = fetchSharedStatus(gatewayIp, DeviceType::SHELLY_BLU_TRV, doc, status);
+
+        for (size_t j = i; j < trvs.size(); j++) {
+            if (polled[j] || trvs[j]->getIp() != gatewayIp) continue;
+            if (ok) trvs[j]->applyStatus(status);
+            else trvs[j]->markOffline();
+            polled[j] = true;
+        }
+    }
+}
+
+float ShellyManager::getPhasePower(int phase) const {
+    if (phase < 0 || phase >= (int)phasePower.size()) return 0.0f;
+    return phasePower[phase];
+}
+
 void ShellyManager::discoverDevices() {
     SysLog.log("ShellyManager: starting mDNS discovery");
     
@@ -72,12 +228,11 @@ void ShellyManager::processDiscoveredService(String ip, String hostname) {
     // Use the /shelly endpoint which is common to Gen2 and supported by many Gen1 devices (returns type/mac).
     // If it's Gen2, the JSON contains a "gen" field (2 or greater).
     
-    String url = "http://" + ip + "/shelly";
-    HttpResult r = httpGet(url);
+    HttpView r = httpGet(pollArena, pollArena.format("http://%s/shelly", ip.c_str()));
     if (r.code <= 0) return;
 
-    JsonDocument doc;
-    if (deserializeJson(doc, r.payload)) return;
+    JsonDocument doc(pollArena.json());
+    if (deserializeJson(doc, r.payload, r.length)) return;
 
     String mac = "";
     int generation = 1; // Default Gen1
@@ -115,31 +270,31 @@ void ShellyManager::processDiscoveredService(String ip, String hostname) {
     for (int ch = 0; ch < channels; ch++) {
         String id = mac + "_" + String(ch);
         
-        if (devices.find(id) == devices.end()) {
+        if (slots.find(id) == slots.end()) {
             DeviceRole role = DeviceRole::UNKNOWN;
             int priority = 0;
+            int phase = -1;
             
             if (config->devices.find(id) != config->devices.end()) {
                 role = config->devices[id].role;
                 priority = config->devices[id].priority;
+                phase = config->devices[id].phase;
                 config->devices[id].ip = ip; 
             }
             
             DeviceType dtype = (generation >= 2) ? DeviceType::SHELLY_GEN2 : DeviceType::SHELLY_GEN1;
 
-            ShellyDevice* dev = ShellyDevice::create(dtype, ip, id, ch, role, priority);
+            ShellyDevice* dev = addDevice(dtype, ip, id, ch, role, priority, phase);
             
             if (dev) {
                 dev->fetchMetadata(); 
-                devices[id] = dev;
                 
                 String typeStr = (generation >= 2) ? "GEN2" : "GEN1";
                 String logMsg = String("ShellyManager: added Shelly/") + typeStr + " [" + id + "] name=\"" + dev->getName() + "\"";
                 SysLog.log(logMsg);
                 
-                if (config->devices[id].name.length() == 0) {
-                    config->devices[id].name = dev->getName();
-                }
+                DeviceConfig& cfg = configFor(id);
+                if (cfg.name.length() == 0) cfg.name = dev->getName();
             }
         }
     }
@@ -147,11 +302,10 @@ void ShellyManager::processDiscoveredService(String ip, String hostname) {
 
 // Legacy helper: get MAC from /status for Gen1 devices
 String ShellyManager::getMacFromIp(String ip) {
-    String url = "http://" + ip + "/status";
-    HttpResult r = httpGet(url);
+    HttpView r = httpGet(pollArena, pollArena.format("http://%s/status", ip.c_str()));
     if (r.code <= 0) return "";
-    JsonDocument doc;
-    if (deserializeJson(doc, r.payload)) return "";
+    JsonDocument doc(pollArena.json());
+    if (deserializeJson(doc, r.payload, r.length)) return "";
     if (!doc["mac"].isNull()) return doc["mac"].as<String>();
     if (!doc["device"].isNull() && !doc["device"]["mac"].isNull()) return doc["device"]["mac"].as<String>();
     if (!doc["wifi_sta"].isNull() && !doc["wifi_sta"]["mac"].isNull()) return doc["wifi_sta"]["mac"].as<String>();
@@ -160,11 +314,10 @@ String ShellyManager::getMacFromIp(String ip) {
 
 // Helper: count channels on Gen1 (using /status)
 int ShellyManager::getChannelCountGen1(String ip) {
-    String url = "http://" + ip + "/status";
-    HttpResult r = httpGet(url);
+    HttpView r = httpGet(pollArena, pollArena.format("http://%s/status", ip.c_str()));
     if (r.code <= 0) return 1; 
-    JsonDocument doc;
-    if (deserializeJson(doc, r.payload)) return 1;
+    JsonDocument doc(pollArena.json());
+    if (deserializeJson(doc, r.payload, r.length)) return 1;
 
     // Check roller mode
     if (!doc["rollers"].isNull()) return 1;
@@ -186,19 +339,19 @@ int ShellyManager::getChannelCountGen1(String ip) {
 int ShellyManager::getChannelCountGen2(String ip) {
     // Use Shelly.GetConfig to see how many 'switch' components are configured.
     // Alternative: call Switch.GetConfig for id=0,1,2,... until failure, but Shelly.GetConfig is a single call.
-    String body = "{\"id\":1, \"method\":\"Shelly.GetConfig\"}";
-    String url = "http://" + ip + "/rpc";
-    HttpResult r = httpPost(url, body);
+    HttpView r = httpPost(pollArena, pollArena.format("http://%s/rpc", ip.c_str()), "{\"id\":1, \"method\":\"Shelly.GetConfig\"}");
     
     if (r.code != 200) return 1; // Fallback
 
-    JsonDocument doc;
-    // Increase capacity if the config JSON is very large (Shelly Pro 4PM)
-    if (deserializeJson(doc, r.payload)) return 1;
+    // A Pro 4PM config is several KB: it may spill out of the arena block, which is fine
+    JsonDocument doc(pollArena.json());
+    if (deserializeJson(doc, r.payload, r.length)) return 1;
 
     if (doc["result"].isNull()) return 1;
 
     int switchCount = 0;
+    int emCount = 0;
+    bool triphase = false;
     JsonObject result = doc["result"].as<JsonObject>();
     
     // Iterate keys to find "switch:0", "switch:1", etc.
@@ -206,9 +359,17 @@ int ShellyManager::getChannelCountGen2(String ip) {
         String key = String(kv.key().c_str());
         if (key.startsWith("switch:")) {
             switchCount++;
+        } else if (key.startsWith("em1:")) {
+            emCount++;
+        } else if (key == "em:0") {
+            triphase = true;
         }
     }
 
+    // Meter-only devices: one channel per em1 component, or one per phase for a triphase Pro 3EM
+    if (switchCount == 0 && emCount > 0) return emCount;
+    if (switchCount == 0 && triphase) return 3;
+
     // If no switches found, it might be a cover device (e.g. Shelly Plus 2PM in cover mode).
     // To support covers, look for keys like "cover:0". For now return switchCount.
     return (switchCount > 0) ? switchCount : 1;
@@ -219,29 +380,20 @@ int ShellyManager::getChannelCount(String ip) {
     return getChannelCountGen1(ip); 
 }
 
-ShellyDevice* ShellyManager::getDevice(String id) {
-    if (devices.find(id) != devices.end()) return devices[id];
-    return nullptr;
+ShellyDevice* ShellyManager::getDevice(const String& id) {
+    auto it = slots.find(id);
+    return it != slots.end() ? &pool[it->second] : nullptr;
 }
 
-std::vector<ShellyDevice*> ShellyManager::getAllDevices() {
-    std::vector<ShellyDevice*> list;
-    for (auto& kv : devices) {
-        list.push_back(kv.second);
-    }
-    return list;
-}
-
-float ShellyManager::getTotalPower(String mainMeterId) {
-    if (devices.find(mainMeterId) != devices.end()) {
-        return devices[mainMeterId]->getPower();
-    }
-    return 0.0f;
+DeviceConfig& ShellyManager::configFor(const String& id) {
+    auto it = config->devices.find(id);
+    if (it == config->devices.end()) it = config->devices.emplace(id, ConfigManager::makeDevice(id)).first;
+    return it->second;
 }
 
 void ShellyManager::syncConfig() {
-    for (auto& kv : devices) {
-        config->devices[kv.first].name = kv.second->getName();
+    for (const ShellyDevice& dev : pool) {
+        configFor(dev.getId()).name = dev.getName();
     }
 }
 
@@ -252,11 +404,11 @@ bool ShellyManager::saveDiscoveredDevices(const String& path) {
     File f = SD.open(path.c_str(), FILE_WRITE);
     if (!f) return false;
 
-    JsonDocument doc;
+    JsonDocument doc(psramJsonAllocator());
     JsonArray arr = doc.to<JsonArray>();
 
-    for (auto &kv : devices) {
-        ShellyDevice* dev = kv.second;
+    for (auto &kv : slots) {
+        const ShellyDevice* dev = &pool[kv.second];
         JsonObject obj = arr.add<JsonObject>();
         obj["id"] = dev->getId();
         obj["ip"] = dev->getIp();
@@ -1,11 +1,22 @@
 #include "ThermostatChart.h"
 #include "ui/screens.h"
 #include "RoomDataManager.h"
+#include "LogManager.h"
+#include <esp_heap_caps.h>
 #include <stdio.h>
+#include <math.h>
 
 // Buffer per formattare i tick
 static char tickBuffer[16];
 
+// Etichetta "tempo fa" per l'asse X (es. -45m, -12h, -3g)
+static void formatAgo(char* buf, size_t len, uint32_t secondsAgo, uint32_t span) {
+    if (secondsAgo == 0) lv_snprintf(buf, len, "ora");
+    else if (span <= 2UL * 3600UL) lv_snprintf(buf, len, "-%um", (unsigned)((secondsAgo + 30) / 60));
+    else if (span <= 2UL * 86400UL) lv_snprintf(buf, len, "-%uh", (unsigned)((secondsAgo + 1800) / 3600));
+    else lv_snprintf(buf, len, "-%ug", (unsigned)((secondsAgo + 43200) / 86400));
+}
+
 // Callback per formattare i tick degli assi
 static void format_chart_ticks(lv_event_t* e) {
     lv_obj_draw_part_dsc_t* dsc = lv_event_get_draw_part_dsc(e);
@@ -23,13 +34,118 @@ static void format_chart_ticks(lv_event_t* e) {
         dsc->text = tickBuffer;
     }
     else if(dsc->id == LV_CHART_AXIS_PRIMARY_X) {
-        // Asse X: minuti (0m, 5m, 10m...)
-        lv_snprintf(tickBuffer, sizeof(tickBuffer), "%dm", (int)dsc->value);
+        uint32_t span = thermostatChart.getSpanSeconds();
+        if (thermostatChart.getView() == ThermostatChart::VIEW_LIVE) {
+            // Grafico a linee circolare: value = indice del major tick (0..6), cade sul punto
+            // value*5. Il punto più recente si sposta lungo l'asse, l'età di ogni punto
+            // si conta da lui (il separatore dopo di lui è il limite più vecchio).
+            int newest = thermostatChart.getLiveNewest();
+            if (newest < 0) {
+                formatAgo(tickBuffer, sizeof(tickBuffer), span - (uint32_t)dsc->value * 300, span);
+            } else {
+                uint32_t slot = (uint32_t)dsc->value * ((ROOM_CHART_POINTS - 1) / 6);
+                uint32_t age = (newest + ROOM_CHART_POINTS - slot) % ROOM_CHART_POINTS;
+                formatAgo(tickBuffer, sizeof(tickBuffer), age * 60, span);
+            }
+        } else {
+            // Scatter: value = secondi dall'inizio finestra
+            uint32_t now = 0;
+            RoomDataManager::getEpochSeconds(now);
+            uint32_t end = thermostatChart.getViewEnd() ? thermostatChart.getViewEnd() : now;
+            uint32_t offset = (now > end) ? now - end : 0;
+            formatAgo(tickBuffer, sizeof(tickBuffer), offset + span - (uint32_t)dsc->value, span);
+        }
         dsc->text = tickBuffer;
     }
 }
 
-ThermostatChart::ThermostatChart() : chartObj(nullptr) {
+// Largest-Triangle-Three-Buckets: riduce n punti a `threshold` conservando picchi e forma.
+// O(n), un solo passaggio; tempi relativi al primo punto per la precisione dei float.
+static size_t lttb(const SeriesPoint* in, size_t n, size_t threshold, SeriesPoint* out) {
+    if (threshold >= n || threshold < 3) {
+        memcpy(out, in, n * sizeof(SeriesPoint));
+        return n;
+    }
+    
+    uint32_t t0 = in[0].time;
+    float every = (float)(n - 2) / (float)(threshold - 2);
+    size_t a = 0;
+    size_t k = 0;
+    out[k++] = in[0];
+    
+    for (size_t i = 0; i < threshold - 2; i++) {
+        // Media del bucket successivo (terzo vertice del triangolo)
+        size_t avgStart = (size_t)((i + 1) * every) + 1;
+        size_t avgEnd = (size_t)((i + 2) * every) + 1;
+        if (avgEnd > n) avgEnd = n;
+        float avgX = 0.0f, avgY = 0.0f;
+        size_t avgLen = avgEnd - avgStart;
+        if (avgLen == 0) {
+            avgX = (float)(in[n - 1].time - t0);
+            avgY = in[n - 1].avg;
+        } else {
+            for (size_t j = avgStart; j < avgEnd; j++) {
+                avgX += (float)(in[j].time - t0);
+                avgY += in[j].avg;
+            }
+            avgX /= avgLen;
+            avgY /= avgLen;
+        }
+        
+        // Nel bucket corrente, il punto che forma il triangolo più grande
+        size_t rangeStart = (size_t)(i * every) + 1;
+        size_t rangeEnd = (size_t)((i + 1) * every) + 1;
+        float ax = (float)(in[a].time - t0);
+        float ay = in[a].avg;
+        float maxArea = -1.0f;
+        size_t next = rangeStart;
+        for (size_t j = rangeStart; j < rangeEnd; j++) {
+            float area = fabsf((ax - avgX) * (in[j].avg - ay) - (ax - (float)(in[j].time - t0)) * (avgY - ay));
+            if (area > maxArea) {
+                maxArea = area;
+                next = j;
+            }
+        }
+        out[k++] = in[next];
+        a = next;
+    }
+    
+    out[k++] = in[n - 1];
+    return k;
+}
+
+ThermostatChart::ThermostatChart()
+    : chartObj(nullptr), viewSelector(nullptr), series(nullptr), boundRoom(nullptr), boundSeq(0),
+      view(VIEW_LIVE), viewEnd(0), renderedUntil(0), renderedStep(0), yMin(180), yMax(210),
+      queryBuf(nullptr), drawBuf(nullptr), xPoints(nullptr), yPoints(nullptr) {
+}
+
+bool ThermostatChart::allocBuffers() {
+    if (queryBuf) return true;
+    queryBuf = (SeriesPoint*)heap_caps_malloc(QUERY_MAX * sizeof(SeriesPoint), MALLOC_CAP_SPIRAM);
+    drawBuf = (SeriesPoint*)heap_caps_malloc(DRAW_MAX * sizeof(SeriesPoint), MALLOC_CAP_SPIRAM);
+    xPoints = (lv_coord_t*)heap_caps_malloc(DRAW_MAX * sizeof(lv_coord_t), MALLOC_CAP_SPIRAM);
+    yPoints = (lv_coord_t*)heap_caps_malloc(DRAW_MAX * sizeof(lv_coord_t), MALLOC_CAP_SPIRAM);
+    if (!queryBuf || !drawBuf || !xPoints || !yPoints) {
+        SysLog.error("ThermostatChart: failed to allocate chart buffers");
+        heap_caps_free(queryBuf);
+        heap_caps_free(drawBuf);
+        heap_caps_free(xPoints);
+        heap_caps_free(yPoints);
+        queryBuf = drawBuf = nullptr;
+        xPoints = yPoints = nullptr;
+        return false;
+    }
+    return true;
+}
+
+uint32_t ThermostatChart::getSpanSeconds() const {
+    switch (view) {
+        case VIEW_1H: return 3600UL;
+        case VIEW_24H: return 24UL * 3600UL;
+        case VIEW_7D: return 7UL * 86400UL;
+        default: return ROOM_HISTORY_WINDOW_MIN * 60UL;
+    }
 }
 
 void ThermostatChart::init() {
@@ -38,28 +154,33 @@ void ThermostatChart::init() {
     
     // 1. Configurazione base del grafico
     lv_chart_set_type(chartObj, LV_CHART_TYPE_LINE);
-    lv_chart_set_point_count(chartObj, 30);  // Finestra di 30 minuti
+    lv_chart_set_point_count(chartObj, ROOM_CHART_POINTS);  // Finestra di 30 minuti + separatore
+    // Circolare: i punti restano fermi, un nuovo punto invalida solo la sua zona
+    lv_chart_set_update_mode(chartObj, LV_CHART_UPDATE_MODE_CIRCULAR);
     
-    // 2. Configurazione Range Asse Y (18.0°C - 21.0°C)
+    // 2. Configurazione Range Asse Y: iniziale 18.0°C - 21.0°C, poi segue i dati (applyYRange)
     // I valori sono in decimi di grado (180 - 210)
-    lv_chart_set_range(chartObj, LV_CHART_AXIS_PRIMARY_Y, 180, 210);
+    yMin = 180;
+    yMax = 210;
+    lv_chart_set_range(chartObj, LV_CHART_AXIS_PRIMARY_Y, yMin, yMax);
     
     // 3. Configurazione Griglia
     // 5 linee orizzontali (divisioni Y), 6 linee verticali (divisioni X)
     lv_chart_set_div_line_count(chartObj, 5, 6);
     
     // 4. Configurazione Tick Assi
-    // Asse Y: 7 major ticks (18.0, 18.5, 19.0, 19.5, 20.0, 20.5, 21.0)
+    // Asse Y: 7 major ticks (es. 18.0, 18.5, 19.0, 19.5, 20.0, 20.5, 21.0)
     lv_chart_set_axis_tick(chartObj, LV_CHART_AXIS_PRIMARY_Y, 10, 5, 7, 2, true, 50);
     
-    // Asse X: 7 major ticks (0, 5, 10, 15, 20, 25, 30)
+    // Asse X: 7 major ticks (tempo fa, es. -30m ... ora)
     lv_chart_set_axis_tick(chartObj, LV_CHART_AXIS_PRIMARY_X, 10, 5, 7, 2, true, 40);
     
     // 5. Configurazione Serie Dati
-    lv_chart_series_t* series = lv_chart_get_series_next(chartObj, NULL);
+    series = lv_chart_get_series_next(chartObj, NULL);
     if (!series) {
         series = lv_chart_add_series(chartObj, lv_palette_main(LV_PALETTE_RED), LV_CHART_AXIS_PRIMARY_Y);
     }
+    boundRoom = nullptr;
     
     // 6. Stile
     lv_obj_set_style_line_width(chartObj, 3, LV_PART_ITEMS);
@@ -74,6 +195,180 @@ void ThermostatChart::init() {
     // Rimuovi eventuali callback precedenti per evitare duplicati se init viene richiamata
     lv_obj_remove_event_cb(chartObj, format_chart_ticks);
     lv_obj_add_event_cb(chartObj, format_chart_ticks, LV_EVENT_DRAW_PART_BEGIN, NULL);
+    
+    // Trascinamento orizzontale = pan nelle viste lunghe
+    lv_obj_add_flag(chartObj, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_clear_flag(chartObj, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_remove_event_cb(chartObj, onChartPressing);
+    lv_obj_add_event_cb(chartObj, onChartPressing, LV_EVENT_PRESSING, this);
+    
+    // 8. Selettore vista (creato qui: lo screen è generato da EEZ)
+    if (!viewSelector) {
+        static const char* viewMap[] = {"30 min", "1 ora", "24 ore", "7 giorni", ""};
+        viewSelector = lv_btnmatrix_create(lv_obj_get_parent(chartObj));
+        lv_btnmatrix_set_map(viewSelector, viewMap);
+        lv_btnmatrix_set_btn_ctrl_all(viewSelector, LV_BTNMATRIX_CTRL_CHECKABLE);
+        lv_btnmatrix_set_one_checked(viewSelector, true);
+        lv_btnmatrix_set_btn_ctrl(viewSelector, view, LV_BTNMATRIX_CTRL_CHECKED);
+        lv_obj_set_size(viewSelector, 420, 50);
+        lv_obj_align_to(viewSelector, chartObj, LV_ALIGN_OUT_TOP_RIGHT, 0, -5);
+        lv_obj_add_event_cb(viewSelector, onViewChanged, LV_EVENT_VALUE_CHANGED, this);
+    }
+    
+    allocBuffers();
+}
+
+int ThermostatChart::getLiveNewest() const {
+    if (view != VIEW_LIVE || !boundRoom) return -1;
+    return (boundRoom->traceHead + ROOM_CHART_POINTS - 1) % ROOM_CHART_POINTS;
+}
+
+// Fascia delle etichette X sotto l'area dati: nella vista live cambiano a ogni punto
+// nuovo, il resto del grafico no
+void ThermostatChart::invalidateXTicks() {
+    lv_area_t a;
+    lv_obj_get_coords(chartObj, &a);
+    lv_coord_t ext = _lv_obj_get_ext_draw_size(chartObj);
+    a.x1 -= ext;
+    a.x2 += ext;
+    a.y1 = a.y2;
+    a.y2 += ext;
+    lv_obj_invalidate_area(chartObj, &a);
+}
+
+// Il range cresce subito se i dati escono, si restringe solo se i dati ne occupano
+// meno della metà: niente salti dell'asse a ogni aggiornamento.
+void ThermostatChart::applyYRange(lv_coord_t dataMin, lv_coord_t dataMax) {
+    if (dataMin > dataMax) return;  // Nessun dato
+    
+    bool inside = dataMin >= yMin && dataMax <= yMax;
+    if (inside && (dataMax - dataMin) * 2 >= (yMax - yMin) - 10) return;
+    
+    // Griglia di 0.5°C con almeno 0.5°C di margine, ampiezza minima 3°C
+    lv_coord_t lo = (lv_coord_t)(floorf((dataMin - 5) / 5.0f) * 5);
+    lv_coord_t hi = (lv_coord_t)(ceilf((dataMax + 5) / 5.0f) * 5);
+    if (hi - lo < 30) {
+        lv_coord_t mid = (lo + hi) / 2;
+        lo = (lv_coord_t)(floorf((mid - 15) / 5.0f) * 5);
+        hi = lo + 30;
+    }
+    if (lo == yMin && hi == yMax) return;
+    yMin = lo;
+    yMax = hi;
+    lv_chart_set_range(chartObj, LV_CHART_AXIS_PRIMARY_Y, yMin, yMax);
+}
+
+void ThermostatChart::bindLive(RoomData* room) {
+    lv_chart_set_type(chartObj, LV_CHART_TYPE_LINE);
+    lv_chart_set_update_mode(chartObj, LV_CHART_UPDATE_MODE_CIRCULAR);
+    lv_chart_set_ext_y_array(chartObj, series, room->chartTrace);
+    lv_chart_set_point_count(chartObj, ROOM_CHART_POINTS);
+    
+    lv_coord_t lo = LV_COORD_MAX, hi = LV_COORD_MIN;
+    for (auto v : room->chartTrace) {
+        if (v == LV_CHART_POINT_NONE) continue;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+    applyYRange(lo, hi);
+    
+    boundRoom = room;
+    boundSeq = room->traceSeq;
+    lv_chart_refresh(chartObj);
+}
+
+// Finestra lunga: livello più grossolano che riempie la larghezza, LTTB a una densità
+// proporzionale ai pixel, punti posizionati per tempo (scatter) così i buchi restano buchi.
+void ThermostatChart::renderRange(RoomData* room) {
+    unsigned long t0 = micros();
+    boundRoom = room;
+    
+    uint32_t now;
+    TimeSeries* ts = room->series;
+    if (!allocBuffers() || !ts || ts->empty() || !RoomDataManager::getEpochSeconds(now)) {
+        lv_chart_set_point_count(chartObj, 0);
+        lv_chart_refresh(chartObj);
+        return;
+    }
+    
+    uint32_t span = getSpanSeconds();
+    uint32_t end = viewEnd ? viewEnd : now;
+    uint32_t from = end - span;
+    
+    size_t width = (size_t)lv_obj_get_content_width(chartObj);
+    size_t target = width / PX_PER_POINT;
+    if (target < 3) target = 3;
+    if (target > DRAW_MAX) target = DRAW_MAX;
+    
+    TimeSeries::Tier tier = ts->pickTier(from, end, target);
+    size_t n = ts->read(tier, from, end, queryBuf, QUERY_MAX);
+    renderedUntil = ts->lastTime();
+    renderedStep = TimeSeries::tierSeconds(tier);
+    if (renderedStep < 60) renderedStep = 60;  // Al massimo un ridisegno al minuto
+    
+    // Range Y dai min/max di livello: include i picchi che LTTB potrebbe scartare
+    float lo = INFINITY, hi = -INFINITY;
+    for (size_t i = 0; i < n; i++) {
+        if (queryBuf[i].min < lo) lo = queryBuf[i].min;
+        if (queryBuf[i].max > hi) hi = queryBuf[i].max;
+    }
+    
+    size_t k = lttb(queryBuf, n, target, drawBuf);
+    for (size_t i = 0; i < k; i++) {
+        xPoints[i] = (lv_coord_t)(drawBuf[i].time - from);
+        yPoints[i] = (lv_coord_t)lroundf(drawBuf[i].avg * 10.0f);
+    }
+    
+    lv_chart_set_type(chartObj, LV_CHART_TYPE_SCATTER);
+    lv_chart_set_range(chartObj, LV_CHART_AXIS_PRIMARY_X, 0, (lv_coord_t)span);
+    lv_chart_set_ext_x_array(chartObj, series, xPoints);
+    lv_chart_set_ext_y_array(chartObj, series, yPoints);
+    lv_chart_set_point_count(chartObj, (uint16_t)k);
+    if (n > 0) applyYRange((lv_coord_t)floorf(lo * 10.0f), (lv_coord_t)ceilf(hi * 10.0f));
+    lv_chart_refresh(chartObj);
+    
+    unsigned long elapsed = micros() - t0;
+    if (elapsed > 16000) {
+        LOG_DEBUG("ThermostatChart: render took %lu us (%u -> %u points)", elapsed, (unsigned)n, (unsigned)k);
+    }
+}
+
+void ThermostatChart::setView(View v) {
+    if (v >= VIEW_COUNT) return;
+    view = v;
+    viewEnd = 0;
+    boundRoom = nullptr;  // Forza il ricollegamento/ridisegno
+    updateForRoom(roomDataManager.getCurrentRoomIndex());
+}
+
+void ThermostatChart::onViewChanged(lv_event_t* e) {
+    ThermostatChart* self = (ThermostatChart*)lv_event_get_user_data(e);
+    uint16_t sel = lv_btnmatrix_get_selected_btn(self->viewSelector);
+    if (sel < VIEW_COUNT) self->setView((View)sel);
+}
+
+void ThermostatChart::onChartPressing(lv_event_t* e) {
+    ThermostatChart* self = (ThermostatChart*)lv_event_get_user_data(e);
+    if (self->view == VIEW_LIVE || !self->boundRoom || !self->boundRoom->series) return;
+    
+    lv_point_t v;
+    lv_indev_get_vect(lv_indev_get_act(), &v);
+    if (v.x == 0) return;
+    
+    uint32_t now;
+    if (!RoomDataManager::getEpochSeconds(now)) return;
+    
+    // Trascinare verso destra mostra dati più vecchi
+    uint32_t span = self->getSpanSeconds();
+    lv_coord_t width = lv_obj_get_content_width(self->chartObj);
+    if (width <= 0) return;
+    int64_t end = self->viewEnd ? self->viewEnd : now;
+    end -= (int64_t)v.x * span / width;
+    
+    int64_t oldestEnd = (int64_t)self->boundRoom->series->firstTime() + span;
+    if (end < oldestEnd) end = oldestEnd;
+    self->viewEnd = (end >= (int64_t)now) ? 0 : (uint32_t)end;
+    self->renderRange(self->boundRoom);
 }
 
 void ThermostatChart::updateForRoom(int roomIndex) {
@@ -81,31 +376,52 @@ void ThermostatChart::updateForRoom(int roomIndex) {
         init();
         if (!chartObj) return;
     }
-    
-    RoomData& room = roomDataManager.getRoom(roomIndex);
-    
-    lv_chart_series_t* series = lv_chart_get_series_next(chartObj, NULL);
     if (!series) return;
     
-    // Pulisci il grafico
-    lv_chart_set_all_value(chartObj, series, LV_CHART_POINT_NONE);
+    RoomData* room = roomDataManager.getRoom(roomIndex);
+    if (!room) return;
+    
+    if (view != VIEW_LIVE) {
+        if (room != boundRoom) {
+            renderRange(room);
+            return;
+        }
+        // Finestra ferma (pan) o nessun nuovo punto del livello mostrato: niente da fare
+        if (viewEnd != 0 || !room->series) return;
+        if (room->series->lastTime() < renderedUntil + renderedStep) return;
+        renderRange(room);
+        return;
+    }
     
-    // Logica: Mostra sempre gli ultimi 30 minuti disponibili
-    // Se abbiamo meno di 30 punti, li mostriamo tutti partendo da sinistra
-    // Se ne abbiamo più di 30, prendiamo solo gli ultimi 30
+    // Cambio stanza: la serie legge direttamente la traccia della stanza
+    if (room != boundRoom) {
+        bindLive(room);
+        return;
+    }
     
-    const auto& history = room.history;
-    size_t totalPoints = history.size();
-    size_t pointsToShow = (totalPoints > 30) ? 30 : totalPoints;
-    size_t startIndex = (totalPoints > 30) ? (totalPoints - 30) : 0;
+    if (room->traceSeq == boundSeq) return;  // Nessun punto nuovo
     
-    for (size_t i = 0; i < pointsToShow; i++) {
-        float temp = history[startIndex + i].temperature;
-        int16_t val = (int16_t)(temp * 10.0f);
-        lv_chart_set_next_value(chartObj, series, val);
+    // Nuovo punto fuori range: allarga l'asse (ridisegno completo, raro)
+    uint16_t newest = (room->traceHead + ROOM_CHART_POINTS - 1) % ROOM_CHART_POINTS;
+    lv_coord_t v = room->chartTrace[newest];
+    if (v < yMin || v > yMax) {
+        applyYRange(v < yMin ? v : yMin, v > yMax ? v : yMax);
+        boundSeq = room->traceSeq;
+        lv_chart_refresh(chartObj);
+        return;
     }
     
-    lv_chart_refresh(chartObj);
+    if (room->traceSeq - boundSeq == 1) {
+        // Un punto: ridisegna solo il nuovo punto e il separatore che lo segue.
+        // set_value_by_id riscrive lo stesso valore, serve per l'invalidazione locale.
+        uint16_t prev = (room->traceHead + ROOM_CHART_POINTS - 1) % ROOM_CHART_POINTS;
+        lv_chart_set_value_by_id(chartObj, series, prev, room->chartTrace[prev]);
+        lv_chart_set_value_by_id(chartObj, series, room->traceHead, room->chartTrace[room->traceHead]);
+        invalidateXTicks();
+    } else {
+        lv_chart_refresh(chartObj);  // Più punti persi (schermata non visibile): ridisegno completo
+    }
+    boundSeq = room->traceSeq;
 }
 
 // Istanza globale
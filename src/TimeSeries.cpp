@@ -0,0 +1,185 @@
+#include "TimeSeries.h"
+#include <esp_heap_caps.h>
+#include <new>
+
+TimeSeries* TimeSeries::create() {
+    void* mem = heap_caps_malloc(sizeof(TimeSeries), MALLOC_CAP_SPIRAM);
+    if (!mem) mem = heap_caps_malloc(sizeof(TimeSeries), MALLOC_CAP_DEFAULT);
+    if (!mem) return nullptr;
+    TimeSeries* ts = new (mem) TimeSeries();
+    ts->clear();
+    return ts;
+}
+
+void TimeSeries::destroy(TimeSeries* ts) {
+    if (!ts) return;
+    ts->~TimeSeries();
+    heap_caps_free(ts);
+}
+
+size_t TimeSeries::memoryBytes() {
+    return sizeof(TimeSeries);
+}
+
+uint32_t TimeSeries::tierSeconds(Tier tier) {
+    switch (tier) {
+        case TIER_1MIN: return 60;
+        case TIER_15MIN: return 15 * 60;
+        case TIER_1H: return 3600;
+        default: return 1;
+    }
+}
+
+void TimeSeries::clear() {
+    raw.clear();
+    min1.clear();
+    min15.clear();
+    hour.clear();
+    for (auto& b : open) b.count = 0;
+    firstSampleTime = 0;
+    lastSampleTime = 0;
+    hasSamples = false;
+    closedMinute = false;
+}
+
+bool TimeSeries::add(uint32_t time, float value) {
+    if (hasSamples && time < lastSampleTime) return false;
+    if (!hasSamples) firstSampleTime = time;
+    hasSamples = true;
+    lastSampleTime = time;
+
+    closedMinute = false;
+    raw.push({time, value});
+    merge(0, {time, value, value, value, 1});
+    return closedMinute;
+}
+
+void TimeSeries::addMinute(uint32_t time, float value) {
+    if (hasSamples && time < lastSampleTime) return;
+    if (!hasSamples) firstSampleTime = time;
+    hasSamples = true;
+    lastSampleTime = time;
+    merge(0, {time, value, value, value, 1});
+}
+
+bool TimeSeries::lastClosed(Tier tier, SeriesPoint& out) const {
+    const Bucket* b = nullptr;
+    switch (tier) {
+        case TIER_1MIN: if (!min1.empty()) b = &min1.back(); break;
+        case TIER_15MIN: if (!min15.empty()) b = &min15.back(); break;
+        case TIER_1H: if (!hour.empty()) b = &hour.back(); break;
+        default: break;
+    }
+    if (!b) return false;
+    out = {b->time, b->min, b->max, b->sum / b->count};
+    return true;
+}
+
+// Fold b into the open bucket of `level` (0 = 1-min). A bucket from a new period
+// closes the open one, which is stored and cascades into the next coarser level.
+void TimeSeries::merge(int level, const Bucket& b) {
+    Tier tier = (Tier)(TIER_1MIN + level);
+    uint32_t period = tierSeconds(tier);
+    uint32_t start = b.time - (b.time % period);
+    Bucket& o = open[level];
+
+    if (o.count && o.time != start) {
+        Bucket closed = o;
+        o.count = 0;
+        switch (tier) {
+            case TIER_1MIN: min1.push(closed); closedMinute = true; break;
+            case TIER_15MIN: min15.push(closed); break;
+            default: hour.push(closed); break;
+        }
+        if (level + 1 < TIER_COUNT - 1) merge(level + 1, closed);
+    }
+
+    if (!o.count) {
+        o = {start, b.min, b.max, b.sum, b.count};
+        return;
+    }
+    if (b.min < o.min) o.min = b.min;
+    if (b.max > o.max) o.max = b.max;
+    o.sum += b.sum;
+    o.count += b.count;
+}
+
+// Stored buckets plus the open one, which is always the newest point of a tier
+size_t TimeSeries::tierSize(Tier tier) const {
+    switch (tier) {
+        case TIER_RAW: return raw.size();
+        case TIER_1MIN: return min1.size() + (open[0].count ? 1 : 0);
+        case TIER_15MIN: return min15.size() + (open[1].count ? 1 : 0);
+        default: return hour.size() + (open[2].count ? 1 : 0);
+    }
+}
+
+SeriesPoint TimeSeries::tierPoint(Tier tier, size_t i) const {
+    if (tier == TIER_RAW) {
+        const RawSample& s = raw[i];
+        return {s.time, s.value, s.value, s.value};
+    }
+
+    const Bucket* b;
+    int level = tier - TIER_1MIN;
+    switch (tier) {
+        case TIER_1MIN: b = (i < min1.size()) ? &min1[i] : &open[level]; break;
+        case TIER_15MIN: b = (i < min15.size()) ? &min15[i] : &open[level]; break;
+        default: b = (i < hour.size()) ? &hour[i] : &open[level]; break;
+    }
+    return {b->time, b->min, b->max, b->sum / b->count};
+}
+
+uint32_t TimeSeries::tierOldest(Tier tier) const {
+    if (tierSize(tier) == 0) return UINT32_MAX;
+    return tierPoint(tier, 0).time;
+}
+
+// First point whose period ends after `time`
+size_t TimeSeries::lowerBound(Tier tier, uint32_t time) const {
+    uint32_t period = tierSeconds(tier);
+    size_t lo = 0, hi = tierSize(tier);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (tierPoint(tier, mid).time + period <= time) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+size_t TimeSeries::read(Tier tier, uint32_t from, uint32_t to, SeriesPoint* out, size_t maxOut) const {
+    size_t n = 0;
+    size_t size = tierSize(tier);
+    for (size_t i = lowerBound(tier, from); i < size && n < maxOut; i++) {
+        SeriesPoint p = tierPoint(tier, i);
+        if (p.time > to) break;
+        out[n++] = p;
+    }
+    return n;
+}
+
+TimeSeries::Tier TimeSeries::pickTier(uint32_t from, uint32_t to, size_t width) const {
+    // A tier covers the window if it reaches back to `from`, or to the first sample
+    // ever seen when the series is younger than the window.
+    uint32_t needed = (from > firstSampleTime) ? from : firstSampleTime;
+
+    for (int t = TIER_1H; t >= TIER_RAW; t--) {
+        Tier tier = (Tier)t;
+        if (tierOldest(tier) > needed + tierSeconds(tier)) continue;
+        size_t first = lowerBound(tier, from);
+        size_t last = lowerBound(tier, to + tierSeconds(tier)); // first point after `to`
+        if (last - first >= width) return tier;
+    }
+
+    // Nothing fills the width: finest tier that still covers the window
+    for (int t = TIER_RAW; t <= TIER_1H; t++) {
+        Tier tier = (Tier)t;
+        if (tierOldest(tier) <= needed + tierSeconds(tier)) return tier;
+    }
+    return TIER_1H;
+}
+
+size_t TimeSeries::query(uint32_t from, uint32_t to, size_t width, SeriesPoint* out, size_t maxOut) const {
+    if (!hasSamples || to < from) return 0;
+    return read(pickTier(from, to, width), from, to, out, maxOut);
+}
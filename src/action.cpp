@@ -9,23 +9,12 @@ void action_show_thermostat(lv_event_t * e)
 {
     int roomIndex = -1;
     
-    switch((intptr_t)e->user_data)
+    // I pannelli 0..3 della schermata principale mostrano le prime 4 stanze da configurazione
+    roomIndex = (int)(intptr_t)e->user_data;
+    if (!roomDataManager.getRoom(roomIndex))
     {
-        case 0://Camera da letto
-            roomIndex = 0;
-            break;
-        case 1://Salotto
-            roomIndex = 1;
-            break;
-        case 2://Cameretta
-            roomIndex = 2;
-            break;
-        case 3://Bagno
-            roomIndex = 3;
-            break;
-        default:
-            SysLog.log("Action: Show Thermostat (unknown room)");
-            return;
+        SysLog.log("Action: Show Thermostat (unknown room)");
+        return;
     }
     
     // Imposta la stanza corrente
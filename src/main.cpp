@@ -8,6 +8,8 @@
 #include "NetworkUtils.h"
 #include "RoomDataManager.h"
 #include "ThermostatChart.h"
+#include "LogViewer.h"
+#include "JsonAllocator.h"
 #include <ArduinoOTA.h>
 #include <time.h>
 
@@ -270,8 +272,7 @@ static void handleUIUpdates()
     {
         last_ui_update = now;
         // Show the actual main meter consumption as a percentage of configured max_power_w
-        SystemState st = appManager.getSystemState();
-        float currentKw = st.totalPower / 1000.f; // current consumption from shared state
+        float currentKw = appManager.getTotalPower() / 1000.f; // current consumption from shared state
         float maxKw = appManager.getMaxPowerW() / 1000.f;   // configured max power in kW
         int pct = 0;
         
@@ -294,7 +295,37 @@ static void handleUIUpdates()
     }
 }
 
-// Helper: aggiorna dati temperatura ogni 30 secondi
+// Helper: i 4 pannelli stanza della schermata principale mostrano le prime 4 stanze
+static void updateRoomPanels()
+{
+    lv_obj_t* panels[4] = {objects.panel_room_1, objects.panel_room_2, objects.panel_room_3, objects.panel_room_4};
+    lv_obj_t* names[4] = {objects.lbl_name_camera_da_letto, objects.lbl_name_salotto, objects.lbl_name_cameretta, objects.lbl_name_bagno};
+    lv_obj_t* temps[4] = {objects.lbl_temp_camera_da_letto, objects.lbl_temp_salotto, objects.lbl_temp_cameretta, objects.lbl_temp_bagno};
+    
+    for (int i = 0; i < 4; i++)
+    {
+        if (!panels[i]) continue;
+        RoomData* room = roomDataManager.getRoom(i);
+        if (!room)
+        {
+            lv_obj_add_flag(panels[i], LV_OBJ_FLAG_HIDDEN);
+            continue;
+        }
+        lv_obj_clear_flag(panels[i], LV_OBJ_FLAG_HIDDEN);
+        if (strcmp(lv_label_get_text(names[i]), room->roomName.c_str()) != 0)
+            lv_label_set_text(names[i], room->roomName.c_str());
+        
+        char buf[16];
+        if (room->hasTemperature())
+            snprintf(buf, sizeof(buf), "%.1f°C", room->currentTemp);
+        else
+            snprintf(buf, sizeof(buf), "--.-°C");
+        if (strcmp(lv_label_get_text(temps[i]), buf) != 0)
+            lv_label_set_text(temps[i], buf);
+    }
+}
+
+// Helper: aggiorna dati temperatura ogni secondo
 static void handleTemperatureUpdates()
 {
     static uint32_t last_temp_update = 0;
@@ -303,8 +334,17 @@ static void handleTemperatureUpdates()
     {
         last_temp_update = now;
         
-        // Genera temperature casuali per tutte le stanze
-        roomDataManager.generateAllRandomTemps();
+        // Aggregati stanza dalle TRV: solo i dispositivi cambiati dall'ultimo giro
+        static std::vector<DeviceState> changed;
+        appManager.takeChangedDevices(changed);
+        for (const auto& ds : changed)
+            roomDataManager.onDeviceState(ds);
+        roomDataManager.update();
+        updateRoomPanels();
+        
+        // Storico consumi
+        roomDataManager.addPowerSample(appManager.getTotalPower());
+        roomDataManager.loop();
         
         // Se siamo nella schermata termostato, aggiorna il grafico
         static lv_obj_t* lastScreen = nullptr;
@@ -315,6 +355,11 @@ static void handleTemperatureUpdates()
             // Aggiorna il grafico per la stanza corrente
             thermostatChart.updateForRoom(roomDataManager.getCurrentRoomIndex());
         }
+        else if (currentScreen == logViewer.getScreen())
+        {
+            // Righe nuove del log corrente
+            logViewer.update();
+        }
         
         lastScreen = currentScreen;
     }
@@ -363,6 +408,15 @@ static void logBatteryStateFromSystem()
     SysLog.log(s);
 }
 
+// Boot profile: time spent in each setup stage since the previous mark
+static unsigned long bootMarkMs = 0;
+static void bootProfile(const String& stage)
+{
+    unsigned long now = millis();
+    SysLog.log("Boot profile: " + stage + " " + String(now - bootMarkMs) + " ms (at " + String(now) + " ms)");
+    bootMarkMs = now;
+}
+
 void setup()
 {
     // 1. Init Hardware (M5)
@@ -385,6 +439,7 @@ void setup()
 
     SysLog.log("=== HomeAIO Boot Sequence ===");
     SysLog.log("Hardware Initialized");
+    bootProfile("hardware + logging");
 
     if (SysLog.isSdMounted())
         SysLog.log("SD Card Mounted");
@@ -394,16 +449,28 @@ void setup()
     // 4. Init Display Settings
     initDisplay();
     SysLog.log("Display Configured: " + String(screenWidth) + "x" + String(screenHeight));
+    bootProfile("display");
 
     // 5. Start App Logic
     SysLog.log("Starting AppManager...");
     appManager.begin();
     SysLog.log("AppManager Started");
+    const ConfigManager& cfg = appManager.getConfigManager();
+    SysLog.log("Boot profile: config " + String(cfg.getLastLoadMs()) + " ms (" +
+               (cfg.wasLoadedFromCache() ? "snapshot" : "JSON") + ")");
+    bootProfile("AppManager");
+
+    // Rooms come from the device config; then restore the last 24 h of history from SD
+    roomDataManager.begin(appManager.getConfig());
+    roomDataManager.loadHistory();
+    bootProfile("rooms + history");
 
     // 6. Init LVGL
     SysLog.log("Initializing LVGL...");
     initLVGL();
     SysLog.log("LVGL Initialized");
+    bootProfile("LVGL");
+    logHeapStats("Boot");
 
     // 7. Finalize Boot
     SysLog.log("System Ready. Starting UI...");
@@ -429,6 +496,7 @@ void setup()
     // 9. Start UI
     SysLog.log("=== Calling ui_init() ===");
     ui_init();
+    logViewer.attach(objects.panel_sidebar);
     SysLog.log("=== ui_init() completed ===");
 }
 
@@ -0,0 +1,283 @@
+#!/usr/bin/env python3
+"""Decode HomeAIO binary logs (/system.blg, see LogManager.h) back to text.
+
+    python tools/logdecode.py system.blg                # file copied from the SD card
+    python tools/logdecode.py system.blg.2.lz system.blg.1 system.blg   # oldest first
+    python tools/logdecode.py system.log.3.lz           # compressed text generation
+    python tools/logdecode.py --serial COM9             # live serial stream (pyserial)
+    python tools/logdecode.py --udp 5514                # collector for the network sink
+
+Format definitions from every file are read before decoding, so events whose
+definition was written to another file (before a rotation) are still decoded.
+Compressed generations (.lz, see LogArchive.h) are expanded first; text logs are
+printed as they are.
+"""
+import argparse
+import re
+import struct
+import sys
+import time
+
+REC_SYNC = 0xA5
+REC_EVENT = 0
+REC_FORMAT = 1
+LEVEL_UPTIME = 0x80
+REC_MAX = 512
+LEVELS = {0: "INF", 1: "ERR", 2: "DBG"}
+LZ_MAGIC = b"HLZ1"
+
+# printf conversion: flags, width, precision, length, type
+CONV = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|j|z|t|L)?([diuxXocfFeEgGaAspn%])")
+
+
+def lz_frame(src, raw_len):
+    """LogArchive::decompressFrame: token, literals, uint16 offset, match (LZ4 style)."""
+    out = bytearray()
+    i = 0
+
+    def length(n):
+        nonlocal i
+        if n == 15:
+            while True:
+                b = src[i]
+                i += 1
+                n += b
+                if b != 255:
+                    break
+        return n
+
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = length(token >> 4)
+        out += src[i:i + lit]
+        i += lit
+        if i >= len(src):
+            break
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        match = length(token & 15) + 4
+        for _ in range(match):
+            out.append(out[-offset])
+    if len(out) != raw_len:
+        raise ValueError("corrupt frame")
+    return bytes(out)
+
+
+def read_log(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(LZ_MAGIC):
+        return data
+    out = bytearray()
+    i = len(LZ_MAGIC)
+    while i + 4 <= len(data):
+        raw_len, stored = struct.unpack_from("<HH", data, i)
+        i += 4
+        if stored == 0:
+            out += data[i:i + raw_len]
+            i += raw_len
+        else:
+            out += lz_frame(data[i:i + stored], raw_len)
+            i += stored
+    return bytes(out)
+
+
+def records(data):
+    """Yield (type, payload), resynchronising on REC_SYNC after garbage."""
+    i = 0
+    while i + 4 <= len(data):
+        if data[i] != REC_SYNC or data[i + 1] not in (REC_EVENT, REC_FORMAT):
+            i += 1
+            continue
+        length = struct.unpack_from("<H", data, i + 2)[0]
+        if length > REC_MAX or i + 4 + length > len(data):
+            i += 1
+            continue
+        yield data[i + 1], data[i + 4:i + 4 + length]
+        i += 4 + length
+
+
+def parse_format(payload):
+    fmt_id, source, file_len = struct.unpack_from("<IHB", payload, 0)
+    name = payload[7:7 + file_len].decode("utf-8", "replace")
+    fmt = payload[7 + file_len:].decode("utf-8", "replace")
+    return fmt_id, source, name, fmt
+
+
+def render(fmt, args):
+    """Unpack the arguments in the order LogManager packed them and format with Python %."""
+    out = []
+    pos = 0
+    last = 0
+
+    def take(size, code):
+        nonlocal pos
+        if pos + size > len(args):
+            raise IndexError
+        value = struct.unpack_from(code, args, pos)[0]
+        pos += size
+        return value
+
+    for m in CONV.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, prec, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        try:
+            values = []
+            if width == "*":
+                width = str(take(4, "<i"))
+            if prec == "*":
+                prec = str(take(4, "<i"))
+            wide = length in ("ll", "j")
+            if conv in "di":
+                values.append(take(8, "<q") if wide else take(4, "<i"))
+            elif conv in "uxXo":
+                values.append(take(8, "<Q") if wide else take(4, "<I"))
+                conv = "d" if conv == "u" else conv
+            elif conv == "c":
+                values.append(take(4, "<i") & 0xFF)
+            elif conv in "fFeEgGaA":
+                values.append(take(4, "<f"))
+                conv = {"a": "e", "A": "E"}.get(conv, conv)
+            elif conv == "s":
+                n = take(1, "<B")
+                if pos + n > len(args):
+                    raise IndexError
+                values.append(args[pos:pos + n].decode("utf-8", "replace"))
+                pos += n
+            elif conv == "p":
+                values.append(take(4, "<I"))
+                conv, flags = "x", "#"
+            elif conv == "n":
+                continue
+            spec = "%" + (flags or "") + (width or "") + ("." + prec if prec is not None else "")
+            out.append((spec + conv) % tuple(values))
+        except (IndexError, struct.error):
+            out.append("?")
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def decode_event(payload, formats, show_source):
+    sec, ms, level, source, fmt_id = struct.unpack_from("<IHBHI", payload, 0)
+    args = payload[13:]
+    if level & LEVEL_UPTIME:
+        stamp = "%d.%03ds" % (sec, ms)
+    else:
+        stamp = time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(sec))
+    tag = LEVELS.get(level & 0x7F, "L%d" % (level & 0x7F))
+
+    if fmt_id == 0:
+        msg = args.decode("utf-8", "replace")
+        name = None
+    elif fmt_id in formats:
+        name, fmt = formats[fmt_id]
+        msg = render(fmt, args)
+    else:
+        name = "src%04x" % source
+        msg = "<format %08x> %s" % (fmt_id, args.hex())
+    if show_source and name:
+        msg = name + ": " + msg
+    return "%s [%s]: %s" % (stamp, tag, msg)
+
+
+def decode_files(paths, show_source, out):
+    blobs = []
+    for path in paths:
+        data = read_log(path)
+        if ".blg" not in path:
+            out.write(data.decode("utf-8", "replace").replace("\r\n", "\n"))
+            continue
+        blobs.append(data)
+    formats = {}
+    for data in blobs:
+        for rtype, payload in records(data):
+            if rtype == REC_FORMAT:
+                fmt_id, _, name, fmt = parse_format(payload)
+                formats[fmt_id] = (name, fmt)
+    for data in blobs:
+        for rtype, payload in records(data):
+            if rtype == REC_EVENT:
+                out.write(decode_event(payload, formats, show_source) + "\n")
+
+
+def decode_serial(port, baud, show_source, out):
+    import serial  # pyserial, only needed for live decoding
+
+    formats = {}
+    buf = bytearray()
+    with serial.Serial(port, baud, timeout=0.2) as s:
+        while True:
+            buf += s.read(4096)
+            consumed = 0
+            i = 0
+            while i + 4 <= len(buf):
+                if buf[i] != REC_SYNC or buf[i + 1] not in (REC_EVENT, REC_FORMAT):
+                    i += 1
+                    consumed = i
+                    continue
+                length = struct.unpack_from("<H", buf, i + 2)[0]
+                if length > REC_MAX:
+                    i += 1
+                    consumed = i
+                    continue
+                if i + 4 + length > len(buf):
+                    break  # Wait for the rest of the record
+                payload = bytes(buf[i + 4:i + 4 + length])
+                if buf[i + 1] == REC_FORMAT:
+                    fmt_id, _, name, fmt = parse_format(payload)
+                    formats[fmt_id] = (name, fmt)
+                else:
+                    out.write(decode_event(payload, formats, show_source) + "\n")
+                    out.flush()
+                i += 4 + length
+                consumed = i
+            del buf[:consumed]
+
+
+def decode_udp(port, show_source, out):
+    """Local collector: RFC 5424 datagrams are printed as they are, binary ones decoded."""
+    import socket
+
+    formats = {}
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", port))
+    while True:
+        data, addr = sock.recvfrom(2048)
+        if data[:1] == b"<":
+            out.write("%s %s\n" % (addr[0], data.decode("utf-8", "replace")))
+        else:
+            for rtype, payload in records(data):
+                if rtype == REC_FORMAT:
+                    fmt_id, _, name, fmt = parse_format(payload)
+                    formats[fmt_id] = (name, fmt)
+                else:
+                    out.write("%s %s\n" % (addr[0], decode_event(payload, formats, show_source)))
+        out.flush()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("files", nargs="*", help="binary log files, oldest first")
+    ap.add_argument("--serial", metavar="PORT", help="decode the live serial stream")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--udp", type=int, metavar="PORT", help="listen for the network log sink")
+    ap.add_argument("--source", action="store_true", help="prefix messages with the source file")
+    opts = ap.parse_args()
+
+    if opts.udp:
+        decode_udp(opts.udp, opts.source, sys.stdout)
+    elif opts.serial:
+        decode_serial(opts.serial, opts.baud, opts.source, sys.stdout)
+    elif opts.files:
+        decode_files(opts.files, opts.source, sys.stdout)
+    else:
+        ap.error("no input: give log files, --serial PORT or --udp PORT")
+
+
+if __name__ == "__main__":
+    main()